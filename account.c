@@ -0,0 +1,549 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <sys/syscall.h>
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "account.h"
+#include "utils.h"
+
+#define ACCOUNT_MAX_FD_LEAKS	16
+#define ACCOUNT_TEXT_MAX	48
+
+// Blocks of up to this size get a header: with it, they still fit in
+// glibc's per-thread cache (1032 bytes), the fast path
+#define ACCOUNT_HEADER_MAX	1016
+
+// glibc's chunk size field, right before the block, of the smallest block
+// too big for a header
+#define ACCOUNT_BIG_CHUNK	1040
+
+// In the header; glibc's chunk size fields stay below 2^48
+#define ACCOUNT_MAGIC		0xacc0u
+#define ACCOUNT_SIZE_TAG	(0xa5a5ULL << 48)
+#define ACCOUNT_SIZE_MASK	((1ULL << 48) - 1)
+
+#define ACCOUNT_MIN_TABLE	64
+
+// A table slot whose block was freed
+#define ACCOUNT_TOMBSTONE	((void *)1)
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+extern void __libc_free(void *p);
+
+struct account_stats {
+	unsigned long long calls, allocs, bytes;
+	unsigned long long live, live_bytes;
+};
+
+/**
+ * Right before a small block allocated under a site, so that freeing it
+ * needs no lookup; 16 bytes, as glibc's alignment.
+ */
+struct account_header {
+	uint32_t magic;
+	uint32_t site;
+	uint64_t size;		/* | ACCOUNT_SIZE_TAG */
+};
+
+/**
+ * A big block allocated under a site.
+ */
+struct account_slot {
+	void *p;
+	size_t size;
+	enum account_site site;
+};
+
+/**
+ * Statements (the last one's text) that left fds open.
+ */
+struct account_fd_leak {
+	int first_line, last_line, opened;
+	char text[ACCOUNT_TEXT_MAX];
+};
+
+static const char * const site_names[ACCOUNT_SITES] = {
+	[ACCOUNT_GET_WORD] = "get_word",
+	[ACCOUNT_GET_ARGV] = "get_argv",
+	[ACCOUNT_READ_LINE] = "read_line",
+	[ACCOUNT_PARSER] = "parser",
+};
+
+static bool enabled;
+static enum account_site current;
+static struct account_stats stats[ACCOUNT_SITES];
+
+// Open addressing, linear probing; used counts tombstones too
+static struct account_slot *table;
+static size_t table_size, table_used;
+
+static int fd_dir = -1;
+static int fds_last, fds_max, fd_leaks;
+static struct account_fd_leak leaks[ACCOUNT_MAX_FD_LEAKS];
+
+// The statements since the fds were last counted (the first and last
+// one's line), and how many to let through before counting again
+static int window_line, window_last;
+static int64_t window, window_size, last_count;
+
+static size_t slot_of(const void *p)
+{
+	// Blocks are 16-byte aligned: the low bits say nothing
+	return ((uintptr_t)p >> 4) * 0x9e3779b97f4a7c15ULL
+		& (table_size - 1);
+}
+
+static void table_insert(void *p, size_t size, enum account_site site);
+
+/**
+ * Grow the table (or only drop its tombstones), keeping it at most half
+ * full.
+ */
+static void table_grow(void)
+{
+	struct account_slot *old = table;
+	size_t old_size = table_size;
+	size_t live = 0;
+
+	for (size_t i = 0; i < old_size; i++)
+		live += old[i].p > ACCOUNT_TOMBSTONE;
+
+	table_size = ACCOUNT_MIN_TABLE;
+	while (table_size < 4 * live)
+		table_size *= 2;
+
+	table = __libc_calloc(table_size, sizeof(*table));
+	DIE(table == NULL, "Error allocating accounting table.");
+	table_used = 0;
+
+	for (size_t i = 0; i < old_size; i++)
+		if (old[i].p > ACCOUNT_TOMBSTONE)
+			table_insert(old[i].p, old[i].size, old[i].site);
+
+	__libc_free(old);
+}
+
+static void table_insert(void *p, size_t size, enum account_site site)
+{
+	if (2 * (table_used + 1) > table_size)
+		table_grow();
+
+	size_t i = slot_of(p);
+
+	while (table[i].p > ACCOUNT_TOMBSTONE)
+		i = (i + 1) & (table_size - 1);
+
+	table_used += table[i].p == NULL;
+	table[i] = (struct account_slot){ p, size, site };
+}
+
+/**
+ * Take p out of the table, if it is there.
+ *
+ * @return its slot's contents, with site ACCOUNT_NONE if it was not there
+ */
+static struct account_slot table_remove(void *p)
+{
+	struct account_slot found = { NULL, 0, ACCOUNT_NONE };
+
+	if (table_size == 0)
+		return found;
+
+	for (size_t i = slot_of(p); table[i].p != NULL;
+			i = (i + 1) & (table_size - 1)) {
+		if (table[i].p != p)
+			continue;
+
+		found = table[i];
+		table[i].p = ACCOUNT_TOMBSTONE;
+		break;
+	}
+
+	return found;
+}
+
+/**
+ * Find the header of p, if it is a small block allocated under a site.
+ */
+static struct account_header *header_of(void *p)
+{
+	struct account_header *h = (struct account_header *)p - 1;
+
+	if ((h->size & ~ACCOUNT_SIZE_MASK) != ACCOUNT_SIZE_TAG
+			|| h->magic != ACCOUNT_MAGIC)
+		return NULL;
+
+	return h;
+}
+
+/**
+ * Check if p, not a small block allocated under a site, may be a big one.
+ */
+static bool maybe_big(void *p)
+{
+	return (((uint64_t *)p)[-1] & ~7ULL) >= ACCOUNT_BIG_CHUNK;
+}
+
+/**
+ * What glibc must allocate for a block of size bytes under a site.
+ */
+static size_t raw_size(size_t size)
+{
+	return size <= ACCOUNT_HEADER_MAX ? sizeof(struct account_header) + size
+		: size;
+}
+
+/**
+ * Account the block allocated at raw to site, as live.
+ *
+ * @return the block to hand out
+ */
+static void *track(void *raw, enum account_site site, size_t size)
+{
+	stats[site].live++;
+	stats[site].live_bytes += size;
+
+	if (size > ACCOUNT_HEADER_MAX) {
+		table_insert(raw, size, site);
+		return raw;
+	}
+
+	struct account_header *h = raw;
+
+	h->magic = ACCOUNT_MAGIC;
+	h->site = site;
+	h->size = size | ACCOUNT_SIZE_TAG;
+
+	return h + 1;
+}
+
+/**
+ * Stop accounting p as live, if it is accounted.
+ *
+ * @param old set to where and how big it was (site ACCOUNT_NONE if it is
+ * not accounted)
+ *
+ * @return the block glibc allocated for p
+ */
+static void *untrack(void *p, struct account_slot *old)
+{
+	struct account_header *h = header_of(p);
+
+	if (h != NULL) {
+		old->site = h->site;
+		old->size = h->size & ACCOUNT_SIZE_MASK;
+
+		// A stale header must not be taken for a live one
+		h->magic = 0;
+	} else {
+		old->site = ACCOUNT_NONE;
+		if (maybe_big(p))
+			*old = table_remove(p);
+	}
+
+	if (old->site != ACCOUNT_NONE) {
+		stats[old->site].live--;
+		stats[old->site].live_bytes -= old->size;
+	}
+
+	return h != NULL ? (void *)h : p;
+}
+
+static void *account_alloc(void *raw, size_t size)
+{
+	if (raw == NULL)
+		return NULL;
+
+	stats[current].allocs++;
+	stats[current].bytes += size;
+
+	return track(raw, current, size);
+}
+
+__attribute__((weak)) void *malloc(size_t size)
+{
+	if (!enabled || current == ACCOUNT_NONE)
+		return __libc_malloc(size);
+
+	return account_alloc(__libc_malloc(raw_size(size)), size);
+}
+
+__attribute__((weak)) void *calloc(size_t n, size_t size)
+{
+	if (!enabled || current == ACCOUNT_NONE)
+		return __libc_calloc(n, size);
+
+	if (size != 0 && n > (SIZE_MAX - sizeof(struct account_header)) / size)
+		return NULL;
+
+	return account_alloc(__libc_calloc(1, raw_size(n * size)), n * size);
+}
+
+__attribute__((weak)) void free(void *p)
+{
+	struct account_slot old;
+
+	if (!enabled || p == NULL) {
+		__libc_free(p);
+		return;
+	}
+
+	__libc_free(untrack(p, &old));
+}
+
+__attribute__((weak)) void *realloc(void *p, size_t size)
+{
+	if (!enabled)
+		return __libc_realloc(p, size);
+
+	if (p == NULL)
+		return malloc(size);
+
+	if (size == 0) {
+		free(p);
+		return NULL;
+	}
+
+	struct account_slot old;
+	void *raw = untrack(p, &old);
+
+	// A block of no site grown under one (e.g. a buffer the parser
+	// keeps) is counted, but not made the site's
+	if (old.site == ACCOUNT_NONE) {
+		if (current != ACCOUNT_NONE) {
+			stats[current].allocs++;
+			stats[current].bytes += size;
+		}
+		return __libc_realloc(p, size);
+	}
+
+	// Grown under no site, it stays its own site's
+	enum account_site site = current != ACCOUNT_NONE ? current : old.site;
+	size_t old_off = (char *)p - (char *)raw;
+	size_t new_off = raw_size(size) - size;
+	void *q = __libc_realloc(raw, size + (old_off > new_off ? old_off
+				: new_off));
+
+	// The old block stays as it was if the new one cannot be had
+	if (q == NULL) {
+		track(raw, old.site, old.size);
+		return NULL;
+	}
+
+	// The data moves with the header coming or going
+	if (new_off > old_off)
+		memmove((char *)q + new_off, q, size);
+	else if (new_off < old_off)
+		memmove(q, (char *)q + old_off, old.size);
+
+	stats[site].allocs++;
+	stats[site].bytes += size;
+
+	return track(q, site, size);
+}
+
+/**
+ * Count the open fds, but the one counting them.
+ */
+static int count_fds(void)
+{
+	char buf[4096];
+	long n;
+	int count = 0;
+
+	if (fd_dir < 0 || lseek(fd_dir, 0, SEEK_SET) < 0)
+		return -1;
+
+	// getdents64() neither allocates nor goes through a DIR
+	while ((n = syscall(SYS_getdents64, fd_dir, buf, sizeof(buf))) > 0) {
+		for (long off = 0; off < n; ) {
+			unsigned short reclen;
+			const char *name = buf + off + 19;
+
+			memcpy(&reclen, buf + off + 16, sizeof(reclen));
+			count += name[0] != '.';
+			off += reclen;
+		}
+	}
+
+	return n < 0 ? -1 : count - 1;
+}
+
+void account_init(void)
+{
+	const char *value = getenv("MINISHELL_ACCOUNT");
+
+	if (value == NULL || strcmp(value, "1"))
+		return;
+
+	// Out of the way of the fds scripts use (e.g. 'exec 3>file')
+	int fd = open("/proc/self/fd", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+	if (fd >= 0) {
+		fd_dir = fcntl(fd, F_DUPFD_CLOEXEC, SHELL_FD_MIN);
+		close(fd);
+	}
+
+	enabled = true;
+	account_fds_mark();
+}
+
+enum account_site account_enter(enum account_site site)
+{
+	enum account_site prev = current;
+
+	if (enabled && prev == ACCOUNT_NONE) {
+		current = site;
+		stats[site].calls++;
+	}
+
+	return prev;
+}
+
+void account_leave(enum account_site prev)
+{
+	if (enabled)
+		current = prev;
+}
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Count the open fds now, closing the window of statements, the last one
+ * (text, if known) at line.
+ */
+static void fds_count(int line, const char *text)
+{
+	int64_t start = now_ns();
+	int fds = count_fds();
+	int64_t end = now_ns();
+
+	// Size the next window to take ACCOUNT_FD_RATIO times the count
+	window_size = (end - start) * ACCOUNT_FD_RATIO * window
+		/ (start - last_count + 1) + 1;
+	window = 0;
+	last_count = end;
+
+	if (fds > fds_max)
+		fds_max = fds;
+
+	if (fds > fds_last && fd_leaks < ACCOUNT_MAX_FD_LEAKS) {
+		struct account_fd_leak *l = &leaks[fd_leaks];
+
+		l->first_line = window_line;
+		l->last_line = line;
+		l->opened = fds - fds_last;
+		snprintf(l->text, sizeof(l->text), "%s", text);
+
+		// One line in the report
+		for (char *c = l->text; *c != '\0'; c++)
+			if (*c == '\n')
+				*c = ' ';
+	}
+
+	fd_leaks += fds > fds_last;
+	fds_last = fds;
+	window_line = 0;
+}
+
+void account_fds_check(int line, const char *text)
+{
+	if (!enabled)
+		return;
+
+	if (window_line == 0)
+		window_line = line;
+	window_last = line;
+
+	// Fast statements are counted together, which keeps the cost low
+	if (++window < window_size)
+		return;
+
+	fds_count(line, text);
+}
+
+void account_fds_mark(void)
+{
+	if (!enabled)
+		return;
+
+	fds_last = count_fds();
+	window_line = window = 0;
+	last_count = now_ns();
+}
+
+void account_print(FILE *out)
+{
+	if (!enabled)
+		return;
+
+	fprintf(out, "account: %-10s %10s %10s %12s %8s %12s\n", "site",
+			"calls", "allocs", "bytes", "live", "live bytes");
+
+	for (int i = ACCOUNT_NONE + 1; i < ACCOUNT_SITES; i++) {
+		const struct account_stats *st = &stats[i];
+
+		fprintf(out, "account: %-10s %10llu %10llu %12llu %8llu %12llu\n",
+				site_names[i], st->calls, st->allocs,
+				st->bytes, st->live, st->live_bytes);
+	}
+
+	fprintf(out, "account: %d fds open, at most %d", fds_last, fds_max);
+	if (fd_leaks > 0)
+		fprintf(out, "; left open %d times", fd_leaks);
+	fprintf(out, "\n");
+
+	for (int i = 0; i < fd_leaks && i < ACCOUNT_MAX_FD_LEAKS; i++) {
+		const struct account_fd_leak *l = &leaks[i];
+
+		// Counted at exit, the last statement's text is gone
+		if (l->text[0] == '\0')
+			fprintf(out, "account:   lines %d-%d: +%d\n",
+					l->first_line, l->last_line, l->opened);
+		else if (l->first_line == l->last_line)
+			fprintf(out, "account:   line %d: +%d '%s'\n",
+					l->last_line, l->opened, l->text);
+		else
+			fprintf(out, "account:   lines %d-%d: +%d (last '%s')\n",
+					l->first_line, l->last_line, l->opened,
+					l->text);
+	}
+}
+
+void account_report(void)
+{
+	// The statements not counted yet may have left some open too (a
+	// builtin cannot tell: its saved fds are open while it runs)
+	if (enabled && window > 0)
+		fds_count(window_last, "");
+
+	account_print(stderr);
+}
+
+int account_stat(int argc, char **argv)
+{
+	if (!enabled) {
+		printf("no accounting (MINISHELL_ACCOUNT is not set)\n");
+		return 0;
+	}
+
+	account_print(stdout);
+
+	return 0;
+}
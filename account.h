@@ -0,0 +1,87 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _ACCOUNT_H
+#define _ACCOUNT_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#define ACCOUNT_FD_RATIO	50
+
+/*
+ * Allocation and fd accounting, enabled by setting MINISHELL_ACCOUNT=1: a
+ * cheap stand-in for Valgrind on real workloads.
+ *
+ * Allocations are attributed to the call site they are made under (the
+ * outermost one, so the words of get_argv() count for get_argv()): the
+ * calls, the allocations and the bytes asked for, and those still live.
+ * What is live at exit and was not handed to a longer-lived structure is
+ * a leak. The shell's malloc(), calloc(), realloc() and free() count them
+ * and forward to the C library's allocator; the small blocks allocated
+ * under a site get a header naming it, so that freeing one needs no lookup,
+ * and the big ones (fewer, and past the allocator's fast path anyway) an
+ * entry in a table.
+ * They are weak, so a program linking the library with its own allocator
+ * still uses its own.
+ *
+ * The shell's open fds are counted after each statement, and the
+ * statements that leave more of them open are reported. Counting takes a
+ * few system calls; to stay cheap, it is only done once enough statements
+ * ran to take ACCOUNT_FD_RATIO times as long as the count (every one of
+ * them when they run commands), and a leak is then reported for the range
+ * of statements since.
+ *
+ * The report is printed at exit, and by the 'account' builtin.
+ */
+
+enum account_site {
+	ACCOUNT_NONE,
+	ACCOUNT_GET_WORD,
+	ACCOUNT_GET_ARGV,
+	ACCOUNT_READ_LINE,
+	ACCOUNT_PARSER,
+	ACCOUNT_SITES
+};
+
+/**
+ * Read MINISHELL_ACCOUNT; called once, at startup.
+ */
+void account_init(void);
+
+/**
+ * Attribute the allocations made until account_leave() to site, unless an
+ * outer site already has them.
+ *
+ * @return what to pass to account_leave()
+ */
+enum account_site account_enter(enum account_site site);
+
+void account_leave(enum account_site prev);
+
+/**
+ * Take the shell's open fds as they are now as the ones it should have.
+ */
+void account_fds_mark(void);
+
+/**
+ * Count the shell's open fds after the statement text, at line, and note
+ * it if it (or one since the last count) left some open.
+ */
+void account_fds_check(int line, const char *text);
+
+/**
+ * Print the report, if accounting, to out.
+ */
+void account_print(FILE *out);
+
+/**
+ * Print the report to the standard error, at exit.
+ */
+void account_report(void);
+
+/**
+ * account: print the report now.
+ */
+int account_stat(int argc, char **argv);
+
+#endif /* _ACCOUNT_H */
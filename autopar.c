@@ -0,0 +1,233 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "autopar.h"
+#include "cmd.h"
+#include "dirs.h"
+#include "jobs.h"
+#include "plan.h"
+#include "redir.h"
+#include "prefix.h"
+#include "utils.h"
+
+struct access {
+	char *path;		/* absolute */
+	bool write;
+};
+
+/**
+ * The files a pure command of the current run uses.
+ */
+struct access_set {
+	struct access *acc;
+	int nacc;
+};
+
+bool autopar_enabled(void)
+{
+	const char *value = getenv("MINISHELL_AUTOPAR");
+
+	return value != NULL && *value != '\0' && strcmp(value, "0");
+}
+
+/**
+ * Append the commands of the ';' chain rooted at c, in order.
+ */
+static void chain_collect(command_t *c, command_t ***cmds, int *n, int *size)
+{
+	if (c->op == OP_SEQUENTIAL) {
+		chain_collect(c->cmd1, cmds, n, size);
+		chain_collect(c->cmd2, cmds, n, size);
+		return;
+	}
+
+	if (*n == *size) {
+		*size = *size ? 2 * *size : 16;
+		*cmds = realloc(*cmds, *size * sizeof(**cmds));
+		DIE(*cmds == NULL, "Error allocating command chain.");
+	}
+
+	(*cmds)[(*n)++] = c;
+}
+
+static bool is_pure(const command_t *c)
+{
+	const word_t *verb = c->op == OP_NONE ? c->scmd->verb : NULL;
+
+	return verb != NULL && verb->next_part == NULL && !verb->expand
+		&& !strcmp(verb->string, "pure");
+}
+
+static void set_add(struct access_set *set, const char *path, bool write)
+{
+	set->acc = realloc(set->acc, (set->nacc + 1) * sizeof(*set->acc));
+	DIE(set->acc == NULL, "Error allocating access set.");
+
+	set->acc[set->nacc].path = dirs_absolute(path);
+	set->acc[set->nacc].write = write;
+	set->nacc++;
+}
+
+static void set_add_word(struct access_set *set, word_t *w, bool write)
+{
+	char *path = get_word(w);
+
+	if (path != NULL)
+		set_add(set, path, write);
+	free(path);
+}
+
+/**
+ * Collect the files a pure command uses: its redirection targets and the
+ * declared ones. Words are expanded now, once everything before the run
+ * has finished.
+ */
+static void set_collect(struct access_set *set, command_t *c)
+{
+	simple_command_t *s = c->scmd;
+	struct prefix_attrs attrs;
+	int argc = 0;
+	char **argv = get_argv(s, &argc);
+
+	if (prefix_parse(argv, argc, &attrs) >= 0)
+		for (int i = 0; i < attrs.nfiles; i++)
+			set_add(set, argv[attrs.files[i].arg],
+					attrs.files[i].write);
+	free_argv(argv, argc);
+
+	set_add_word(set, s->in, false);
+	set_add_word(set, s->out, true);
+	set_add_word(set, s->err, true);
+
+	for (const struct fd_redir *r = plan_redirections(s); r != NULL;
+			r = r->next)
+		if (r->kind == REDIR_FILE)
+			set_add_word(set, r->file,
+					(r->flags & O_ACCMODE) != O_RDONLY);
+}
+
+/**
+ * Check if a and b must not run at the same time: one of them writes a
+ * file the other one uses.
+ */
+static bool set_conflict(const struct access_set *a,
+		const struct access_set *b)
+{
+	for (int i = 0; i < a->nacc; i++) {
+		for (int k = 0; k < b->nacc; k++) {
+			const struct access *x = &a->acc[i], *y = &b->acc[k];
+
+			if ((x->write || y->write) && !strcmp(x->path, y->path))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+static bool job_ready(const struct job *jobs, const struct access_set *sets,
+		int idx)
+{
+	for (int i = 0; i < idx; i++)
+		if (jobs[i].state != JOB_DONE && set_conflict(&sets[i],
+					&sets[idx]))
+			return false;
+
+	return true;
+}
+
+static int run_command(void *arg)
+{
+	command_t *c = arg;
+
+	return parse_command(c, 0, c->up);
+}
+
+/**
+ * Run consecutive pure commands concurrently.
+ *
+ * @return the exit status of the last one
+ */
+static int run_group(command_t **cmds, int n)
+{
+	struct job *jobs = calloc(n, sizeof(*jobs));
+	struct access_set *sets = calloc(n, sizeof(*sets));
+	int limit = jobs_limit();
+	int running = 0, flushed = 0;
+
+	DIE(jobs == NULL || sets == NULL, "Error allocating jobs.");
+
+	for (int i = 0; i < n; i++) {
+		jobs[i].run = run_command;
+		jobs[i].arg = cmds[i];
+		jobs[i].out_fd = -1;
+		jobs[i].err_fd = -1;
+		set_collect(&sets[i], cmds[i]);
+	}
+
+	while (flushed < n) {
+		for (int i = flushed; i < n && running < limit; i++)
+			if (jobs[i].state == JOB_WAITING
+					&& job_ready(jobs, sets, i)
+					&& job_start(&jobs[i]))
+				running++;
+
+		// Only the group's own children are reaped; if they cannot be
+		// waited for, they are all done (failed) and none is running
+		if (running > 0)
+			running = jobs_reap(jobs, n) >= 0 ? running - 1 : 0;
+
+		// Write out the finished prefix of the run, in order
+		while (flushed < n && jobs[flushed].state == JOB_DONE)
+			job_flush(&jobs[flushed++]);
+	}
+
+	int ret = jobs[n - 1].status;
+
+	for (int i = 0; i < n; i++) {
+		for (int k = 0; k < sets[i].nacc; k++)
+			free(sets[i].acc[k].path);
+		free(sets[i].acc);
+	}
+	free(sets);
+	free(jobs);
+
+	return ret;
+}
+
+int autopar_run(command_t *c, int level)
+{
+	command_t **cmds = NULL;
+	int n = 0, size = 0;
+	int ret = 0;
+
+	chain_collect(c, &cmds, &n, &size);
+
+	for (int i = 0; i < n; ) {
+		int end = i + 1;
+
+		if (is_pure(cmds[i]))
+			while (end < n && is_pure(cmds[end]))
+				end++;
+
+		if (end - i > 1)
+			ret = run_group(cmds + i, end - i);
+		else
+			ret = parse_command(cmds[i], level, cmds[i]->up);
+
+		// Like a plain ';' chain, stop when the shell must exit
+		if (ret < 0 && end < n)
+			break;
+
+		i = end;
+	}
+
+	free(cmds);
+
+	return ret;
+}
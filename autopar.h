@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _AUTOPAR_H
+#define _AUTOPAR_H
+
+#include <stdbool.h>
+
+#include "../util/parser/parser.h"
+
+/*
+ * Concurrent execution of the independent commands of a ';' chain, enabled
+ * by setting MINISHELL_AUTOPAR=1.
+ *
+ * Only commands marked with the 'pure' prefix take part: such a command
+ * touches nothing but its redirection targets and the files declared with
+ * 'pure -r FILE' (read) and 'pure -w FILE' (written), and reads /dev/null
+ * unless its input is redirected. Consecutive pure commands run at the
+ * same time, up to jobs_limit() of them (see jobs.h), except that a
+ * command waits for every earlier command of the run that writes a file
+ * it uses or uses a file it writes. Any other command is a barrier and
+ * runs alone, after everything before it.
+ *
+ * The standard output and error of each concurrent command are buffered
+ * and written out in the order of the chain, each command's output once
+ * it finished and all the ones before it were written (its standard error
+ * after its standard output).
+ */
+
+/**
+ * Check if MINISHELL_AUTOPAR is set.
+ */
+bool autopar_enabled(void);
+
+/**
+ * Run a ';' chain, whose root is c.
+ *
+ * @return the exit status of the last command, or the negative value (e.g.
+ * SHELL_EXIT) that stopped the chain
+ */
+int autopar_run(command_t *c, int level);
+
+#endif /* _AUTOPAR_H */
@@ -0,0 +1,243 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+/*
+ * Microbenchmarks of the word and line helpers of utils.c: get_word(),
+ * get_argv() and read_line(), run in-process on synthetic parser output
+ * and large inputs.
+ *
+ *	make mini-bench && ./mini-bench [FILTER]
+ *
+ * Each benchmark runs for at least BENCH_MIN_NS, in doubling batches, and
+ * reports the time, the allocations and the bytes allocated per operation.
+ * Allocations are counted by the malloc(), calloc() and realloc() of this
+ * binary, which take the place of the C library's for everything it links
+ * (strdup() included); every call that asks for memory counts as one
+ * allocation of the size asked for, a growing realloc() too.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "utils.h"
+
+#define BENCH_MIN_NS		(200 * 1000 * 1000LL)
+#define BENCH_MAX_BATCH		(1 << 20)
+#define BENCH_INPUT_SIZE	(8 << 20)
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+
+static bool counting;
+static uint64_t allocs, alloc_bytes;
+
+void *malloc(size_t size)
+{
+	if (counting) {
+		allocs++;
+		alloc_bytes += size;
+	}
+
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+	if (counting) {
+		allocs++;
+		alloc_bytes += n * size;
+	}
+
+	return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size)
+{
+	if (counting && size > 0) {
+		allocs++;
+		alloc_bytes += size;
+	}
+
+	return __libc_realloc(p, size);
+}
+
+struct bench {
+	const char *name;
+	void (*op)(void *arg);
+	void *arg;
+};
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * Synthetic parser output
+ */
+
+/**
+ * Build a word of nparts parts, each part in every_expand a parameter
+ * expansion (of spec) and the others literal text.
+ */
+static word_t *make_word(int nparts, int every_expand, const char *spec)
+{
+	word_t *parts = calloc(nparts, sizeof(*parts));
+
+	DIE(parts == NULL, "Error allocating word.");
+
+	for (int i = 0; i < nparts; i++) {
+		bool expand = every_expand > 0 && i % every_expand == 0;
+
+		parts[i].string = expand ? spec : "literal-";
+		parts[i].expand = expand;
+		parts[i].next_part = i + 1 < nparts ? &parts[i + 1] : NULL;
+	}
+
+	return parts;
+}
+
+/**
+ * Build a command with nargs arguments of nparts parts each.
+ */
+static simple_command_t *make_command(int nargs, int nparts)
+{
+	simple_command_t *s = calloc(1, sizeof(*s));
+
+	DIE(s == NULL, "Error allocating command.");
+
+	s->verb = make_word(1, 0, NULL);
+
+	word_t **next = &s->params;
+
+	for (int i = 0; i < nargs; i++) {
+		*next = make_word(nparts, 4, "BENCH_VAR");
+		next = &(*next)->next_word;
+	}
+
+	return s;
+}
+
+/**
+ * Build an input of lines of length line_len, as a file.
+ */
+static FILE *make_input(size_t line_len)
+{
+	FILE *in = tmpfile();
+	char *line = malloc(line_len + 1);
+
+	DIE(in == NULL || line == NULL, "Error creating input.");
+
+	for (size_t i = 0; i < line_len; i++)
+		line[i] = 'a' + i % 26;
+	line[line_len] = '\n';
+
+	for (size_t n = 0; n < BENCH_INPUT_SIZE; n += line_len + 1)
+		fwrite(line, 1, line_len + 1, in);
+
+	free(line);
+	rewind(in);
+
+	return in;
+}
+
+/*
+ * Operations
+ */
+
+static void op_get_word(void *arg)
+{
+	free(get_word(arg));
+}
+
+static void op_get_argv(void *arg)
+{
+	int argc;
+	char **argv = get_argv(arg, &argc);
+
+	free_argv(argv, argc);
+}
+
+static void op_read_line(void *arg)
+{
+	char *line = read_line(arg);
+
+	// Start over at the end of the input
+	if (line == NULL) {
+		rewind(arg);
+		line = read_line(arg);
+	}
+
+	free(line);
+}
+
+static void bench_run(const struct bench *b)
+{
+	uint64_t ops = 0;
+	int64_t start, elapsed;
+	int batch = 1;
+
+	// Warm the caches (e.g. the parsed parameter specs) first
+	b->op(b->arg);
+
+	allocs = alloc_bytes = 0;
+	counting = true;
+	start = now_ns();
+
+	do {
+		for (int i = 0; i < batch; i++)
+			b->op(b->arg);
+
+		ops += batch;
+		elapsed = now_ns() - start;
+
+		if (batch < BENCH_MAX_BATCH)
+			batch *= 2;
+	} while (elapsed < BENCH_MIN_NS);
+
+	counting = false;
+
+	printf("%-24s %12.1f %12.2f %12.1f\n", b->name,
+			(double)elapsed / ops, (double)allocs / ops,
+			(double)alloc_bytes / ops);
+}
+
+int main(int argc, char **argv)
+{
+	const char *filter = argc > 1 ? argv[1] : NULL;
+
+	setenv("BENCH_VAR", "/usr/local/share/minishell.conf", 1);
+
+	const struct bench benches[] = {
+		{ "get_word/1-part", op_get_word, make_word(1, 0, NULL) },
+		{ "get_word/64-parts", op_get_word, make_word(64, 0, NULL) },
+		{ "get_word/16-expand", op_get_word,
+			make_word(16, 1, "BENCH_VAR") },
+		{ "get_word/16-default", op_get_word,
+			make_word(16, 1, "BENCH_UNSET:-default") },
+		{ "get_word/16-strip", op_get_word,
+			make_word(16, 1, "BENCH_VAR##*/") },
+		{ "get_argv/8-args", op_get_argv, make_command(8, 1) },
+		{ "get_argv/256-args", op_get_argv, make_command(256, 8) },
+		{ "read_line/80B", op_read_line, make_input(80) },
+		{ "read_line/4KiB", op_read_line, make_input(4096) },
+		{ "read_line/64KiB", op_read_line, make_input(65536) },
+	};
+
+	printf("%-24s %12s %12s %12s\n", "benchmark", "ns/op", "allocs/op",
+			"bytes/op");
+
+	for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++)
+		if (filter == NULL || strstr(benches[i].name, filter) != NULL)
+			bench_run(&benches[i]);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,342 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "account.h"
+#include "builtins.h"
+#include "cond.h"
+#include "dirs.h"
+#include "fair.h"
+#include "input.h"
+#include "parmap.h"
+#include "replay.h"
+#include "source.h"
+#include "utils.h"
+#include "vars.h"
+
+#define DEFAULT_IFS		" \t\n"
+
+/**
+ * Remove the backslashes of a line read without -r; each one quotes the
+ * character after it.
+ */
+static void read_unescape(struct word_buf *line)
+{
+	size_t j = 0;
+
+	for (size_t i = 0; i < line->len; i++) {
+		if (line->data[i] == '\\' && i + 1 < line->len)
+			i++;
+		line->data[j++] = line->data[i];
+	}
+
+	line->len = j;
+	line->data[j] = '\0';
+}
+
+/**
+ * Split text into fields separated by IFS characters: one field per name,
+ * the last name getting the rest of the text. With no names, the whole
+ * line goes to REPLY.
+ */
+static int read_assign(char **names, int nnames, char *text)
+{
+	const char *ifs = getenv("IFS");
+
+	if (nnames == 0)
+		return setenv("REPLY", text, 1);
+
+	if (ifs == NULL)
+		ifs = DEFAULT_IFS;
+
+	char *p = text + strspn(text, ifs);
+
+	for (int i = 0; i < nnames; i++) {
+		size_t n = strcspn(p, ifs);
+		char *next = p + n;
+
+		if (i == nnames - 1) {
+			// Last field: all the rest, minus trailing separators
+			char *end = p + strlen(p);
+
+			while (end > p && strchr(ifs, end[-1]))
+				end--;
+			*end = '\0';
+		} else if (*next != '\0') {
+			*next++ = '\0';
+			next += strspn(next, ifs);
+		}
+
+		if (setenv(names[i], p, 1) < 0)
+			return -1;
+
+		p = next;
+	}
+
+	return 0;
+}
+
+/**
+ * read [-r] [-d delim] [name ...]
+ */
+static int builtin_read(int argc, char **argv)
+{
+	struct word_buf line = { NULL, 0, 0 };
+	struct word_buf more = { NULL, 0, 0 };
+	bool raw = false;
+	char delim = '\n';
+	int i, ret;
+
+	for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+		if (!strcmp(argv[i], "-r")) {
+			raw = true;
+		} else if (!strcmp(argv[i], "-d") && i + 1 < argc) {
+			delim = argv[++i][0];
+		} else {
+			fprintf(stderr, "read: invalid option '%s'\n", argv[i]);
+			return 2;
+		}
+	}
+
+	ret = input_read_line(STDIN_FILENO, delim, &line);
+
+	// Without -r, a trailing backslash continues the record
+	while (!raw && ret == 1 && line.len > 0
+			&& line.data[line.len - 1] == '\\') {
+		line.data[--line.len] = '\0';
+
+		ret = input_read_line(STDIN_FILENO, delim, &more);
+		word_buf_append(&line, more.data, more.len);
+	}
+
+	if (ret < 0) {
+		perror("read");
+		free(line.data);
+		free(more.data);
+		return 1;
+	}
+
+	if (!raw)
+		read_unescape(&line);
+
+	if (ret == 1 || line.len > 0)
+		read_assign(argv + i, argc - i, line.data);
+
+	free(line.data);
+	free(more.data);
+
+	// End of input is a failure, even after a partial record
+	return ret == 1 ? 0 : 1;
+}
+
+/**
+ * mapfile [-t] [-d delim] [array]
+ *
+ * Store every record of the standard input as an element of array
+ * (MAPFILE by default).
+ */
+static int builtin_mapfile(int argc, char **argv)
+{
+	struct word_buf all = { NULL, 0, 0 };
+	const char *name = "MAPFILE";
+	bool trim = false;
+	char delim = '\n';
+	int i;
+
+	for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+		if (!strcmp(argv[i], "-t")) {
+			trim = true;
+		} else if (!strcmp(argv[i], "-d") && i + 1 < argc) {
+			delim = argv[++i][0];
+		} else {
+			fprintf(stderr, "%s: invalid option '%s'\n", argv[0],
+					argv[i]);
+			return 2;
+		}
+	}
+
+	if (i < argc)
+		name = argv[i];
+
+	if (input_read_all(STDIN_FILENO, &all) < 0) {
+		perror(argv[0]);
+		free(all.data);
+		return 1;
+	}
+
+	char **values = NULL;
+	int n = 0, size = 0;
+	size_t pos = 0;
+
+	while (pos < all.len) {
+		char *found = memchr(all.data + pos, delim, all.len - pos);
+		size_t end = all.len, keep;
+
+		if (found != NULL)
+			end = found - all.data;
+		keep = end - pos + (found != NULL && !trim);
+
+		if (n == size) {
+			size = size ? 2 * size : 64;
+			values = realloc(values, size * sizeof(*values));
+			DIE(values == NULL, "Error allocating array.");
+		}
+
+		values[n] = malloc(keep + 1);
+		DIE(values[n] == NULL, "Error allocating array.");
+		memcpy(values[n], all.data + pos, keep);
+		values[n][keep] = '\0';
+		n++;
+
+		pos = end + 1;
+	}
+
+	free(all.data);
+	vars_array_set(name, values, n);
+
+	return 0;
+}
+
+/**
+ * : (no-op), also used for commands made only of redirections
+ */
+static int builtin_true(int argc, char **argv)
+{
+	return 0;
+}
+
+/**
+ * source FILE, . FILE
+ */
+static int builtin_source(int argc, char **argv)
+{
+	if (argc < 2) {
+		fprintf(stderr, "%s: filename argument required\n", argv[0]);
+		return 2;
+	}
+
+	return source_file(argv[1]);
+}
+
+/**
+ * pushd [DIR]
+ */
+static int builtin_pushd(int argc, char **argv)
+{
+	if (argc > 1 && replay_confine(argv[1]) < 0)
+		return 1;
+
+	if (dirs_push(argc > 1 ? argv[1] : NULL) < 0) {
+		if (errno == EINVAL)
+			fprintf(stderr, "pushd: no other directory\n");
+		else
+			fprintf(stderr, "pushd: %s: %s\n", argv[1],
+					strerror(errno));
+		return 1;
+	}
+
+	dirs_print(false);
+
+	return 0;
+}
+
+/**
+ * popd
+ */
+static int builtin_popd(int argc, char **argv)
+{
+	if (dirs_pop() < 0) {
+		if (errno == EINVAL)
+			fprintf(stderr, "popd: directory stack empty\n");
+		else
+			perror("popd");
+		return 1;
+	}
+
+	dirs_print(false);
+
+	return 0;
+}
+
+/**
+ * dirs [-c] [-l]
+ */
+static int builtin_dirs(int argc, char **argv)
+{
+	bool full_paths = false;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-c")) {
+			dirs_clear();
+			return 0;
+		} else if (!strcmp(argv[i], "-l")) {
+			full_paths = true;
+		} else {
+			fprintf(stderr, "dirs: invalid option '%s'\n", argv[i]);
+			return 2;
+		}
+	}
+
+	dirs_print(full_paths);
+
+	return 0;
+}
+
+/**
+ * pwd [-L|-P]
+ *
+ * The logical path is the one kept by the shell; only -P asks the kernel.
+ */
+static int builtin_pwd(int argc, char **argv)
+{
+	if (argc > 1 && !strcmp(argv[1], "-P")) {
+		char *real = getcwd(NULL, 0);
+
+		if (real == NULL) {
+			perror("pwd");
+			return 1;
+		}
+
+		printf("%s\n", real);
+		free(real);
+
+		return 0;
+	}
+
+	printf("%s\n", dirs_pwd());
+
+	return 0;
+}
+
+static const struct {
+	const char *name;
+	builtin_t fn;
+} builtins[] = {
+	{ ":", builtin_true },
+	{ "read", builtin_read },
+	{ "mapfile", builtin_mapfile },
+	{ "readarray", builtin_mapfile },
+	{ "[[", cond_eval },
+	{ "source", builtin_source },
+	{ ".", builtin_source },
+	{ "pushd", builtin_pushd },
+	{ "popd", builtin_popd },
+	{ "dirs", builtin_dirs },
+	{ "pwd", builtin_pwd },
+	{ "parmap", parmap_run },
+	{ "fairstat", fair_stat },
+	{ "account", account_stat },
+};
+
+builtin_t builtin_lookup(const char *name)
+{
+	for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++)
+		if (!strcmp(builtins[i].name, name))
+			return builtins[i].fn;
+
+	return NULL;
+}
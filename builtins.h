@@ -0,0 +1,17 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _BUILTINS_H
+#define _BUILTINS_H
+
+/**
+ * A builtin runs inside the shell process, with the redirections of its
+ * command already applied, and returns its exit status.
+ */
+typedef int (*builtin_t)(int argc, char **argv);
+
+/**
+ * Return the builtin called name, or NULL if there is none.
+ */
+builtin_t builtin_lookup(const char *name);
+
+#endif /* _BUILTINS_H */
@@ -0,0 +1,586 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "account.h"
+#include "case.h"
+#include "cmd.h"
+#include "expand.h"
+#include "glob.h"
+#include "plan.h"
+#include "utils.h"
+
+/**
+ * The body of an arm: its statements, one per line except for constructs
+ * spanning several lines, like in a sourced file.
+ */
+struct case_body {
+	struct plan **plans;
+	int nplans;
+};
+
+struct case_stmt {
+	word_t *subject;
+
+	// Patterns of all the arms, pattern i belonging to arm arms[i]. The
+	// text of those holding an expansion is kept in dynamic[i], as they
+	// are only compiled when the statement runs
+	struct glob **globs;
+	int *arms;
+	char **dynamic;
+	int nglobs;
+	int ndynamic;
+
+	struct case_body *bodies;
+	int narms;
+
+	struct glob_set *set;	/* if no pattern is dynamic */
+
+	// Commands following 'esac;' on the same line
+	struct plan *next;
+};
+
+static inline bool is_blank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static inline bool is_delim(char c)
+{
+	return c == '\0' || is_blank(c) || c == ';' || c == '|' || c == '&'
+		|| c == '(' || c == ')';
+}
+
+static const char *skip_blank(const char *p)
+{
+	while (is_blank(*p))
+		p++;
+
+	return p;
+}
+
+/**
+ * Skip a quoted string or an escaped character starting at p.
+ */
+static const char *skip_quoted(const char *p)
+{
+	char quote = *p++;
+
+	if (quote == '\\')
+		return *p != '\0' ? p + 1 : p;
+
+	while (*p != '\0' && *p != quote)
+		p++;
+
+	return *p != '\0' ? p + 1 : p;
+}
+
+static bool at_keyword(const char *p, const char *kw)
+{
+	size_t n = strlen(kw);
+
+	return !strncmp(p, kw, n) && is_delim(p[n]);
+}
+
+/**
+ * Skip the '${...}' expression starting at p.
+ */
+static const char *skip_braces(const char *p)
+{
+	int depth = 0;
+
+	for (p += 2; *p != '\0'; p++) {
+		if (*p == '{')
+			depth++;
+		else if (*p == '}' && depth-- == 0)
+			return p + 1;
+	}
+
+	return p;
+}
+
+/**
+ * Scan from p, which must be in command position, keeping track of nested
+ * case ... esac pairs. 'case' and 'esac' are keywords only where a command
+ * may start (or, for 'esac', where a pattern may), so that 'echo esac' is
+ * just a command.
+ *
+ * @param stop_on_arm also stop on a ';;' that is not nested
+ *
+ * @return where the scan stopped: right after the 'esac' closing the
+ * statement open before p (or the ';;'), or NULL if the text ends first
+ */
+static const char *scan(const char *p, int depth, bool stop_on_arm)
+{
+	bool word_start = true, command = true, want_in = false;
+
+	while (*p != '\0') {
+		if (*p == '\'' || *p == '"' || *p == '\\') {
+			p = skip_quoted(p);
+			word_start = command = false;
+			continue;
+		}
+
+		if (stop_on_arm && depth == 1 && p[0] == ';' && p[1] == ';')
+			return p;
+
+		if (command && at_keyword(p, "case")) {
+			depth++;
+			p += 4;
+			word_start = command = false;
+			want_in = true;
+			continue;
+		}
+
+		// Patterns follow the 'in' of a 'case'
+		if (word_start && want_in && at_keyword(p, "in")) {
+			p += 2;
+			word_start = want_in = false;
+			command = true;
+			continue;
+		}
+
+		if (command && at_keyword(p, "esac")) {
+			p += 4;
+			if (--depth == 0)
+				return p;
+			word_start = command = false;
+			continue;
+		}
+
+		if (strchr(";|&()\n", *p) != NULL)
+			command = true;
+		else if (!is_blank(*p))
+			command = false;
+
+		word_start = is_delim(*p);
+		p++;
+	}
+
+	return NULL;
+}
+
+bool case_is_case(const char *text)
+{
+	return at_keyword(skip_blank(text), "case");
+}
+
+bool case_incomplete(const char *text)
+{
+	return scan(skip_blank(text), 0, false) == NULL;
+}
+
+/**
+ * Lower the subject word through the parser, so that it is expanded
+ * exactly like a command word when the statement runs.
+ */
+static word_t *case_subject(const char *start, const char *end)
+{
+	char *text = strndup(start, end - start);
+	command_t *root = NULL;
+	word_t *subject = NULL;
+
+	DIE(text == NULL, "Error allocating case subject.");
+
+	enum account_site prev = account_enter(ACCOUNT_PARSER);
+
+	parse_line(text, &root);
+	account_leave(prev);
+
+	if (root != NULL && root->op == OP_NONE && root->scmd->params == NULL)
+		subject = plan_clone_word(root->scmd->verb);
+
+	free_parse_memory();
+	free(text);
+
+	return subject;
+}
+
+/**
+ * Append n characters of s to pat, escaped so they only match themselves.
+ */
+static void case_escape(struct word_buf *pat, const char *s, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		if (strchr("*?[]\\", s[i]) != NULL)
+			word_buf_append(pat, "\\", 1);
+		word_buf_append(pat, s + i, 1);
+	}
+}
+
+/**
+ * Turn the text of a pattern, from p to end, into a glob pattern appended
+ * to pat. Quoted characters are escaped so they only match themselves.
+ * '$name' and '${...}' are expanded, like in bash: the value of one in
+ * double quotes is escaped too, that of an unquoted one is a pattern.
+ *
+ * @return true if the pattern holds an expansion
+ */
+static bool case_glob_text(const char *p, const char *end,
+		struct word_buf *pat)
+{
+	struct word_buf value = { NULL, 0, 0 };
+	bool expands = false;
+	char quote = '\0';
+
+	while (p < end) {
+		char c = *p;
+
+		if (c == '$' && quote != '\'') {
+			value.len = 0;
+			word_buf_append(&value, "", 0);
+			p = expand_dollar(p, &value);
+
+			if (quote == '"')
+				case_escape(pat, value.data, value.len);
+			else
+				word_buf_append(pat, value.data, value.len);
+			expands = true;
+			continue;
+		}
+
+		if ((c == '\'' || c == '"') && (quote == '\0' || quote == c)) {
+			quote = quote == '\0' ? c : '\0';
+			p++;
+			continue;
+		}
+
+		if (quote != '\0') {
+			case_escape(pat, p, 1);
+			p++;
+			continue;
+		}
+
+		if (c == '\\' && p + 1 < end) {
+			word_buf_append(pat, p, 2);
+			p += 2;
+			continue;
+		}
+
+		if (!is_blank(c))
+			word_buf_append(pat, p, 1);
+		p++;
+	}
+
+	free(value.data);
+
+	return expands;
+}
+
+static void case_add_pattern(struct case_stmt *stmt, const char *start,
+		const char *end)
+{
+	struct word_buf pat = { NULL, 0, 0 };
+	int n = stmt->nglobs;
+
+	stmt->globs = realloc(stmt->globs, (n + 1) * sizeof(*stmt->globs));
+	stmt->arms = realloc(stmt->arms, (n + 1) * sizeof(*stmt->arms));
+	stmt->dynamic = realloc(stmt->dynamic,
+			(n + 1) * sizeof(*stmt->dynamic));
+	DIE(stmt->globs == NULL || stmt->arms == NULL || stmt->dynamic == NULL,
+			"Error allocating case pattern.");
+
+	word_buf_append(&pat, "", 0);
+
+	stmt->globs[n] = NULL;
+	stmt->dynamic[n] = NULL;
+	stmt->arms[n] = stmt->narms;
+	stmt->nglobs++;
+
+	if (case_glob_text(start, end, &pat)) {
+		stmt->dynamic[n] = strndup(start, end - start);
+		DIE(stmt->dynamic[n] == NULL, "Error allocating case pattern.");
+		stmt->ndynamic++;
+	} else {
+		stmt->globs[n] = glob_compile(pat.data);
+	}
+
+	free(pat.data);
+}
+
+/**
+ * Parse 'PAT[|PAT]...)' into glob patterns.
+ *
+ * @return the position after ')', or NULL on a syntax error
+ */
+static const char *case_patterns(struct case_stmt *stmt, const char *p)
+{
+	if (*p == '(')
+		p++;
+
+	for (;;) {
+		const char *start = p;
+
+		// Up to the '|' or ')' that is not quoted nor in a '${...}'
+		while (*p != '\0' && *p != ';' && *p != '|' && *p != ')') {
+			if (*p == '\'' || *p == '"' || *p == '\\')
+				p = skip_quoted(p);
+			else if (p[0] == '$' && p[1] == '{')
+				p = skip_braces(p);
+			else
+				p++;
+		}
+
+		if (*p == '\0' || *p == ';')
+			return NULL;
+
+		case_add_pattern(stmt, start, p);
+
+		if (*p++ == ')')
+			break;
+	}
+
+	return p;
+}
+
+/**
+ * Compile a complete statement of an arm body and reset text.
+ *
+ * @return false on a syntax error
+ */
+static bool case_body_add(struct case_body *body, struct word_buf *text)
+{
+	// A command may end with the ';' of a ';;' split over two lines
+	while (text->len > 0 && (is_blank(text->data[text->len - 1])
+				|| text->data[text->len - 1] == ';'))
+		text->data[--text->len] = '\0';
+
+	if (text->len == 0)
+		return true;
+
+	struct plan *plan = plan_compile(text->data);
+
+	text->len = 0;
+	if (plan == NULL)
+		return false;
+
+	body->plans = realloc(body->plans,
+			(body->nplans + 1) * sizeof(*body->plans));
+	DIE(body->plans == NULL, "Error allocating case arm.");
+
+	body->plans[body->nplans++] = plan;
+
+	return true;
+}
+
+/**
+ * Compile the body of an arm into its statements: one per non-empty line,
+ * except for nested constructs, which keep their lines.
+ */
+static bool case_add_arm(struct case_stmt *stmt, const char *start,
+		const char *end)
+{
+	struct word_buf text = { NULL, 0, 0 };
+	bool ok = true;
+
+	stmt->bodies = realloc(stmt->bodies,
+			(stmt->narms + 1) * sizeof(*stmt->bodies));
+	DIE(stmt->bodies == NULL, "Error allocating case arm.");
+
+	struct case_body *body = &stmt->bodies[stmt->narms++];
+
+	body->plans = NULL;
+	body->nplans = 0;
+
+	while (ok && start < end) {
+		const char *nl = memchr(start, '\n', end - start);
+		const char *s = start, *e = nl != NULL ? nl : end;
+
+		start = e + (nl != NULL);
+
+		while (s < e && is_blank(*s))
+			s++;
+		while (e > s && is_blank(e[-1]))
+			e--;
+
+		if (e == s && text.len == 0)
+			continue;
+
+		if (text.len > 0)
+			word_buf_append(&text, "\n", 1);
+		word_buf_append(&text, s, e - s);
+
+		if (!plan_incomplete(text.data))
+			ok = case_body_add(body, &text);
+	}
+
+	// A nested construct left open fails to compile
+	if (ok && text.len > 0)
+		ok = case_body_add(body, &text);
+
+	free(text.data);
+
+	return ok;
+}
+
+struct case_stmt *case_compile(const char *text)
+{
+	const char *p = skip_blank(text) + strlen("case");
+	const char *end = scan(skip_blank(text), 0, false);
+	struct case_stmt *stmt = calloc(1, sizeof(*stmt));
+
+	DIE(stmt == NULL, "Error allocating case statement.");
+
+	if (end == NULL)
+		goto syntax_error;
+
+	// Subject word
+	p = skip_blank(p);
+
+	const char *subject = p;
+
+	while (*p != '\0' && !is_blank(*p)) {
+		if (*p == '\'' || *p == '"' || *p == '\\')
+			p = skip_quoted(p);
+		else
+			p++;
+	}
+
+	stmt->subject = case_subject(subject, p);
+	if (stmt->subject == NULL)
+		goto syntax_error;
+
+	p = skip_blank(p);
+	if (!at_keyword(p, "in"))
+		goto syntax_error;
+	p = skip_blank(p + 2);
+
+	// Arms, up to the closing 'esac'
+	const char *esac = end - strlen("esac");
+
+	while (p < esac) {
+		p = case_patterns(stmt, p);
+		if (p == NULL)
+			goto syntax_error;
+
+		const char *body = p;
+
+		p = scan(body, 1, true);
+		if (p == NULL || p > end)
+			goto syntax_error;
+
+		if (p == end)
+			p = esac;
+
+		if (!case_add_arm(stmt, body, p))
+			goto syntax_error;
+
+		if (p[0] == ';' && p[1] == ';')
+			p += 2;
+		p = skip_blank(p);
+	}
+
+	// Only a ';' separated command list may follow 'esac'
+	p = skip_blank(end);
+	if (*p == ';')
+		p = skip_blank(p + 1);
+	else if (*p != '\0')
+		goto syntax_error;
+
+	if (*p != '\0') {
+		stmt->next = plan_compile(p);
+		if (stmt->next == NULL)
+			goto syntax_error;
+	}
+
+	if (stmt->ndynamic == 0)
+		stmt->set = glob_set_compile(stmt->globs, stmt->arms,
+				stmt->nglobs);
+
+	return stmt;
+
+syntax_error:
+	parse_error("invalid case statement",
+			(int)((p != NULL ? p : text) - text));
+	case_free(stmt);
+
+	return NULL;
+}
+
+/**
+ * Find the arm of the first pattern matching value, expanding and
+ * compiling the dynamic patterns on the way.
+ */
+static int case_match_dynamic(struct case_stmt *stmt, const char *value)
+{
+	struct word_buf pat = { NULL, 0, 0 };
+	size_t len = strlen(value);
+	int arm = -1;
+
+	for (int i = 0; i < stmt->nglobs && arm < 0; i++) {
+		if (stmt->dynamic[i] == NULL) {
+			if (glob_match(stmt->globs[i], value, len))
+				arm = stmt->arms[i];
+			continue;
+		}
+
+		pat.len = 0;
+		word_buf_append(&pat, "", 0);
+		const char *text = stmt->dynamic[i];
+
+		case_glob_text(text, text + strlen(text), &pat);
+
+		struct glob *g = glob_compile(pat.data);
+
+		if (glob_match(g, value, len))
+			arm = stmt->arms[i];
+		glob_free(g);
+	}
+
+	free(pat.data);
+
+	return arm;
+}
+
+int case_run(struct case_stmt *stmt)
+{
+	char *value = get_word(stmt->subject);
+	int arm = stmt->set != NULL
+		? glob_set_match(stmt->set, value, strlen(value))
+		: case_match_dynamic(stmt, value);
+
+	int ret = 0;
+
+	free(value);
+
+	if (arm >= 0) {
+		const struct case_body *body = &stmt->bodies[arm];
+
+		for (int i = 0; i < body->nplans && ret != SHELL_EXIT; i++)
+			ret = plan_run(body->plans[i]);
+	}
+
+	if (stmt->next != NULL && ret != SHELL_EXIT)
+		ret = plan_run(stmt->next);
+
+	return ret;
+}
+
+void case_free(struct case_stmt *stmt)
+{
+	if (stmt == NULL)
+		return;
+
+	plan_free_word(stmt->subject);
+	plan_free(stmt->next);
+	glob_set_free(stmt->set);
+
+	for (int i = 0; i < stmt->nglobs; i++) {
+		glob_free(stmt->globs[i]);
+		free(stmt->dynamic[i]);
+	}
+
+	for (int i = 0; i < stmt->narms; i++) {
+		for (int j = 0; j < stmt->bodies[i].nplans; j++)
+			plan_free(stmt->bodies[i].plans[j]);
+		free(stmt->bodies[i].plans);
+	}
+
+	free(stmt->globs);
+	free(stmt->arms);
+	free(stmt->dynamic);
+	free(stmt->bodies);
+	free(stmt);
+}
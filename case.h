@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _CASE_H
+#define _CASE_H
+
+#include <stdbool.h>
+
+/**
+ * A compiled 'case WORD in PAT[|PAT]...) BODY ;; ... esac' statement. All
+ * the patterns of all the arms are compiled into one glob_set, so picking
+ * the arm costs a single pass over the value.
+ *
+ * Patterns may hold '$name' and '${...}', expanded each time the statement
+ * runs: an unquoted value is a pattern, a quoted one only matches itself.
+ * A statement with such patterns matches them one at a time instead.
+ *
+ * 'case' and 'esac' are keywords only in command position ('esac' also
+ * where a pattern may start), so 'echo esac' in a body is a command.
+ */
+struct case_stmt;
+
+/**
+ * Check if the line starts with the 'case' keyword.
+ */
+bool case_is_case(const char *text);
+
+/**
+ * Check if the statement still misses its closing 'esac'.
+ */
+bool case_incomplete(const char *text);
+
+/**
+ * Compile a case statement; text may span several lines.
+ *
+ * @return the statement, or NULL on a syntax error
+ */
+struct case_stmt *case_compile(const char *text);
+
+/**
+ * Run the body of the first arm matching the subject.
+ *
+ * @return the exit status of the body, 0 if no arm matched
+ */
+int case_run(struct case_stmt *stmt);
+
+void case_free(struct case_stmt *stmt);
+
+#endif /* _CASE_H */
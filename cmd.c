@@ -11,18 +11,49 @@
 #include <sys/stat.h>
 #include <sys/wait.h>
 
+#include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
+#include "autopar.h"
+#include "builtins.h"
 #include "cmd.h"
+#include "dirs.h"
+#include "fair.h"
+#include "make.h"
+#include "memo.h"
+#include "plan.h"
+#include "proc.h"
+#include "rate.h"
+#include "record.h"
+#include "redir.h"
+#include "replay.h"
+#include "retry.h"
+#include "prefix.h"
 #include "utils.h"
 
 #define READ		0
 #define WRITE		1
 
+/**
+ * Open the target of a redirection, unless a replay keeps it out of reach.
+ */
+static int open_target(const char *path, int flags)
+{
+	if (replay_confine(path) < 0)
+		return -1;
+
+	int fd = open(path, flags, 0644);
+
+	if (fd < 0)
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+
+	return fd;
+}
+
 /**
  * Redirects standard input, output and/or error to specified file(s).
  * For 'cd' command, redirects both standard output and standard error.
@@ -51,7 +82,7 @@ int redirect_to_file(simple_command_t *s, int redirection_flags,
 		std_file_name = get_word(s->in);
 
 		if (std_file_name)
-			fd = open(std_file_name, O_RDONLY);
+			fd = open_target(std_file_name, O_RDONLY);
 	} else if (!strcmp(redirection_type, "out")) {
 		if (cd_cmd)
 			redirection_flags = O_WRONLY | O_CREAT | O_TRUNC;
@@ -59,12 +90,12 @@ int redirect_to_file(simple_command_t *s, int redirection_flags,
 		std_file_name = get_word(s->out);
 
 		if (std_file_name)
-			fd = open(std_file_name, redirection_flags, 0644);
+			fd = open_target(std_file_name, redirection_flags);
 	} else if (!strcmp(redirection_type, "err")) {
 		std_file_name = get_word(s->err);
 
 		if (std_file_name)
-			fd = open(std_file_name, redirection_flags, 0644);
+			fd = open_target(std_file_name, redirection_flags);
 	} else {
 		fprintf(stderr, "Invalid redirection type\n");
 		return -1;
@@ -92,7 +123,7 @@ int redirect_to_file(simple_command_t *s, int redirection_flags,
 		fd = 0;
 
 		if (std_file_name)
-			fd = open(std_file_name, redirection_flags, 0644);
+			fd = open_target(std_file_name, redirection_flags);
 
 		// Continue only if the operation on file descriptor was successful
 		if (fd <= 0)
@@ -107,6 +138,44 @@ int redirect_to_file(simple_command_t *s, int redirection_flags,
 	return EXIT_SUCCESS;
 }
 
+/**
+ * Apply the parser's redirection of fd (-1 for &>) to the calling process.
+ *
+ * @param same whether output and error go to the same file, which is
+ * opened once for both
+ *
+ * @return 0 if the redirection was successful, a negative value otherwise
+ */
+static int cmd_redirect_std(simple_command_t *s, int fd, int flags,
+		bool same)
+{
+	if (fd == STDIN_FILENO)
+		return s->in == NULL ? 0 : redirect_to_file(s, O_RDONLY, "in",
+				false);
+
+	if (!same && fd == STDOUT_FILENO)
+		return s->out == NULL ? 0 : redirect_to_file(s, flags, "out",
+				false);
+
+	if (!same)
+		return s->err == NULL ? 0 : redirect_to_file(s, flags, "err",
+				false);
+
+	// Both output and error will be redirected to same file
+	char *name = get_word(s->out);
+	int file = open_target(name, flags);
+
+	free(name);
+	if (file < 0)
+		return -1;
+
+	dup2(file, STDOUT_FILENO);
+	dup2(file, STDERR_FILENO);
+	close(file);
+
+	return 0;
+}
+
 /**
  * Main function for redirection for a command.
  *
@@ -120,6 +189,11 @@ int cmd_redirection(simple_command_t *s)
 	char *output_file_name = get_word(s->out);
 	char *error_file_name = get_word(s->err);
 	int io_flags = s->io_flags;
+	bool same = output_file_name && error_file_name
+		&& !strcmp(output_file_name, error_file_name);
+
+	free(output_file_name);
+	free(error_file_name);
 
 	// Determine redirection flags based on APPEND or TRUNC mode
 	int redirection_flags = 0;
@@ -135,37 +209,37 @@ int cmd_redirection(simple_command_t *s)
 		return -1;
 	}
 
-	// Perform input redirection
-	redirect_to_file(s, O_RDONLY, "in", false);
+	const struct fd_redir *list = plan_redirections(s), *r;
+	bool marked = false, same_done = false;
 
-	// Perform output and error redirection
-	if (output_file_name && error_file_name
-						 && !strcmp(output_file_name, error_file_name)) {
-		// Both output and error will be redirected to same file
-		int fd = open(output_file_name, redirection_flags, 0644);
+	for (r = list; r != NULL; r = r->next)
+		marked |= r->kind == REDIR_STD;
 
-		if (fd < 0) {
-			free(output_file_name);
-			free(error_file_name);
+	// A command not read from a command line has no markers telling
+	// where the parser's redirections are; they come first
+	for (int fd = 0; !marked && fd < 3; fd++)
+		if ((!same || fd < 2)
+				&& cmd_redirect_std(s, fd, redirection_flags,
+					same && fd > 0) < 0)
 			return -1;
-		}
 
-		// Redirect both standard output and standard error
-		dup2(fd, STDOUT_FILENO);
-		dup2(fd, STDERR_FILENO);
+	// Perform all of them in command line order
+	for (r = list; r != NULL; r = r->next) {
+		bool both = same && r->fd != STDIN_FILENO;
 
-		close(fd);
-	} else {
-		// Perform redirection for output or error only
-		if (output_file_name)
-			redirect_to_file(s, redirection_flags, "out", false);
+		if (r->kind != REDIR_STD) {
+			if (redir_apply(r) < 0)
+				return -1;
+			continue;
+		}
 
-		if (error_file_name)
-			redirect_to_file(s, redirection_flags, "err", false);
-	}
+		if (both && same_done)
+			continue;
+		same_done |= both;
 
-	free(output_file_name);
-	free(error_file_name);
+		if (cmd_redirect_std(s, r->fd, redirection_flags, both) < 0)
+			return -1;
+	}
 
 	return EXIT_SUCCESS;
 }
@@ -182,7 +256,8 @@ static bool shell_cd(word_t *dir)
 	// Try to change the current directory, if possible
 	char *target_dir = get_word(dir);
 
-	if (chdir(target_dir) < 0) {
+	// Directories visited before are entered through their cached fd
+	if (replay_confine(target_dir) < 0 || dirs_cd(target_dir) < 0) {
 		free(target_dir);
 		return false;
 	}
@@ -202,6 +277,150 @@ static int shell_exit(void)
 	return SHELL_EXIT;
 }
 
+/**
+ * Run a builtin in the shell process. Its redirections only last for the
+ * duration of the call.
+ *
+ * @param s the command to be executed
+ * @param builtin the builtin implementing the command
+ *
+ * @return the exit status of the builtin
+ */
+static int run_builtin(simple_command_t *s, builtin_t builtin)
+{
+	// Standard input, output, error and any fd the command redirects
+	int nfds = 3;
+	const struct fd_redir *r;
+
+	for (r = plan_redirections(s); r != NULL; r = r->next)
+		nfds += r->kind != REDIR_STD;
+
+	int fds[nfds], saved_fds[nfds];
+
+	nfds = 0;
+	for (int i = 0; i < 3; i++)
+		fds[nfds++] = i;
+	for (r = plan_redirections(s); r != NULL; r = r->next)
+		if (r->kind != REDIR_STD)
+			fds[nfds++] = r->fd;
+
+	// Save them (any of them may be closed)
+	for (int i = 0; i < nfds; i++)
+		saved_fds[i] = fcntl(fds[i], F_DUPFD_CLOEXEC,
+				SHELL_FD_MIN);
+
+	int argc = 0;
+	char **argv = get_argv(s, &argc);
+	int ret = cmd_redirection(s) < 0 ? EXIT_FAILURE : builtin(argc, argv);
+
+	fflush(stdout);
+	fflush(stderr);
+
+	// Restore the shell's own fds, last saved first
+	for (int i = nfds - 1; i >= 0; i--) {
+		if (saved_fds[i] < 0) {
+			close(fds[i]);
+			continue;
+		}
+
+		dup2(saved_fds[i], fds[i]);
+		close(saved_fds[i]);
+	}
+
+	free_argv(argv, argc);
+
+	return ret;
+}
+
+/**
+ * Internal exec command. With only redirections, they are applied to the
+ * shell itself and stay in effect for the following commands. Otherwise
+ * the shell process is replaced by the command.
+ */
+static int shell_exec(simple_command_t *s)
+{
+	int argc = 0;
+	char **argv = get_argv(s, &argc);
+
+	// Pending output must reach the old stdout/stderr
+	fflush(stdout);
+	fflush(stderr);
+
+	if (cmd_redirection(s) < 0) {
+		free_argv(argv, argc);
+		return EXIT_FAILURE;
+	}
+
+	if (argc == 1) {
+		free_argv(argv, argc);
+		return EXIT_SUCCESS;
+	}
+
+	struct prefix_attrs attrs;
+	int first = prefix_parse(argv + 1, argc - 1, &attrs) + 1;
+
+	// It would end the replay, with whatever it is run as
+	if (first > 0 && first < argc && replay_running()) {
+		fprintf(stderr, "exec: not run in a replay\n");
+		free_argv(argv, argc);
+		return EXIT_FAILURE;
+	}
+
+	if (first > 0 && first < argc && prefix_apply(&attrs) == 0) {
+		execvp(argv[first], argv + first);
+		fprintf(stderr, "Execution failed for '%s'\n", argv[first]);
+	}
+
+	free_argv(argv, argc);
+
+	return 127;
+}
+
+/**
+ * Check if a command runs as part of a pipeline, whose commands must all
+ * run at the same time.
+ */
+static bool in_pipeline(command_t *father)
+{
+	for (command_t *c = father; c != NULL; c = c->up)
+		if (c->op == OP_PIPE)
+			return true;
+
+	return false;
+}
+
+/**
+ * What the child of an external command needs before it execs.
+ */
+struct simple_child {
+	simple_command_t *s;
+	struct prefix_attrs *attrs;
+	struct memo_job *memo;
+	char **argv;
+};
+
+static int simple_setup(void *arg)
+{
+	struct simple_child *c = arg;
+
+	// A timeout kills the whole group of the run (see retry.h)
+	if (c->attrs->timeout_ms > 0)
+		setpgid(0, 0);
+
+	// Perform redirections in child
+	if (cmd_redirection(c->s) < 0)
+		return -1;
+
+	// Apply the resource prefixes, if any
+	if (prefix_apply(c->attrs) < 0)
+		return -1;
+
+	if (c->memo->active)
+		memo_exec(c->memo, c->argv);
+
+	return 0;
+}
+
 /**
  * Parse a simple command (internal, environment variable assignment,
  * external command).
@@ -229,6 +448,20 @@ static int parse_simple(simple_command_t *s, int level, command_t *father)
 
 		// Execute the 'exit' or 'quit' command; return the exit status
 		return shell_exit();
+	} else if (!strcmp(curr_cmd, "exec")) {
+		free(curr_cmd);
+
+		// Replace the shell, or redirect its own fds for good
+		return shell_exec(s);
+	}
+
+	builtin_t builtin = builtin_lookup(curr_cmd);
+
+	if (builtin != NULL) {
+		free(curr_cmd);
+
+		// Execute the builtin in the shell process
+		return run_builtin(s, builtin);
 	}
 
 	// If variable assignment, execute the assignment and
@@ -251,6 +484,10 @@ static int parse_simple(simple_command_t *s, int level, command_t *father)
 			// If there is, assign it, if possible
 			int ret_assign = setenv(src, dst, 1);
 
+			// Memoized CDPATH lookups belong to the old value
+			if (!strcmp(src, "CDPATH"))
+				dirs_cdpath_changed();
+
 			// Free resources
 			free(dst);
 			free(var_assign);
@@ -265,47 +502,108 @@ static int parse_simple(simple_command_t *s, int level, command_t *father)
 
 	// External command case
 
-	// Fork new process
-	pid_t curr_pid = fork();
+	// Resource prefixes (nice, ionice, taskset, ulimit) are parsed here
+	// and applied in the child, right before exec
+	struct prefix_attrs attrs;
+	int argc = 0;
+	char **argv = get_argv(s, &argc);
+	int first = prefix_parse(argv, argc, &attrs);
 
-	switch (curr_pid) {
-	case -1: {
-		return -1;
+	if (first < 0 || first == argc) {
+		// Of the prefixes, only a bare 'ulimit' changes the shell itself
+		int ret = first < 0 ? EXIT_FAILURE : prefix_apply_shell(&attrs);
+
+		free_argv(argv, argc);
+		free(curr_cmd);
+		return ret;
 	}
 
-	case 0: {
-		// Perform redirections in child
-		int ret_redir = cmd_redirection(s);
+	// A replay runs the stub of a command given by its path
+	replay_command_name(argv[first]);
 
-		if (ret_redir < 0) {
-			free(curr_cmd);
-			return -1;
-		}
+	// Commands annotated with @in/@out are skipped when up to date; a
+	// simulation has no files to check
+	struct make_job make = { 0 };
 
-		// Load executable in child
-		int argc = 0;
-		int exec_ret = execvp(curr_cmd, get_argv(s, &argc));
+	if (attrs.make && !proc->simulated
+			&& make_check(&make, s, argv, argc, &attrs)) {
+		free_argv(argv, argc);
+		free(curr_cmd);
+		return EXIT_SUCCESS;
+	}
 
-		if (exec_ret < 0) {
-			fprintf(stderr, "Execution failed for '%s'\n", curr_cmd);
-			free(curr_cmd);
-		}
+	// memo commands may be replayed from the store
+	struct memo_job memo = { 0 };
+
+	if (attrs.memo && !proc->simulated)
+		memo_lookup(&memo, s, argv, argc, &attrs);
+
+	struct simple_child setup = {
+		.s = s, .attrs = &attrs, .memo = &memo, .argv = argv + first
+	};
+	struct proc_child child = {
+		.setup = simple_setup, .arg = &setup,
+		.argv = argv + first, .stdin_fd = -1, .stdout_fd = -1
+	};
 
-		// Finish child process
-		exit(exec_ret);
+	// Attempts made so far, for retry
+	int attempt = 0;
+
+spawn:
+	attempt++;
+
+	// Take a slot of MINISHELL_SLOTS, unless waiting could deadlock
+	int slot = in_pipeline(father) ? -1 : fair_acquire(-1);
+	int64_t started = record_clock();
+
+	// Start the child; it sets itself up, then execs
+	pid_t curr_pid = proc->start(&child);
+
+	switch (curr_pid) {
+	case -1: {
+		fair_release(slot);
+		memo_finish(&memo);
+		make_record(&make, EXIT_FAILURE);
+		free_argv(argv, argc);
+		free(curr_cmd);
+		return -1;
 	}
 
 	default: {
 		int status = 0;
+		bool timed_out;
+
+		// Wait for child, killing it if it runs over the retry timeout
+		int ret_pid = proc->wait_timeout(curr_pid, attrs.timeout_ms,
+				&status, &timed_out);
+
+		// Not held while backing off
+		fair_release(slot);
+
+		record_command(argv[first], started, ret_pid < 0 ? -1
+				: WIFEXITED(status) ? WEXITSTATUS(status)
+				: 128 + WTERMSIG(status));
+
+		// A replayed memo entry would just fail the same way again
+		if (ret_pid >= 0 && attempt < attrs.attempts && !memo.hit
+				&& retry_retryable(&attrs, status, timed_out)) {
+			retry_sleep(&attrs, argv[first], status, attempt);
+			goto spawn;
+		}
+
+		free_argv(argv, argc);
 
-		// Wait for child
-		int ret_pid = waitpid(curr_pid, &status, 0);
+		memo_finish(&memo);
 
 		if (ret_pid < 0) {
+			make_record(&make, EXIT_FAILURE);
 			free(curr_cmd);
 			return -1;
 		}
 
+		make_record(&make, WIFEXITED(status) ? WEXITSTATUS(status)
+				: EXIT_FAILURE);
+
 		if (WIFEXITED(status)) {
 			// Return exit status
 			free(curr_cmd);
@@ -320,6 +618,34 @@ static int parse_simple(simple_command_t *s, int level, command_t *father)
 	return EXIT_SUCCESS;
 }
 
+/**
+ * One side of '&' or '|', run in a child.
+ */
+struct branch {
+	command_t *cmd;
+	int level;
+	command_t *father;
+	int close_fd;		/* the other end of its pipe, if not -1 */
+};
+
+static int branch_setup(void *arg)
+{
+	struct branch *b = arg;
+
+	// Readers only see the end of the pipe once every writer is gone
+	if (b->close_fd >= 0)
+		close(b->close_fd);
+
+	return 0;
+}
+
+static int run_branch(void *arg)
+{
+	struct branch *b = arg;
+
+	return parse_command(b->cmd, b->level + 1, b->father);
+}
+
 /**
  * Process two commands in parallel, by creating two children.
  */
@@ -327,65 +653,46 @@ static bool run_in_parallel(command_t *cmd1, command_t *cmd2, int level,
 		command_t *father)
 {
 	// Execute cmd1 and cmd2 simultaneously.
+	struct branch b1 = { cmd1, level, father, -1 };
+	struct branch b2 = { cmd2, level, father, -1 };
+	struct proc_child child1 = { .body = run_branch, .arg = &b1,
+		.stdin_fd = -1, .stdout_fd = -1 };
+	struct proc_child child2 = { .body = run_branch, .arg = &b2,
+		.stdin_fd = -1, .stdout_fd = -1 };
+
+	// Nested '&' only fork again; what they run is what is launched
+	if (cmd1->op != OP_PARALLEL)
+		rate_wait();
 
 	// Create child process for cmd1
-	pid_t curr_pid1 = fork();
+	pid_t curr_pid1 = proc->start(&child1);
 
-	switch (curr_pid1) {
-	case -1: {
+	if (curr_pid1 < 0)
 		return false;
-	}
-
-	case 0: {
-		// First child
-		int ret_exec = parse_command(cmd1, level + 1, father);
 
-		if (ret_exec < 0)
-			return false;
-
-		exit(ret_exec);
-	}
-
-	default: {
-		break;
-	}
-	}
+	if (cmd2->op != OP_PARALLEL)
+		rate_wait();
 
 	// Create child process for cmd2
-	pid_t curr_pid2 = fork();
+	pid_t curr_pid2 = proc->start(&child2);
 
-	switch (curr_pid2) {
-	case -1: {
+	if (curr_pid2 < 0)
 		return false;
-	}
 
-	case 0: {
-		// Second child
-		int ret_exec = parse_command(cmd2, level + 1, father);
-
-		if (ret_exec < 0)
-			return false;
-
-		exit(ret_exec);
-	}
+	// Wait for both children
+	int status_pid1 = 0, status_pid2 = 0;
+	int ret_pid1 = proc->wait(curr_pid1, &status_pid1, 0);
 
-	default: {
-		// Wait for both children
-		int status_pid1 = 0, status_pid2 = 0;
-		int ret_pid1 = waitpid(curr_pid1, &status_pid1, 0);
+	if (ret_pid1 < 0)
+		return -1;
 
-		if (ret_pid1 < 0)
-			return -1;
+	int ret_pid2 = proc->wait(curr_pid2, &status_pid2, 0);
 
-		int ret_pid2 = waitpid(curr_pid2, &status_pid2, 0);
+	if (ret_pid2 < 0)
+		return -1;
 
-		if (ret_pid2 < 0)
-			return -1;
-
-		if (WIFEXITED(status_pid2))
-			return WEXITSTATUS(status_pid2);
-	}
-	}
+	if (WIFEXITED(status_pid2))
+		return WEXITSTATUS(status_pid2);
 
 	// Return exit status (0 for success)
 	return EXIT_SUCCESS;
@@ -401,95 +708,58 @@ static bool run_on_pipe(command_t *cmd1, command_t *cmd2, int level,
 	int pipefd[2] = {0};
 
 	// Create anonymous pipe
-	if (pipe(pipefd) < 0)
+	if (proc->pipe(pipefd) < 0)
 		return false;
 
+	// Standard output of cmd1 goes to the pipe write end, standard
+	// input of cmd2 comes from its read end
+	struct branch b1 = { cmd1, level, father, pipefd[READ] };
+	struct branch b2 = { cmd2, level, father, pipefd[WRITE] };
+	struct proc_child child1 = {
+		.body = run_branch, .setup = branch_setup, .arg = &b1,
+		.stdin_fd = -1, .stdout_fd = pipefd[WRITE]
+	};
+	struct proc_child child2 = {
+		.body = run_branch, .setup = branch_setup, .arg = &b2,
+		.stdin_fd = pipefd[READ], .stdout_fd = -1
+	};
+
+	// Nested '&' only fork again; what they run is what is launched
+	if (cmd1->op != OP_PARALLEL)
+		rate_wait();
+
 	// Create child process for cmd1
-	pid_t curr_pid1 = fork();
+	pid_t curr_pid1 = proc->start(&child1);
 
-	switch (curr_pid1) {
-	case -1: {
+	if (curr_pid1 < 0)
 		return false;
-	}
-
-	case 0: {
-		// First child
-		close(pipefd[READ]);
-
-		// Redirect standard output of cmd1 to pipe write end
-		int ret_dup2 = dup2(pipefd[WRITE], STDOUT_FILENO);
 
-		if (ret_dup2 < 0)
-			return false;
-
-		close(pipefd[WRITE]);
-
-		// Execute cmd1
-		int ret_exec = parse_command(cmd1, level + 1, father);
-
-		if (ret_exec < 0)
-			return false;
-
-		exit(ret_exec);
-	}
-
-	default: {
-		break;
-	}
-	}
+	if (cmd2->op != OP_PARALLEL)
+		rate_wait();
 
 	// Create child process for cmd2
-	pid_t curr_pid2 = fork();
+	pid_t curr_pid2 = proc->start(&child2);
 
-	switch (curr_pid2) {
-	case -1: {
+	if (curr_pid2 < 0)
 		return false;
-	}
-
-	case 0: {
-		// Second child
-		close(pipefd[WRITE]);
-
-		// Redirect standard input of cmd2 to pipe read end
-		int ret_dup2 = dup2(pipefd[READ], STDIN_FILENO);
 
-		if (ret_dup2 < 0)
-			return false;
-
-		close(pipefd[READ]);
-
-		// Execute cmd2
-		int ret_exec = parse_command(cmd2, level + 1, father);
-
-		if (ret_exec < 0)
-			return false;
-
-		exit(ret_exec);
-	}
-
-	default: {
-		close(pipefd[WRITE]);
-		close(pipefd[READ]);
-
-		// Wait for both children
-		int status_pid1 = 0, status_pid2 = 0;
-		int ret_pid1 = waitpid(curr_pid1, &status_pid1, 0);
+	close(pipefd[WRITE]);
+	close(pipefd[READ]);
 
-		if (ret_pid1 < 0)
-			return -1;
+	// Wait for both children
+	int status_pid1 = 0, status_pid2 = 0;
+	int ret_pid1 = proc->wait(curr_pid1, &status_pid1, 0);
 
-		int ret_pid2 = waitpid(curr_pid2, &status_pid2, 0);
+	if (ret_pid1 < 0)
+		return -1;
 
-		if (ret_pid2 < 0)
-			return -1;
+	int ret_pid2 = proc->wait(curr_pid2, &status_pid2, 0);
 
-		if (WIFEXITED(status_pid2))
-			return WEXITSTATUS(status_pid2);
-	}
-	}
+	if (ret_pid2 < 0)
+		return -1;
 
-	close(pipefd[READ]);
-	close(pipefd[WRITE]);
+	if (WIFEXITED(status_pid2))
+		return WEXITSTATUS(status_pid2);
 
 	// Return exit status
 	return EXIT_SUCCESS;
@@ -514,6 +784,13 @@ int parse_command(command_t *c, int level, command_t *father)
 
 	switch (c->op) {
 	case OP_SEQUENTIAL:
+		// Independent commands of the chain may run concurrently
+		if (autopar_enabled() && (c->up == NULL
+					|| c->up->op != OP_SEQUENTIAL)) {
+			ret_op_status = autopar_run(c, level + 1);
+			break;
+		}
+
 		// Execute the commands one after the other.
 		ret_op_status = parse_command(c->cmd1, level + 1, c);
 		if (ret_op_status < 0)
@@ -554,3 +831,37 @@ int parse_command(command_t *c, int level, command_t *father)
 	// Return the exit status after the execution
 	return ret_op_status;
 }
+
+/**
+ * Check if a simple command runs inside the shell process.
+ */
+static bool simple_in_shell(simple_command_t *s)
+{
+	char *verb = get_word(s->verb);
+	bool ret = !strcmp(verb, "cd") || !strcmp(verb, "exit")
+		|| !strcmp(verb, "quit") || !strcmp(verb, "exec")
+		|| !strcmp(verb, "ulimit") || builtin_lookup(verb) != NULL
+		|| strchr(verb, '=') != NULL;
+
+	free(verb);
+
+	return ret;
+}
+
+bool cmd_in_shell(command_t *c)
+{
+	if (c == NULL)
+		return false;
+
+	switch (c->op) {
+	case OP_NONE:
+		return simple_in_shell(c->scmd);
+	case OP_SEQUENTIAL:
+	case OP_CONDITIONAL_NZERO:
+	case OP_CONDITIONAL_ZERO:
+		return cmd_in_shell(c->cmd1) || cmd_in_shell(c->cmd2);
+	default:
+		// Both sides run in children
+		return false;
+	}
+}
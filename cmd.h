@@ -3,6 +3,8 @@
 #ifndef _CMD_H
 #define _CMD_H
 
+#include <stdbool.h>
+
 #include "../util/parser/parser.h"
 
 #define SHELL_EXIT -100
@@ -12,4 +14,12 @@
  */
 int parse_command(command_t *cmd, int level, command_t *father);
 
+/**
+ * Check if running a command may change the state of the shell itself: if
+ * any of the simple commands it runs in the shell process (not in a pipe
+ * or in the background) is cd, exit, exec, ulimit, a builtin or a variable
+ * assignment.
+ */
+bool cmd_in_shell(command_t *c);
+
 #endif /* _CMD_H */
@@ -0,0 +1,367 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <regex.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cond.h"
+#include "glob.h"
+#include "utils.h"
+#include "vars.h"
+
+#define COND_TRUE		0
+#define COND_FALSE		1
+#define COND_ERROR		2
+
+#define COND_BUCKETS		(2 * COND_REGEX_CACHE_SIZE)
+#define NONE			-1
+
+enum pattern_kind {
+	PATTERN_GLOB,
+	PATTERN_REGEX
+};
+
+/**
+ * A compiled pattern. Entries are chained in their hash bucket and in the
+ * LRU list, most recently used first.
+ */
+struct pattern_entry {
+	enum pattern_kind kind;
+	char *text;
+	unsigned int hash;
+
+	regex_t regex;
+	struct glob *glob;
+
+	int bucket_next;
+	int lru_prev;
+	int lru_next;
+};
+
+static struct pattern_entry entries[COND_REGEX_CACHE_SIZE];
+static int nentries;
+static int buckets[COND_BUCKETS];
+static int lru_head = NONE;
+static int lru_tail = NONE;
+static bool cache_ready;
+
+static unsigned int hash_pattern(enum pattern_kind kind, const char *text)
+{
+	unsigned int h = 5381 + kind;
+
+	while (*text != '\0')
+		h = h * 33 + (unsigned char)*text++;
+
+	return h;
+}
+
+static void lru_unlink(int i)
+{
+	struct pattern_entry *e = &entries[i];
+
+	if (e->lru_prev != NONE)
+		entries[e->lru_prev].lru_next = e->lru_next;
+	else
+		lru_head = e->lru_next;
+
+	if (e->lru_next != NONE)
+		entries[e->lru_next].lru_prev = e->lru_prev;
+	else
+		lru_tail = e->lru_prev;
+}
+
+static void lru_push_front(int i)
+{
+	entries[i].lru_prev = NONE;
+	entries[i].lru_next = lru_head;
+
+	if (lru_head != NONE)
+		entries[lru_head].lru_prev = i;
+	lru_head = i;
+
+	if (lru_tail == NONE)
+		lru_tail = i;
+}
+
+static void bucket_unlink(int i)
+{
+	int *link = &buckets[entries[i].hash % COND_BUCKETS];
+
+	while (*link != i)
+		link = &entries[*link].bucket_next;
+
+	*link = entries[i].bucket_next;
+}
+
+/**
+ * Pick the slot for a new entry: a free one, or the least recently used.
+ */
+static int cache_slot(void)
+{
+	if (!cache_ready) {
+		for (int i = 0; i < COND_BUCKETS; i++)
+			buckets[i] = NONE;
+		cache_ready = true;
+	}
+
+	if (nentries < COND_REGEX_CACHE_SIZE)
+		return nentries++;
+
+	int i = lru_tail;
+	struct pattern_entry *e = &entries[i];
+
+	lru_unlink(i);
+	bucket_unlink(i);
+
+	if (e->kind == PATTERN_REGEX)
+		regfree(&e->regex);
+	glob_free(e->glob);
+	free(e->text);
+
+	return i;
+}
+
+/**
+ * Return the compiled pattern, compiling it on a miss.
+ *
+ * @return the cache entry, or NULL if the regex does not compile
+ */
+static struct pattern_entry *pattern_lookup(enum pattern_kind kind,
+		const char *text)
+{
+	unsigned int hash = hash_pattern(kind, text);
+
+	if (cache_ready) {
+		int i = buckets[hash % COND_BUCKETS];
+
+		for (; i != NONE; i = entries[i].bucket_next) {
+			struct pattern_entry *e = &entries[i];
+
+			if (e->hash != hash || e->kind != kind
+					|| strcmp(e->text, text))
+				continue;
+
+			lru_unlink(i);
+			lru_push_front(i);
+
+			return e;
+		}
+	}
+
+	regex_t regex;
+
+	if (kind == PATTERN_REGEX) {
+		int ret = regcomp(&regex, text, REG_EXTENDED);
+
+		if (ret != 0) {
+			char msg[128];
+
+			regerror(ret, &regex, msg, sizeof(msg));
+			fprintf(stderr, "[[: invalid regex '%s': %s\n", text,
+					msg);
+			return NULL;
+		}
+	}
+
+	int i = cache_slot();
+	struct pattern_entry *e = &entries[i];
+
+	memset(e, 0, sizeof(*e));
+	e->kind = kind;
+	e->hash = hash;
+	e->text = strdup(text);
+	DIE(e->text == NULL, "Error allocating pattern.");
+
+	if (kind == PATTERN_REGEX)
+		e->regex = regex;
+	else
+		e->glob = glob_compile(text);
+
+	e->bucket_next = buckets[hash % COND_BUCKETS];
+	buckets[hash % COND_BUCKETS] = i;
+	lru_push_front(i);
+
+	return e;
+}
+
+/**
+ * Search value for the regex and publish the match in BASH_REMATCH.
+ */
+static int cond_regex(const char *value, const char *text)
+{
+	struct pattern_entry *e = pattern_lookup(PATTERN_REGEX, text);
+
+	if (e == NULL)
+		return COND_ERROR;
+
+	size_t ngroups = e->regex.re_nsub + 1;
+	regmatch_t *match = calloc(ngroups, sizeof(*match));
+
+	DIE(match == NULL, "Error allocating regex match.");
+
+	if (regexec(&e->regex, value, ngroups, match, 0) != 0) {
+		free(match);
+		vars_array_set("BASH_REMATCH", NULL, 0);
+		return COND_FALSE;
+	}
+
+	char **groups = calloc(ngroups, sizeof(*groups));
+
+	DIE(groups == NULL, "Error allocating regex match.");
+
+	for (size_t i = 0; i < ngroups; i++) {
+		// Groups that did not take part in the match are empty
+		regoff_t start = match[i].rm_so < 0 ? 0 : match[i].rm_so;
+		regoff_t end = match[i].rm_so < 0 ? 0 : match[i].rm_eo;
+
+		groups[i] = strndup(value + start, end - start);
+		DIE(groups[i] == NULL, "Error allocating regex match.");
+	}
+
+	free(match);
+	vars_array_set("BASH_REMATCH", groups, ngroups);
+
+	return COND_TRUE;
+}
+
+static int cond_glob(const char *value, const char *text)
+{
+	struct pattern_entry *e = pattern_lookup(PATTERN_GLOB, text);
+
+	return glob_match(e->glob, value, strlen(value)) ? COND_TRUE
+		: COND_FALSE;
+}
+
+static int cond_integer(const char *left, const char *op, const char *right)
+{
+	char *end_left, *end_right;
+	long a = strtol(left, &end_left, 10);
+	long b = strtol(right, &end_right, 10);
+
+	if (*left == '\0' || *end_left != '\0'
+			|| *right == '\0' || *end_right != '\0') {
+		fprintf(stderr, "[[: integer expression expected\n");
+		return COND_ERROR;
+	}
+
+	bool ret;
+
+	if (!strcmp(op, "-eq"))
+		ret = a == b;
+	else if (!strcmp(op, "-ne"))
+		ret = a != b;
+	else if (!strcmp(op, "-lt"))
+		ret = a < b;
+	else if (!strcmp(op, "-le"))
+		ret = a <= b;
+	else if (!strcmp(op, "-gt"))
+		ret = a > b;
+	else
+		ret = a >= b;
+
+	return ret ? COND_TRUE : COND_FALSE;
+}
+
+static int cond_unary(const char *op, const char *arg)
+{
+	struct stat st;
+
+	switch (op[1]) {
+	case 'z':
+		return *arg == '\0' ? COND_TRUE : COND_FALSE;
+	case 'n':
+		return *arg != '\0' ? COND_TRUE : COND_FALSE;
+	case 'e':
+		return stat(arg, &st) == 0 ? COND_TRUE : COND_FALSE;
+	case 'f':
+		return stat(arg, &st) == 0 && S_ISREG(st.st_mode) ? COND_TRUE
+			: COND_FALSE;
+	case 'd':
+		return stat(arg, &st) == 0 && S_ISDIR(st.st_mode) ? COND_TRUE
+			: COND_FALSE;
+	case 'r':
+		return access(arg, R_OK) == 0 ? COND_TRUE : COND_FALSE;
+	case 'w':
+		return access(arg, W_OK) == 0 ? COND_TRUE : COND_FALSE;
+	case 'x':
+		return access(arg, X_OK) == 0 ? COND_TRUE : COND_FALSE;
+	default:
+		fprintf(stderr, "[[: unknown operator '%s'\n", op);
+		return COND_ERROR;
+	}
+}
+
+static bool is_integer_op(const char *op)
+{
+	static const char * const ops[] = {
+		"-eq", "-ne", "-lt", "-le", "-gt", "-ge"
+	};
+
+	for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+		if (!strcmp(op, ops[i]))
+			return true;
+
+	return false;
+}
+
+int cond_eval(int argc, char **argv)
+{
+	bool negate = false;
+	int ret;
+
+	if (argc < 2 || strcmp(argv[argc - 1], "]]")) {
+		fprintf(stderr, "[[: missing ']]'\n");
+		return COND_ERROR;
+	}
+
+	// Operands between '[[' and ']]'
+	char **args = argv + 1;
+	int nargs = argc - 2;
+
+	if (nargs > 0 && !strcmp(args[0], "!")) {
+		negate = true;
+		args++;
+		nargs--;
+	}
+
+	switch (nargs) {
+	case 1:
+		ret = *args[0] != '\0' ? COND_TRUE : COND_FALSE;
+		break;
+	case 2:
+		if (args[0][0] != '-' || strlen(args[0]) != 2) {
+			fprintf(stderr, "[[: unknown operator '%s'\n", args[0]);
+			return COND_ERROR;
+		}
+		ret = cond_unary(args[0], args[1]);
+		break;
+	case 3:
+		if (!strcmp(args[1], "==") || !strcmp(args[1], "=")) {
+			ret = cond_glob(args[0], args[2]);
+		} else if (!strcmp(args[1], "!=")) {
+			ret = cond_glob(args[0], args[2]);
+			ret = ret == COND_TRUE ? COND_FALSE : COND_TRUE;
+		} else if (!strcmp(args[1], "=~")) {
+			ret = cond_regex(args[0], args[2]);
+		} else if (is_integer_op(args[1])) {
+			ret = cond_integer(args[0], args[1], args[2]);
+		} else {
+			fprintf(stderr, "[[: unknown operator '%s'\n", args[1]);
+			return COND_ERROR;
+		}
+		break;
+	default:
+		fprintf(stderr, "[[: syntax error\n");
+		return COND_ERROR;
+	}
+
+	if (negate && ret != COND_ERROR)
+		ret = ret == COND_TRUE ? COND_FALSE : COND_TRUE;
+
+	return ret;
+}
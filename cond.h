@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _COND_H
+#define _COND_H
+
+#define COND_REGEX_CACHE_SIZE	64
+
+/**
+ * Evaluate '[[ EXPR ]]' in-process; argv[0] is '[[' and the last argument
+ * must be ']]'. EXPR is one of
+ *
+ *   [!] STRING                       true if STRING is not empty
+ *   [!] -z|-n STRING                 empty / non-empty string
+ *   [!] -e|-f|-d|-r|-w|-x FILE       file tests
+ *   [!] LEFT ==|=|!= PATTERN         glob match (shared matcher of glob.c)
+ *   [!] LEFT =~ REGEX                POSIX extended regex search
+ *   [!] LEFT -eq|-ne|-lt|-le|-gt|-ge RIGHT    integer comparison
+ *
+ * Patterns and regexes are compiled once and kept in an LRU cache of
+ * COND_REGEX_CACHE_SIZE entries keyed by their text. After a '=~' test,
+ * the match and its capture groups are in the BASH_REMATCH array.
+ *
+ * Two differences from bash come from the words reaching here already
+ * split and unquoted by the parser:
+ * - an unquoted '|', '&', ';', '<' or '>' is an operator of the command
+ *   line, so '[[ $x =~ a(b|c) ]]' is split at the '|' (and '&&' or '||'
+ *   cannot join tests); quote the regex or keep it in a variable;
+ * - quoting does not make a PATTERN or a REGEX literal: "a*" is still a
+ *   glob and "a.c" still a regex, where bash would match them as plain
+ *   text.
+ *
+ * @return 0 if true, 1 if false, 2 on a syntax error or invalid regex
+ */
+int cond_eval(int argc, char **argv);
+
+#endif /* _COND_H */
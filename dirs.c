@@ -0,0 +1,583 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dirs.h"
+#include "utils.h"
+
+/**
+ * A visited directory: its logical path and an O_PATH fd on it. Entries
+ * are kept most recently used first; the current directory and the stack
+ * hold references, and only unreferenced entries past DIRS_CACHE_SIZE are
+ * dropped.
+ */
+struct dir_entry {
+	char *path;
+	int fd;
+	int refs;
+	struct dir_entry *next;
+};
+
+static struct dir_entry *entries;
+static struct dir_entry *cwd;
+
+// Directory stack, top last
+static struct dir_entry **stack;
+static int nstack, stack_size;
+
+/**
+ * A memoized CDPATH lookup of name (path is NULL if nothing matched). When
+ * CDPATH has relative entries the result also depends on the working
+ * directory it was made from, kept in cwd.
+ */
+struct cdpath_memo {
+	char *name;
+	unsigned int generation;
+	char *cwd;
+	char *path;
+	bool shown;
+};
+
+static struct cdpath_memo cdpath_memo[DIRS_CDPATH_CACHE_SIZE];
+static unsigned int cdpath_generation;
+
+/**
+ * Resolve path against the absolute, normalized base, removing '.' and
+ * '..' components and repeated slashes without looking at the filesystem.
+ */
+static char *dirs_resolve(const char *base, const char *path)
+{
+	struct word_buf out = { NULL, 0, 0 };
+
+	word_buf_append(&out, "", 0);
+
+	if (path[0] != '/') {
+		word_buf_append(&out, base, strlen(base));
+
+		// The root is the only path ending with a slash
+		if (out.len > 0 && out.data[out.len - 1] == '/')
+			out.data[--out.len] = '\0';
+	}
+
+	while (*path != '\0') {
+		size_t n = strcspn(path, "/");
+
+		if (n == 2 && !strncmp(path, "..", 2)) {
+			char *slash = strrchr(out.data, '/');
+
+			out.len = slash != NULL ? slash - out.data : 0;
+			out.data[out.len] = '\0';
+		} else if (n > 0 && !(n == 1 && path[0] == '.')) {
+			word_buf_append(&out, "/", 1);
+			word_buf_append(&out, path, n);
+		}
+
+		path += n;
+		path += strspn(path, "/");
+	}
+
+	if (out.len == 0)
+		word_buf_append(&out, "/", 1);
+
+	return out.data;
+}
+
+static void dir_trim(void)
+{
+	struct dir_entry **link = &entries;
+	int n = 0;
+
+	while (*link != NULL) {
+		struct dir_entry *e = *link;
+
+		if (++n <= DIRS_CACHE_SIZE || e->refs > 0) {
+			link = &e->next;
+			continue;
+		}
+
+		*link = e->next;
+		close(e->fd);
+		free(e->path);
+		free(e);
+	}
+}
+
+static void dir_put(struct dir_entry *e)
+{
+	if (e == NULL)
+		return;
+
+	e->refs--;
+	dir_trim();
+}
+
+/**
+ * Find the cached entry of the parent of path, if any.
+ */
+static struct dir_entry *dir_parent(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+	size_t n = slash == path ? 1 : slash - path;
+
+	if (slash == NULL || slash[1] == '\0')
+		return NULL;
+
+	for (struct dir_entry *e = entries; e != NULL; e = e->next)
+		if (strlen(e->path) == n && !strncmp(e->path, path, n))
+			return e;
+
+	return NULL;
+}
+
+/**
+ * Check that the directory behind a cached fd still exists, and is still
+ * the one its path names (it was not renamed and replaced).
+ *
+ * The name is looked up in the parent through the parent's own fd when it
+ * is cached, as it is after a walk down the tree, so the check costs a
+ * single name lookup however deep the directory is; only otherwise is the
+ * whole path walked.
+ */
+static bool dir_alive(const struct dir_entry *e)
+{
+	struct stat st, st_path;
+
+	if (fstat(e->fd, &st) < 0 || !S_ISDIR(st.st_mode) || st.st_nlink == 0)
+		return false;
+
+	struct dir_entry *parent = dir_parent(e->path);
+	int ret = parent != NULL
+		? fstatat(parent->fd, strrchr(e->path, '/') + 1, &st_path, 0)
+		: fstatat(AT_FDCWD, e->path, &st_path, 0);
+
+	return ret == 0 && st_path.st_dev == st.st_dev
+		&& st_path.st_ino == st.st_ino;
+}
+
+/**
+ * Return a referenced entry for the logical path, opening the directory
+ * on a miss or when the cached one was removed or replaced.
+ *
+ * @return the entry, or NULL with errno set if the directory cannot be
+ * opened
+ */
+static struct dir_entry *dir_get(const char *path)
+{
+	struct dir_entry **link = &entries;
+
+	while (*link != NULL && strcmp((*link)->path, path))
+		link = &(*link)->next;
+
+	struct dir_entry *e = *link;
+
+	if (e == NULL || !dir_alive(e)) {
+		int fd = fd_move_high(open(path,
+					O_PATH | O_DIRECTORY | O_CLOEXEC));
+
+		if (fd < 0)
+			return NULL;
+
+		if (e == NULL) {
+			e = calloc(1, sizeof(*e));
+			DIE(e == NULL, "Error allocating directory.");
+
+			e->path = strdup(path);
+			DIE(e->path == NULL, "Error allocating directory.");
+		} else {
+			// Stack entries share it, so it is reopened in place
+			close(e->fd);
+			*link = e->next;
+		}
+
+		e->fd = fd;
+	} else {
+		*link = e->next;
+	}
+
+	e->next = entries;
+	entries = e;
+	e->refs++;
+	dir_trim();
+
+	return e;
+}
+
+/**
+ * Return the current directory, taken from PWD (if it really names the
+ * working directory) or getcwd() the first time.
+ */
+static struct dir_entry *dir_current(void)
+{
+	if (cwd != NULL)
+		return cwd;
+
+	const char *pwd = getenv("PWD");
+	struct stat st_pwd, st_dot;
+	char *path = NULL;
+
+	if (pwd != NULL && pwd[0] == '/' && stat(pwd, &st_pwd) == 0
+			&& stat(".", &st_dot) == 0
+			&& st_pwd.st_dev == st_dot.st_dev
+			&& st_pwd.st_ino == st_dot.st_ino)
+		path = dirs_resolve("/", pwd);
+
+	if (path == NULL) {
+		char *real = getcwd(NULL, 0);
+
+		path = dirs_resolve("/", real != NULL ? real : ".");
+		free(real);
+	}
+
+	cwd = dir_get(path);
+
+	if (cwd == NULL) {
+		// Only the working directory itself can still be reached
+		cwd = calloc(1, sizeof(*cwd));
+		DIE(cwd == NULL, "Error allocating directory.");
+
+		cwd->path = path;
+		cwd->fd = fd_move_high(open(".",
+					O_PATH | O_DIRECTORY | O_CLOEXEC));
+		cwd->refs = 1;
+		cwd->next = entries;
+		entries = cwd;
+
+		return cwd;
+	}
+
+	free(path);
+
+	return cwd;
+}
+
+/**
+ * Make e the current directory, taking over the caller's reference.
+ */
+static int dir_enter(struct dir_entry *e)
+{
+	struct dir_entry *old = dir_current();
+
+	if (fchdir(e->fd) < 0)
+		return -1;
+
+	setenv("OLDPWD", old->path, 1);
+	setenv("PWD", e->path, 1);
+
+	cwd = e;
+	dir_put(old);
+
+	return 0;
+}
+
+void dirs_cdpath_changed(void)
+{
+	cdpath_generation++;
+}
+
+/**
+ * Check if CDPATH is searched for path: it must be relative and not start
+ * with '.' or '..'.
+ */
+static bool cdpath_applies(const char *path)
+{
+	if (path[0] == '/' || path[0] == '\0')
+		return false;
+
+	if (path[0] == '.') {
+		size_t dots = path[1] == '.' ? 2 : 1;
+
+		if (path[dots] == '\0' || path[dots] == '/')
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Try name under every CDPATH entry, in order; an empty entry is the
+ * working directory.
+ *
+ * @return the referenced entry of the directory found, or NULL
+ */
+static struct dir_entry *cdpath_search(const char *cdpath, const char *name,
+		bool *shown)
+{
+	const char *cur = dir_current()->path;
+
+	while (true) {
+		size_t n = strcspn(cdpath, ":");
+		char *base = strndup(cdpath, n);
+
+		DIE(base == NULL, "Error allocating CDPATH entry.");
+
+		char *dir = dirs_resolve(cur, n > 0 ? base : ".");
+		char *full = dirs_resolve(dir, name);
+		struct dir_entry *e = dir_get(full);
+
+		// Only a directory found through a named entry is shown
+		*shown = n > 0 && strcmp(base, ".");
+
+		free(base);
+		free(dir);
+		free(full);
+
+		if (e != NULL)
+			return e;
+
+		if (cdpath[n] == '\0')
+			return NULL;
+		cdpath += n + 1;
+	}
+}
+
+static bool cdpath_relative(const char *cdpath)
+{
+	while (true) {
+		if (*cdpath != '/')
+			return true;
+
+		cdpath = strchr(cdpath, ':');
+		if (cdpath == NULL)
+			return false;
+		cdpath++;
+	}
+}
+
+/**
+ * Look name up in CDPATH, through the memo when possible.
+ *
+ * @return the referenced entry of the directory found, or NULL
+ */
+static struct dir_entry *cdpath_lookup(const char *name, bool *shown)
+{
+	const char *cdpath = getenv("CDPATH");
+
+	if (cdpath == NULL || *cdpath == '\0' || !cdpath_applies(name))
+		return NULL;
+
+	unsigned int hash = 5381;
+
+	for (const char *p = name; *p != '\0'; p++)
+		hash = hash * 33 + (unsigned char)*p;
+
+	struct cdpath_memo *m = &cdpath_memo[hash % DIRS_CDPATH_CACHE_SIZE];
+	const char *cur = dir_current()->path;
+
+	if (m->name != NULL && m->generation == cdpath_generation
+			&& !strcmp(m->name, name)
+			&& (m->cwd == NULL || !strcmp(m->cwd, cur))) {
+		if (m->path == NULL)
+			return NULL;
+
+		struct dir_entry *e = dir_get(m->path);
+
+		if (e != NULL) {
+			*shown = m->shown;
+			return e;
+		}
+	}
+
+	struct dir_entry *e = cdpath_search(cdpath, name, shown);
+
+	free(m->name);
+	free(m->cwd);
+	free(m->path);
+
+	m->name = strdup(name);
+	DIE(m->name == NULL, "Error allocating CDPATH memo.");
+	m->generation = cdpath_generation;
+	m->cwd = NULL;
+	m->path = NULL;
+	m->shown = *shown;
+
+	if (cdpath_relative(cdpath)) {
+		m->cwd = strdup(cur);
+		DIE(m->cwd == NULL, "Error allocating CDPATH memo.");
+	}
+
+	if (e != NULL) {
+		m->path = strdup(e->path);
+		DIE(m->path == NULL, "Error allocating CDPATH memo.");
+	}
+
+	return e;
+}
+
+int dirs_cd(const char *path)
+{
+	bool shown = false;
+	struct dir_entry *e = cdpath_lookup(path, &shown);
+
+	if (e == NULL) {
+		char *logical = dirs_resolve(dir_current()->path, path);
+
+		shown = false;
+		e = dir_get(logical);
+		free(logical);
+	}
+
+	if (e == NULL) {
+		// Paths like 'link/..' may only exist physically
+		if (chdir(path) < 0)
+			return -1;
+
+		char *real = getcwd(NULL, 0);
+
+		if (real == NULL)
+			return -1;
+
+		e = dir_get(real);
+		free(real);
+
+		if (e == NULL)
+			return -1;
+	}
+
+	if (dir_enter(e) < 0) {
+		int err = errno;
+
+		dir_put(e);
+		errno = err;
+		return -1;
+	}
+
+	if (shown)
+		printf("%s\n", e->path);
+
+	return 0;
+}
+
+struct dir_entry *dirs_hold(void)
+{
+	struct dir_entry *e = dir_current();
+
+	e->refs++;
+
+	return e;
+}
+
+int dirs_enter(struct dir_entry *e)
+{
+	if (e == dir_current())
+		return 0;
+
+	e->refs++;
+	if (dir_enter(e) < 0) {
+		int err = errno;
+
+		dir_put(e);
+		errno = err;
+		return -1;
+	}
+
+	return 0;
+}
+
+void dirs_release(struct dir_entry *e)
+{
+	dir_put(e);
+}
+
+const char *dirs_pwd(void)
+{
+	return dir_current()->path;
+}
+
+char *dirs_absolute(const char *path)
+{
+	return dirs_resolve(dir_current()->path, path);
+}
+
+int dirs_push(const char *path)
+{
+	struct dir_entry *cur = dir_current();
+
+	if (path == NULL && nstack == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	// The stack keeps its own reference on the directory left
+	cur->refs++;
+
+	if (path == NULL) {
+		if (dir_enter(stack[nstack - 1]) < 0) {
+			cur->refs--;
+			return -1;
+		}
+
+		stack[nstack - 1] = cur;
+		return 0;
+	}
+
+	if (dirs_cd(path) < 0) {
+		int err = errno;
+
+		dir_put(cur);
+		errno = err;
+		return -1;
+	}
+
+	if (nstack == stack_size) {
+		stack_size = stack_size ? 2 * stack_size : 8;
+		stack = realloc(stack, stack_size * sizeof(*stack));
+		DIE(stack == NULL, "Error allocating directory stack.");
+	}
+
+	stack[nstack++] = cur;
+
+	return 0;
+}
+
+int dirs_pop(void)
+{
+	if (nstack == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (dir_enter(stack[nstack - 1]) < 0)
+		return -1;
+
+	nstack--;
+
+	return 0;
+}
+
+static void dirs_print_one(const char *path, bool full_paths)
+{
+	const char *home = getenv("HOME");
+	size_t n = home != NULL ? strlen(home) : 0;
+
+	if (!full_paths && n > 1 && !strncmp(path, home, n)
+			&& (path[n] == '/' || path[n] == '\0'))
+		printf("~%s", path + n);
+	else
+		printf("%s", path);
+}
+
+void dirs_print(bool full_paths)
+{
+	dirs_print_one(dir_current()->path, full_paths);
+
+	for (int i = nstack - 1; i >= 0; i--) {
+		putchar(' ');
+		dirs_print_one(stack[i]->path, full_paths);
+	}
+
+	putchar('\n');
+}
+
+void dirs_clear(void)
+{
+	while (nstack > 0)
+		dir_put(stack[--nstack]);
+}
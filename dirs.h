@@ -0,0 +1,97 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _DIRS_H
+#define _DIRS_H
+
+#include <stdbool.h>
+
+#define DIRS_CACHE_SIZE		16
+#define DIRS_CDPATH_CACHE_SIZE	32
+
+/*
+ * The current directory, the directory stack (pushd, popd, dirs) and a
+ * cache of O_PATH fds of the most recently visited directories.
+ *
+ * The shell keeps its logical working directory (PWD) as a string, with
+ * '.' and '..' resolved lexically, so 'pwd' never calls getcwd(). Each
+ * directory that was entered keeps an O_PATH fd keyed by that logical
+ * path; going back to it is a fchdir() instead of a path walk. An entry
+ * is reopened when its directory was removed, or renamed and replaced:
+ * before it is used, its name is looked up again through the fd of its
+ * parent, if that is cached too (a single name lookup), or else through
+ * its whole path. With the parent cached, a replaced ancestor further up
+ * is not noticed until the parent itself is entered.
+ */
+
+/**
+ * Change the current directory to path, relative to the logical working
+ * directory, and update PWD and OLDPWD.
+ *
+ * A relative path not starting with '.' or '..' is first looked up in the
+ * directories listed in CDPATH; the directory found that way is printed.
+ * Lookups are memoized per name until CDPATH is assigned again (or, if it
+ * has relative entries, until the working directory changes); a directory
+ * created later in an earlier CDPATH entry is not noticed before that.
+ *
+ * @return 0 on success, -1 with errno set otherwise
+ */
+int dirs_cd(const char *path);
+
+/**
+ * Drop the CDPATH lookups made with the previous value of CDPATH.
+ */
+void dirs_cdpath_changed(void);
+
+struct dir_entry;
+
+/**
+ * Take a reference to the current directory: its fd stays open, out of
+ * the cache, until dirs_release().
+ */
+struct dir_entry *dirs_hold(void);
+
+/**
+ * Make a held directory the current one with a fchdir(), updating PWD and
+ * OLDPWD. The caller keeps its reference.
+ *
+ * @return 0 on success, -1 with errno set otherwise
+ */
+int dirs_enter(struct dir_entry *e);
+
+void dirs_release(struct dir_entry *e);
+
+/**
+ * Return the logical working directory.
+ */
+const char *dirs_pwd(void);
+
+/**
+ * Return path made absolute against the logical working directory, with
+ * '.' and '..' resolved lexically (to be freed by the caller).
+ */
+char *dirs_absolute(const char *path);
+
+/**
+ * Push the current directory on the stack and change to path; with a NULL
+ * path, exchange the current directory with the top of the stack.
+ *
+ * @return 0 on success, -1 with errno set otherwise (EINVAL: empty stack)
+ */
+int dirs_push(const char *path);
+
+/**
+ * Change to the directory on top of the stack and remove it.
+ *
+ * @return 0 on success, -1 with errno set otherwise (EINVAL: empty stack)
+ */
+int dirs_pop(void);
+
+/**
+ * Print the current directory followed by the stack, top first. Unless
+ * full_paths is set, the home directory is shown as '~'.
+ */
+void dirs_print(bool full_paths);
+
+void dirs_clear(void);
+
+#endif /* _DIRS_H */
@@ -0,0 +1,546 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "expand.h"
+#include "glob.h"
+#include "utils.h"
+#include "vars.h"
+
+#define PARAM_CACHE_SIZE	256
+
+enum param_op_kind {
+	PARAM_VALUE,
+	PARAM_LENGTH,
+	PARAM_DEFAULT,
+	PARAM_STRIP_PREFIX,
+	PARAM_STRIP_SUFFIX,
+	PARAM_REPLACE,
+	PARAM_SUBSTRING,
+	PARAM_INVALID
+};
+
+enum param_anchor {
+	ANCHOR_NONE,
+	ANCHOR_START,
+	ANCHOR_END
+};
+
+/**
+ * A parsed '${...}' expression, kept in the cache under its spec string.
+ */
+struct param_op {
+	char *spec;
+	char *name;
+	enum param_op_kind kind;
+
+	bool longest;		/* '##' and '%%' */
+	bool all;		/* '//' */
+	enum param_anchor anchor;
+	struct glob *pattern;
+	char *word;		/* default value or replacement */
+
+	long offset;
+	long length;
+	bool has_length;
+
+	bool subscript;		/* name[index] */
+	bool all_elements;	/* name[@] or name[*] */
+	long index;
+};
+
+/* Direct-mapped cache of parsed expressions, indexed by spec hash. */
+static struct param_op *param_cache[PARAM_CACHE_SIZE];
+
+/* Expressions being expanded, counting those nested in a word. */
+static int param_depth;
+
+static inline bool is_name_char(char c)
+{
+	return isalnum((unsigned char)c) || c == '_';
+}
+
+static unsigned int hash_spec(const char *spec)
+{
+	unsigned int h = 5381;
+
+	while (*spec != '\0')
+		h = h * 33 + (unsigned char)*spec++;
+
+	return h;
+}
+
+static char *dup_range(const char *s, size_t n)
+{
+	char *d = malloc(n + 1);
+
+	DIE(d == NULL, "Error allocating expansion.");
+	memcpy(d, s, n);
+	d[n] = '\0';
+
+	return d;
+}
+
+/**
+ * Split "pat/rep" on the first unescaped '/'. The pattern is compiled; the
+ * replacement is kept as text.
+ */
+static void parse_replace(struct param_op *op, const char *p)
+{
+	if (*p == '/') {
+		op->all = true;
+		p++;
+	} else if (*p == '#') {
+		op->anchor = ANCHOR_START;
+		p++;
+	} else if (*p == '%') {
+		op->anchor = ANCHOR_END;
+		p++;
+	}
+
+	const char *sep = p;
+
+	while (*sep != '\0' && *sep != '/') {
+		if (*sep == '\\' && sep[1] != '\0')
+			sep++;
+		sep++;
+	}
+
+	char *pat = dup_range(p, sep - p);
+
+	op->pattern = glob_compile(pat);
+	free(pat);
+
+	op->word = strdup(*sep == '/' ? sep + 1 : "");
+	DIE(op->word == NULL, "Error allocating expansion.");
+}
+
+static void parse_substring(struct param_op *op, const char *p)
+{
+	char *end;
+
+	op->offset = strtol(p, &end, 10);
+	if (end == p && *p != ':') {
+		op->kind = PARAM_INVALID;
+		return;
+	}
+
+	while (isspace((unsigned char)*end))
+		end++;
+
+	if (*end == ':') {
+		p = end + 1;
+		op->length = strtol(p, &end, 10);
+		op->has_length = true;
+
+		while (isspace((unsigned char)*end))
+			end++;
+	}
+
+	if (*end != '\0')
+		op->kind = PARAM_INVALID;
+}
+
+/**
+ * Parse an array subscript starting at '['.
+ *
+ * @return the position after ']', or NULL if the subscript is invalid
+ */
+static const char *parse_subscript(struct param_op *op, const char *p)
+{
+	char *end;
+
+	op->subscript = true;
+
+	if ((p[1] == '@' || p[1] == '*') && p[2] == ']') {
+		op->all_elements = true;
+		return p + 3;
+	}
+
+	op->index = strtol(p + 1, &end, 10);
+	if (end == p + 1 || *end != ']')
+		return NULL;
+
+	return end + 1;
+}
+
+static struct param_op *param_op_parse(const char *spec)
+{
+	struct param_op *op = calloc(1, sizeof(*op));
+
+	DIE(op == NULL, "Error allocating expansion.");
+
+	op->spec = strdup(spec);
+	DIE(op->spec == NULL, "Error allocating expansion.");
+
+	const char *p = spec;
+
+	if (*p == '#' && p[1] != '\0') {
+		op->kind = PARAM_LENGTH;
+		p++;
+	}
+
+	const char *name = p;
+
+	while (is_name_char(*p))
+		p++;
+	op->name = dup_range(name, p - name);
+
+	if (*p == '[' && p != name) {
+		p = parse_subscript(op, p);
+		if (p == NULL) {
+			op->kind = PARAM_INVALID;
+			return op;
+		}
+	}
+
+	if (op->kind == PARAM_LENGTH || p == name) {
+		if (*p != '\0' || op->name[0] == '\0')
+			op->kind = PARAM_INVALID;
+		return op;
+	}
+
+	switch (*p) {
+	case '\0':
+		op->kind = PARAM_VALUE;
+		break;
+	case ':':
+		if (p[1] == '-') {
+			op->kind = PARAM_DEFAULT;
+			op->word = strdup(p + 2);
+			DIE(op->word == NULL, "Error allocating expansion.");
+		} else {
+			op->kind = PARAM_SUBSTRING;
+			parse_substring(op, p + 1);
+		}
+		break;
+	case '#':
+	case '%':
+		op->kind = *p == '#' ? PARAM_STRIP_PREFIX : PARAM_STRIP_SUFFIX;
+		op->longest = p[1] == *p;
+		op->pattern = glob_compile(p + 1 + op->longest);
+		break;
+	case '/':
+		op->kind = PARAM_REPLACE;
+		parse_replace(op, p + 1);
+		break;
+	default:
+		op->kind = PARAM_INVALID;
+		break;
+	}
+
+	return op;
+}
+
+static void param_op_free(struct param_op *op)
+{
+	if (op == NULL)
+		return;
+
+	glob_free(op->pattern);
+	free(op->spec);
+	free(op->name);
+	free(op->word);
+	free(op);
+}
+
+static struct param_op *param_op_lookup(const char *spec)
+{
+	unsigned int slot = hash_spec(spec) % PARAM_CACHE_SIZE;
+	struct param_op *op = param_cache[slot];
+
+	if (op != NULL && !strcmp(op->spec, spec))
+		return op;
+
+	// A nested expression must not free one still being expanded: it
+	// then only takes a free slot, and is freed after use otherwise
+	if (op != NULL && param_depth > 1)
+		return param_op_parse(spec);
+
+	// Miss: the new expression evicts whatever shared the slot
+	param_op_free(op);
+	op = param_op_parse(spec);
+	param_cache[slot] = op;
+
+	return op;
+}
+
+const char *expand_dollar(const char *p, struct word_buf *out)
+{
+	const char *start = p + 1;
+	bool braces = p[1] == '{';
+	int depth = 0;
+
+	if (!braces && !is_name_char(p[1])) {
+		word_buf_append(out, p, 1);
+		return p + 1;
+	}
+
+	if (braces) {
+		for (p += 2; *p != '\0'; p++) {
+			if (*p == '{')
+				depth++;
+			else if (*p == '}' && depth-- == 0)
+				break;
+		}
+		start++;
+	} else {
+		for (p++; is_name_char(*p); p++)
+			;
+	}
+
+	char *spec = dup_range(start, p - start);
+
+	expand_param(spec, out);
+	free(spec);
+
+	return braces && *p == '}' ? p + 1 : p;
+}
+
+/**
+ * Expand the '$name' and '${...}' expressions in a default value or a
+ * replacement, the way get_word expands those of a command word.
+ */
+static void expand_text(const char *text, struct word_buf *out)
+{
+	const char *p = text;
+
+	while (*p != '\0') {
+		if (*p == '$') {
+			p = expand_dollar(p, out);
+			continue;
+		}
+
+		word_buf_append(out, p, 1);
+		p++;
+	}
+}
+
+static void expand_replace(const struct param_op *op, const char *value,
+		size_t len, struct word_buf *out)
+{
+	struct word_buf rep = { NULL, 0, 0 };
+	size_t i = 0;
+
+	word_buf_append(&rep, "", 0);
+	expand_text(op->word, &rep);
+
+	if (op->pattern->ntoks == 0) {
+		word_buf_append(out, value, len);
+		free(rep.data);
+		return;
+	}
+
+	if (op->anchor == ANCHOR_END) {
+		size_t n = glob_match_suffix(op->pattern, value, len, true);
+
+		if (n == GLOB_NO_MATCH) {
+			word_buf_append(out, value, len);
+		} else {
+			word_buf_append(out, value, len - n);
+			word_buf_append(out, rep.data, rep.len);
+		}
+		free(rep.data);
+		return;
+	}
+
+	while (i < len) {
+		size_t n = glob_match_prefix(op->pattern, value + i, len - i,
+				true);
+
+		if (n == GLOB_NO_MATCH || (n == 0 && i < len)) {
+			if (op->anchor == ANCHOR_START)
+				break;
+
+			word_buf_append(out, value + i, 1);
+			i++;
+			continue;
+		}
+
+		word_buf_append(out, rep.data, rep.len);
+		i += n;
+
+		if (!op->all)
+			break;
+	}
+
+	word_buf_append(out, value + i, len - i);
+	free(rep.data);
+}
+
+static void expand_substring(const struct param_op *op, const char *value,
+		size_t len, struct word_buf *out)
+{
+	long slen = (long)len;
+	long start = op->offset < 0 ? slen + op->offset : op->offset;
+	long end = slen;
+
+	if (start < 0 || start > slen)
+		return;
+
+	if (op->has_length)
+		end = op->length < 0 ? slen + op->length : start + op->length;
+
+	if (end > slen)
+		end = slen;
+
+	if (end > start)
+		word_buf_append(out, value + start, end - start);
+}
+
+/**
+ * Fetch the value the expression operates on. Whole arrays are joined with
+ * spaces into tmp.
+ */
+static const char *param_value(const struct param_op *op,
+		struct word_buf *tmp)
+{
+	if (op->kind == PARAM_INVALID)
+		return NULL;
+
+	if (!op->subscript)
+		return getenv(op->name);
+
+	if (!op->all_elements)
+		return vars_array_get(op->name, op->index);
+
+	int n = vars_array_size(op->name);
+
+	for (int i = 0; i < n; i++) {
+		const char *v = vars_array_get(op->name, i);
+
+		if (i > 0)
+			word_buf_append(tmp, " ", 1);
+		word_buf_append(tmp, v, strlen(v));
+	}
+
+	return tmp->data;
+}
+
+void expand_param(const char *spec, struct word_buf *out)
+{
+	struct word_buf tmp = { NULL, 0, 0 };
+	const char *value;
+	size_t len, n;
+	char num[32];
+
+	// Plain names skip the cache entirely
+	const char *p = spec;
+
+	while (is_name_char(*p))
+		p++;
+
+	if (*p == '\0' && p != spec) {
+		value = getenv(spec);
+		if (value != NULL)
+			word_buf_append(out, value, strlen(value));
+		return;
+	}
+
+	param_depth++;
+
+	struct param_op *op = param_op_lookup(spec);
+
+	value = param_value(op, &tmp);
+
+	/* Unset variables expand like empty ones. */
+	if (value == NULL)
+		value = "";
+	len = strlen(value);
+
+	switch (op->kind) {
+	case PARAM_VALUE:
+		word_buf_append(out, value, len);
+		break;
+	case PARAM_LENGTH:
+		if (op->all_elements)
+			len = vars_array_size(op->name) < 0 ? 0
+				: vars_array_size(op->name);
+		n = snprintf(num, sizeof(num), "%zu", len);
+		word_buf_append(out, num, n);
+		break;
+	case PARAM_DEFAULT:
+		if (len == 0)
+			expand_text(op->word, out);
+		else
+			word_buf_append(out, value, len);
+		break;
+	case PARAM_STRIP_PREFIX:
+		n = glob_match_prefix(op->pattern, value, len, op->longest);
+		if (n == GLOB_NO_MATCH)
+			n = 0;
+		word_buf_append(out, value + n, len - n);
+		break;
+	case PARAM_STRIP_SUFFIX:
+		n = glob_match_suffix(op->pattern, value, len, op->longest);
+		if (n == GLOB_NO_MATCH)
+			n = 0;
+		word_buf_append(out, value, len - n);
+		break;
+	case PARAM_REPLACE:
+		expand_replace(op, value, len, out);
+		break;
+	case PARAM_SUBSTRING:
+		expand_substring(op, value, len, out);
+		break;
+	default:
+		fprintf(stderr, "Bad substitution: ${%s}\n", spec);
+		break;
+	}
+
+	if (param_cache[hash_spec(spec) % PARAM_CACHE_SIZE] != op)
+		param_op_free(op);
+	param_depth--;
+	free(tmp.data);
+}
+
+word_t *expand_quoted(word_t *s, struct word_buf *out)
+{
+	struct word_buf spec = { NULL, 0, 0 };
+	word_t *w = s->next_part;
+	int depth = 0;
+
+	if (w == NULL || w->expand || w->string[0] != '{') {
+		word_buf_append(out, "$", 1);
+		return w;
+	}
+
+	word_buf_append(&spec, "", 0);
+
+	// Put the text back together up to the matching '}', so that the
+	// spec is the one the unquoted form gets
+	for (; w != NULL; w = w->next_part) {
+		if (w->expand) {
+			word_buf_append(&spec, "$", 1);
+			word_buf_append(&spec, w->string, strlen(w->string));
+			continue;
+		}
+
+		const char *c = w->string + (w == s->next_part);
+
+		for (; *c != '\0'; c++) {
+			if (*c == '{')
+				depth++;
+			else if (*c == '}' && depth-- == 0)
+				break;
+
+			word_buf_append(&spec, c, 1);
+		}
+
+		if (*c == '}') {
+			expand_param(spec.data, out);
+			word_buf_append(out, c + 1, strlen(c + 1));
+			free(spec.data);
+			return w->next_part;
+		}
+	}
+
+	// Unterminated, which the parser also lets through unquoted
+	expand_param(spec.data, out);
+	free(spec.data);
+
+	return NULL;
+}
@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _EXPAND_H
+#define _EXPAND_H
+
+#include "utils.h"
+
+/**
+ * Expand the parameter described by spec (the text of a '$name' or '${...}'
+ * word part) and append the result to out. Besides plain names, spec may be:
+ *
+ *   #name             length of the value
+ *   name:-word        value, or word if unset or empty
+ *   name#pat          remove shortest matching prefix ('##' for longest)
+ *   name%pat          remove shortest matching suffix ('%%' for longest)
+ *   name/pat/rep      replace first match ('//' for all, '/#' and '/%'
+ *                     anchor the pattern at the start or end)
+ *   name:off[:len]    substring (negative offsets count from the end)
+ *
+ * The word of a default value and the replacement 'rep' are expanded in
+ * turn, and only when used, so they may hold '$name' and '${...}'; the
+ * patterns are taken literally.
+ *
+ * 'name' may also be an array element 'name[i]' or a whole array
+ * 'name[@]' (elements joined by spaces); '${#name[@]}' is the element count.
+ *
+ * Parsed specs and their compiled patterns are cached, so a word repeated
+ * in a loop or pipeline is only compiled once.
+ */
+void expand_param(const char *spec, struct word_buf *out);
+
+/**
+ * Expand the '$name' or '${...}' expression at p, in some text, and append
+ * its value to out; a '$' starting neither is appended as is.
+ *
+ * @return the position right after the expression
+ */
+const char *expand_dollar(const char *p, struct word_buf *out);
+
+/**
+ * Expand the word part s, an expansion with an empty spec, and what
+ * follows it if needed, appending the result to out.
+ *
+ * Inside double quotes the parser only takes a name after '$': "${x:-y}"
+ * comes as an empty expansion followed by the text "{x:-y}", and a '$'
+ * followed by no name (as in "$" or "a $ b") as an empty expansion. The
+ * first is expanded as the spec between the braces, exactly like its
+ * unquoted form; the second is a literal '$'.
+ *
+ * @return the first part left to expand
+ */
+word_t *expand_quoted(word_t *s, struct word_buf *out);
+
+#endif /* _EXPAND_H */
@@ -0,0 +1,390 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <sys/mman.h>
+#include <sys/types.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fair.h"
+
+// Virtual time a session of weight 1 spends per slot
+#define FAIR_SCALE		1000000
+
+struct fair_session {
+	pid_t id;		/* 0 for a free entry */
+	bool batch;
+	int weight;
+	int running;
+	int waiting;
+	uint64_t vtime;
+
+	uint64_t grants;
+	int64_t wait_ns;
+	int64_t max_wait_ns;
+};
+
+/**
+ * A slot held, or waited for, by a process.
+ */
+struct fair_slot {
+	pid_t holder;		/* 0 for a free entry */
+	int session;
+	bool waiting;
+};
+
+/**
+ * Everything in memory shared by the shell and all its children.
+ */
+struct fair_state {
+	pthread_mutex_t lock;
+	pthread_cond_t freed;
+
+	int used;		/* slots held, not waited for */
+	struct fair_slot slots[FAIR_MAX_SLOTS];
+	struct fair_session sessions[FAIR_MAX_SESSIONS];
+};
+
+static struct fair_state *state;
+static pid_t session_id;
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void fair_init(void)
+{
+	pthread_mutexattr_t mattr;
+	pthread_condattr_t cattr;
+
+	state = mmap(NULL, sizeof(*state), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (state == MAP_FAILED) {
+		state = NULL;
+		return;
+	}
+
+	// Robust, so that a process killed while holding it does not wedge
+	// the others
+	pthread_mutexattr_init(&mattr);
+	pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
+	pthread_mutex_init(&state->lock, &mattr);
+	pthread_mutexattr_destroy(&mattr);
+
+	pthread_condattr_init(&cattr);
+	pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+	pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+	pthread_cond_init(&state->freed, &cattr);
+	pthread_condattr_destroy(&cattr);
+
+	session_id = getpid();
+}
+
+void fair_session_start(void)
+{
+	session_id = getpid();
+}
+
+static int fair_cap(void)
+{
+	const char *value = getenv("MINISHELL_SLOTS");
+	long cap = value != NULL ? strtol(value, NULL, 10) : 0;
+
+	if (state == NULL || cap <= 0)
+		return 0;
+
+	return cap < FAIR_MAX_SLOTS ? cap : FAIR_MAX_SLOTS;
+}
+
+static void fair_lock(void)
+{
+	if (pthread_mutex_lock(&state->lock) == EOWNERDEAD)
+		pthread_mutex_consistent(&state->lock);
+}
+
+static bool alive(pid_t pid)
+{
+	return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+static void fair_drop(struct fair_slot *slot)
+{
+	struct fair_session *s = &state->sessions[slot->session];
+
+	if (slot->waiting) {
+		s->waiting--;
+	} else {
+		s->running--;
+		state->used--;
+	}
+
+	slot->holder = 0;
+}
+
+/**
+ * Take back the slots of processes that died holding or waiting for them,
+ * and forget sessions that ended.
+ */
+static void fair_reclaim(void)
+{
+	for (int i = 0; i < FAIR_MAX_SLOTS; i++) {
+		struct fair_slot *slot = &state->slots[i];
+
+		if (slot->holder != 0 && !alive(slot->holder))
+			fair_drop(slot);
+	}
+
+	for (int i = 0; i < FAIR_MAX_SESSIONS; i++) {
+		struct fair_session *s = &state->sessions[i];
+
+		if (s->id != 0 && s->running == 0 && s->waiting == 0
+				&& !alive(s->id))
+			s->id = 0;
+	}
+}
+
+/**
+ * Return the lowest virtual time of the sessions that are busy.
+ */
+static uint64_t fair_vclock(void)
+{
+	uint64_t min = UINT64_MAX;
+
+	for (int i = 0; i < FAIR_MAX_SESSIONS; i++) {
+		const struct fair_session *s = &state->sessions[i];
+
+		if (s->id != 0 && s->running + s->waiting > 0 && s->vtime < min)
+			min = s->vtime;
+	}
+
+	return min == UINT64_MAX ? 0 : min;
+}
+
+/**
+ * Return the index of the calling session, registering it if needed.
+ */
+static int fair_session(void)
+{
+	int free_entry = -1;
+
+	for (int pass = 0; pass < 2; pass++) {
+		for (int i = 0; i < FAIR_MAX_SESSIONS; i++) {
+			if (state->sessions[i].id == session_id)
+				return i;
+			if (free_entry < 0 && state->sessions[i].id == 0)
+				free_entry = i;
+		}
+
+		if (free_entry >= 0)
+			break;
+		fair_reclaim();
+	}
+
+	if (free_entry < 0)
+		return -1;
+
+	struct fair_session *s = &state->sessions[free_entry];
+
+	memset(s, 0, sizeof(*s));
+	s->id = session_id;
+
+	return free_entry;
+}
+
+/**
+ * Update the class and weight of a session that is about to wait, and
+ * keep an idle one from starting behind the others' virtual time.
+ */
+static void fair_classify(struct fair_session *s)
+{
+	const char *class = getenv("MINISHELL_CLASS");
+	const char *weight = getenv("MINISHELL_WEIGHT");
+
+	if (s->running + s->waiting == 0) {
+		uint64_t vclock = fair_vclock();
+
+		if (s->vtime < vclock)
+			s->vtime = vclock;
+	}
+
+	s->waiting++;
+
+	if (class != NULL && *class != '\0')
+		s->batch = !strcmp(class, "batch");
+	else
+		s->batch = s->running + s->waiting > FAIR_INTERACTIVE_MAX;
+
+	s->weight = weight != NULL ? atoi(weight) : 1;
+	if (s->weight <= 0)
+		s->weight = 1;
+}
+
+/**
+ * Return the session the next free slot goes to.
+ */
+static int fair_next(void)
+{
+	int best = -1;
+
+	for (int i = 0; i < FAIR_MAX_SESSIONS; i++) {
+		const struct fair_session *s = &state->sessions[i];
+
+		if (s->id == 0 || s->waiting == 0)
+			continue;
+
+		if (best < 0) {
+			best = i;
+			continue;
+		}
+
+		const struct fair_session *b = &state->sessions[best];
+
+		if (s->batch != b->batch ? !s->batch : s->vtime < b->vtime)
+			best = i;
+	}
+
+	return best;
+}
+
+int fair_acquire(int timeout_ms)
+{
+	int cap = fair_cap();
+
+	if (cap == 0)
+		return -1;
+
+	fair_lock();
+
+	int idx = fair_session();
+
+	int slot = 0;
+
+	while (slot < FAIR_MAX_SLOTS && state->slots[slot].holder != 0)
+		slot++;
+
+	if (idx < 0 || slot == FAIR_MAX_SLOTS) {
+		// Too many to keep track of; not capped
+		pthread_mutex_unlock(&state->lock);
+		return -1;
+	}
+
+	struct fair_session *s = &state->sessions[idx];
+	int64_t start = now_ns();
+	int64_t deadline = start + timeout_ms * 1000000LL;
+
+	// Waiting is recorded too, in case the waiter is killed
+	state->slots[slot].holder = getpid();
+	state->slots[slot].session = idx;
+	state->slots[slot].waiting = true;
+	fair_classify(s);
+
+	while (state->used >= cap || fair_next() != idx) {
+		struct timespec until;
+		int64_t at = now_ns() + FAIR_RECHECK_MS * 1000000LL;
+
+		if (timeout_ms >= 0 && now_ns() >= deadline) {
+			fair_drop(&state->slots[slot]);
+			pthread_cond_broadcast(&state->freed);
+			pthread_mutex_unlock(&state->lock);
+			return FAIR_BUSY;
+		}
+
+		if (timeout_ms >= 0 && at > deadline)
+			at = deadline;
+
+		until.tv_sec = at / 1000000000;
+		until.tv_nsec = at % 1000000000;
+
+		int ret = pthread_cond_timedwait(&state->freed, &state->lock,
+				&until);
+
+		// Timing out now and then notices holders that died
+		if (ret == EOWNERDEAD)
+			pthread_mutex_consistent(&state->lock);
+		else if (ret == ETIMEDOUT)
+			fair_reclaim();
+	}
+
+	state->slots[slot].waiting = false;
+	state->used++;
+
+	int64_t waited = now_ns() - start;
+
+	s->waiting--;
+	s->running++;
+	s->vtime += FAIR_SCALE / s->weight;
+	s->grants++;
+	s->wait_ns += waited;
+	if (waited > s->max_wait_ns)
+		s->max_wait_ns = waited;
+
+	// The next in line may be another waiter
+	pthread_cond_broadcast(&state->freed);
+	pthread_mutex_unlock(&state->lock);
+
+	return slot;
+}
+
+void fair_release(int slot)
+{
+	if (slot < 0 || state == NULL)
+		return;
+
+	fair_lock();
+
+	if (state->slots[slot].holder != 0)
+		fair_drop(&state->slots[slot]);
+
+	pthread_cond_broadcast(&state->freed);
+	pthread_mutex_unlock(&state->lock);
+}
+
+int fair_stat(int argc, char **argv)
+{
+	int cap = fair_cap();
+
+	if (cap == 0) {
+		printf("no slot cap (MINISHELL_SLOTS is not set)\n");
+		return 0;
+	}
+
+	fair_lock();
+	fair_reclaim();
+
+	printf("slots: %d of %d in use\n", state->used, cap);
+	printf("%8s %-11s %6s %7s %7s %8s %10s %10s\n", "SESSION", "CLASS",
+			"WEIGHT", "RUNNING", "WAITING", "GRANTS", "AVG_WAIT",
+			"MAX_WAIT");
+
+	for (int i = 0; i < FAIR_MAX_SESSIONS; i++) {
+		const struct fair_session *s = &state->sessions[i];
+
+		if (s->id == 0)
+			continue;
+
+		printf("%8d %-11s %6d %7d %7d %8llu %9.3fs %9.3fs\n", s->id,
+				s->batch ? "batch" : "interactive", s->weight,
+				s->running, s->waiting,
+				(unsigned long long)s->grants,
+				s->grants ? s->wait_ns / 1e9 / s->grants : 0,
+				s->max_wait_ns / 1e9);
+	}
+
+	pthread_mutex_unlock(&state->lock);
+
+	return 0;
+}
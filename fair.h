@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _FAIR_H
+#define _FAIR_H
+
+#define FAIR_MAX_SESSIONS	256
+#define FAIR_MAX_SLOTS		1024
+#define FAIR_INTERACTIVE_MAX	4
+#define FAIR_RECHECK_MS		100
+
+#define FAIR_BUSY		(-2)
+
+/*
+ * Fair sharing of a concurrency cap between the sessions of a server (see
+ * ms_serve()) and the commands of each session.
+ *
+ * With MINISHELL_SLOTS=N, at most N commands run at a time across the
+ * shell and everything forked from it, sessions included. Each command a
+ * shell launches (external commands, parmap runs) first takes a slot;
+ * subshells that only fork again, and the commands of a pipeline, which
+ * must all run at once, do not.
+ *
+ * A freed slot goes to the waiting session of the highest class with the
+ * lowest virtual time: interactive sessions come before batch ones, and a
+ * session's virtual time grows by 1/WEIGHT per slot it gets, so sessions
+ * of a class share the slots in proportion to their weights. A session
+ * that was idle starts from the lowest virtual time of the others, so it
+ * cannot save up credit. A session is batch if MINISHELL_CLASS=batch, or,
+ * without MINISHELL_CLASS, while it has more than FAIR_INTERACTIVE_MAX
+ * commands running or waiting; its weight is MINISHELL_WEIGHT (default 1).
+ *
+ * Commands that wait for each other outside of a pipeline (e.g. through a
+ * FIFO) can deadlock when N is too small for all of them.
+ */
+
+/**
+ * Map the state shared with the children; called once, at startup.
+ */
+void fair_init(void);
+
+/**
+ * Make the calling process (and what it forks) a session of its own.
+ */
+void fair_session_start(void);
+
+/**
+ * Wait for a slot, if MINISHELL_SLOTS is set, for up to timeout_ms (-1
+ * for as long as it takes).
+ *
+ * @return the slot, -1 if there is no cap, or FAIR_BUSY if none was free
+ * in time
+ */
+int fair_acquire(int timeout_ms);
+
+/**
+ * Give back a slot returned by fair_acquire(); -1 is ignored.
+ */
+void fair_release(int slot);
+
+/**
+ * fairstat: print the slots in use and, per session, the commands running
+ * and waiting (the queue depth), the slots granted and the time waited.
+ */
+int fair_stat(int argc, char **argv);
+
+#endif /* _FAIR_H */
@@ -0,0 +1,491 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "glob.h"
+#include "utils.h"
+
+#define BITS_PER_WORD	64
+
+static inline void set_bit(unsigned char *set, unsigned char c)
+{
+	set[c >> 3] |= 1 << (c & 7);
+}
+
+static inline bool has_bit(const unsigned char *set, unsigned char c)
+{
+	return set[c >> 3] & (1 << (c & 7));
+}
+
+/**
+ * Parse a bracket expression starting right after '['.
+ *
+ * @return the number of pattern bytes consumed (including the closing ']'),
+ * or 0 if the bracket is not terminated and must be taken literally
+ */
+static size_t parse_class(const char *p, unsigned char *set)
+{
+	const char *start = p;
+	bool negate = false;
+
+	if (*p == '!' || *p == '^') {
+		negate = true;
+		p++;
+	}
+
+	// A ']' right after the opening bracket is a literal member
+	bool first = true;
+
+	memset(set, 0, 32);
+	while (*p != '\0' && (*p != ']' || first)) {
+		unsigned char lo = *p, hi;
+
+		if (lo == '\\' && p[1] != '\0')
+			lo = *++p;
+		p++;
+		hi = lo;
+
+		if (p[0] == '-' && p[1] != '\0' && p[1] != ']') {
+			hi = p[1];
+			p += 2;
+		}
+
+		for (unsigned int c = lo; c <= hi; c++)
+			set_bit(set, c);
+
+		first = false;
+	}
+
+	if (*p != ']')
+		return 0;
+
+	if (negate)
+		for (int i = 0; i < 32; i++)
+			set[i] = ~set[i];
+
+	return p - start + 1;
+}
+
+struct glob *glob_compile(const char *pattern)
+{
+	struct glob *g = calloc(1, sizeof(*g));
+
+	DIE(g == NULL, "Error allocating glob.");
+
+	// Every pattern byte yields at most one token
+	g->toks = calloc(strlen(pattern) + 1, sizeof(*g->toks));
+	DIE(g->toks == NULL, "Error allocating glob tokens.");
+
+	for (const char *p = pattern; *p != '\0'; p++) {
+		struct glob_tok *t = &g->toks[g->ntoks];
+		struct glob_tok *prev = g->ntoks ? t - 1 : NULL;
+		size_t used;
+
+		t->kind = GLOB_SET;
+
+		switch (*p) {
+		case '*':
+			// Consecutive stars are equivalent to a single one
+			if (prev != NULL && prev->kind == GLOB_STAR)
+				continue;
+			t->kind = GLOB_STAR;
+			break;
+		case '?':
+			memset(t->set, 0xff, sizeof(t->set));
+			break;
+		case '[':
+			used = parse_class(p + 1, t->set);
+			if (used == 0)
+				set_bit(t->set, '[');
+			p += used;
+			break;
+		case '\\':
+			if (p[1] != '\0')
+				p++;
+			/* fallthrough */
+		default:
+			set_bit(t->set, *p);
+			break;
+		}
+
+		g->ntoks++;
+	}
+
+	return g;
+}
+
+void glob_free(struct glob *g)
+{
+	if (g == NULL)
+		return;
+
+	free(g->toks);
+	free(g);
+}
+
+/*
+ * The matcher runs the position automaton of the pattern: state i means
+ * "the first i tokens matched". Walking the tokens back to front gives the
+ * automaton of the reversed pattern, used for suffix matches.
+ */
+struct glob_run {
+	const struct glob *g;
+	bool reverse;
+	int nwords;
+	uint64_t *cur;
+	uint64_t *next;
+};
+
+static inline const struct glob_tok *run_tok(const struct glob_run *r, int i)
+{
+	return &r->g->toks[r->reverse ? r->g->ntoks - 1 - i : i];
+}
+
+static inline bool run_has(const uint64_t *s, int i)
+{
+	return s[i / BITS_PER_WORD] & (1ULL << (i % BITS_PER_WORD));
+}
+
+static inline void run_add(uint64_t *s, int i)
+{
+	s[i / BITS_PER_WORD] |= 1ULL << (i % BITS_PER_WORD);
+}
+
+/* A star may match the empty string, so it also enables the next state. */
+static void run_close(struct glob_run *r, uint64_t *s)
+{
+	for (int i = 0; i < r->g->ntoks; i++)
+		if (run_has(s, i) && run_tok(r, i)->kind == GLOB_STAR)
+			run_add(s, i + 1);
+}
+
+static void run_init(struct glob_run *r, const struct glob *g, bool reverse)
+{
+	r->g = g;
+	r->reverse = reverse;
+	r->nwords = (g->ntoks + 1 + BITS_PER_WORD - 1) / BITS_PER_WORD;
+	r->cur = calloc(2 * r->nwords, sizeof(uint64_t));
+	DIE(r->cur == NULL, "Error allocating glob state.");
+	r->next = r->cur + r->nwords;
+
+	run_add(r->cur, 0);
+	run_close(r, r->cur);
+}
+
+/**
+ * Advance the automaton over one character.
+ *
+ * @return false if no state is alive anymore
+ */
+static bool run_step(struct glob_run *r, unsigned char c)
+{
+	bool alive = false;
+
+	memset(r->next, 0, r->nwords * sizeof(uint64_t));
+
+	for (int i = 0; i < r->g->ntoks; i++) {
+		if (!run_has(r->cur, i))
+			continue;
+
+		const struct glob_tok *t = run_tok(r, i);
+
+		if (t->kind == GLOB_STAR)
+			run_add(r->next, i);
+		else if (has_bit(t->set, c))
+			run_add(r->next, i + 1);
+		else
+			continue;
+
+		alive = true;
+	}
+
+	run_close(r, r->next);
+
+	uint64_t *tmp = r->cur;
+
+	r->cur = r->next;
+	r->next = tmp;
+
+	return alive;
+}
+
+static inline bool run_accepts(const struct glob_run *r)
+{
+	return run_has(r->cur, r->g->ntoks);
+}
+
+static void run_destroy(struct glob_run *r)
+{
+	free(r->cur < r->next ? r->cur : r->next);
+}
+
+/**
+ * Feed len characters of s (from the back if reverse) to the automaton and
+ * return the shortest or longest accepted length.
+ */
+static size_t glob_run_affix(const struct glob *g, const char *s, size_t len,
+		bool longest, bool reverse)
+{
+	struct glob_run r;
+	size_t found = GLOB_NO_MATCH;
+
+	run_init(&r, g, reverse);
+
+	for (size_t i = 0; ; i++) {
+		if (run_accepts(&r)) {
+			found = i;
+			if (!longest)
+				break;
+		}
+
+		if (i == len)
+			break;
+
+		unsigned char c = reverse ? s[len - 1 - i] : s[i];
+
+		if (!run_step(&r, c))
+			break;
+	}
+
+	run_destroy(&r);
+
+	return found;
+}
+
+bool glob_match(const struct glob *g, const char *s, size_t len)
+{
+	return glob_run_affix(g, s, len, true, false) == len;
+}
+
+size_t glob_match_prefix(const struct glob *g, const char *s, size_t len,
+		bool longest)
+{
+	return glob_run_affix(g, s, len, longest, false);
+}
+
+size_t glob_match_suffix(const struct glob *g, const char *s, size_t len,
+		bool longest)
+{
+	return glob_run_affix(g, s, len, longest, true);
+}
+
+/*
+ * Combined DFA. Positions of all the patterns are laid out one after the
+ * other: a pattern with n tokens owns n + 1 positions, the last of which is
+ * its accepting position. A DFA state is a set of positions.
+ */
+struct dfa_state {
+	uint64_t *bits;
+	int accept;		/* lowest arm accepted here, -1 if none */
+	int next[256];		/* -1 until computed */
+};
+
+struct glob_set {
+	int npos;
+	int nwords;
+	const struct glob_tok **pos_tok;	/* NULL if accepting */
+	int *pos_arm;
+
+	struct dfa_state *states;
+	int nstates;
+	int size;
+
+	int *table;		/* open addressing: state index + 1, or 0 */
+	int table_size;
+};
+
+#define DFA_DEAD	0
+
+static unsigned int dfa_hash(const uint64_t *bits, int nwords)
+{
+	uint64_t h = 1469598103934665603ULL;
+
+	for (int i = 0; i < nwords; i++) {
+		h ^= bits[i];
+		h *= 1099511628211ULL;
+	}
+
+	return (unsigned int)(h ^ (h >> 32));
+}
+
+static void dfa_close(const struct glob_set *set, uint64_t *bits)
+{
+	for (int i = 0; i < set->npos; i++)
+		if (run_has(bits, i) && set->pos_tok[i] != NULL
+				&& set->pos_tok[i]->kind == GLOB_STAR)
+			run_add(bits, i + 1);
+}
+
+static void dfa_rehash(struct glob_set *set)
+{
+	free(set->table);
+	set->table_size = set->table_size ? 2 * set->table_size : 64;
+	set->table = calloc(set->table_size, sizeof(int));
+	DIE(set->table == NULL, "Error allocating glob set.");
+
+	for (int i = 0; i < set->nstates; i++) {
+		unsigned int h = dfa_hash(set->states[i].bits, set->nwords);
+
+		while (set->table[h % set->table_size] != 0)
+			h++;
+		set->table[h % set->table_size] = i + 1;
+	}
+}
+
+/**
+ * Return the index of the state with the given position set, adding it if
+ * needed. Takes ownership of bits.
+ */
+static int dfa_intern(struct glob_set *set, uint64_t *bits)
+{
+	unsigned int h = dfa_hash(bits, set->nwords);
+
+	for (;; h++) {
+		int idx = set->table[h % set->table_size];
+
+		if (idx == 0)
+			break;
+
+		if (!memcmp(set->states[idx - 1].bits, bits,
+				set->nwords * sizeof(uint64_t))) {
+			free(bits);
+			return idx - 1;
+		}
+	}
+
+	if (set->nstates == set->size) {
+		set->size = set->size ? 2 * set->size : 16;
+		set->states = realloc(set->states,
+				set->size * sizeof(*set->states));
+		DIE(set->states == NULL, "Error allocating glob set.");
+	}
+
+	struct dfa_state *st = &set->states[set->nstates];
+
+	st->bits = bits;
+	st->accept = -1;
+	memset(st->next, -1, sizeof(st->next));
+
+	for (int i = 0; i < set->npos; i++) {
+		if (!run_has(bits, i) || set->pos_tok[i] != NULL)
+			continue;
+
+		if (st->accept < 0 || set->pos_arm[i] < st->accept)
+			st->accept = set->pos_arm[i];
+	}
+
+	set->nstates++;
+	if (2 * set->nstates > set->table_size)
+		dfa_rehash(set);
+	else
+		set->table[h % set->table_size] = set->nstates;
+
+	return set->nstates - 1;
+}
+
+static int dfa_next(struct glob_set *set, int state, unsigned char c)
+{
+	if (set->states[state].next[c] >= 0)
+		return set->states[state].next[c];
+
+	uint64_t *bits = calloc(set->nwords, sizeof(uint64_t));
+
+	DIE(bits == NULL, "Error allocating glob set.");
+
+	// states may move while interning, so only hold on to indices
+	const uint64_t *cur = set->states[state].bits;
+
+	for (int i = 0; i < set->npos; i++) {
+		const struct glob_tok *t = set->pos_tok[i];
+
+		if (!run_has(cur, i) || t == NULL)
+			continue;
+
+		if (t->kind == GLOB_STAR)
+			run_add(bits, i);
+		else if (has_bit(t->set, c))
+			run_add(bits, i + 1);
+	}
+	dfa_close(set, bits);
+
+	int next = dfa_intern(set, bits);
+
+	set->states[state].next[c] = next;
+
+	return next;
+}
+
+struct glob_set *glob_set_compile(struct glob * const *globs, const int *arms,
+		int n)
+{
+	struct glob_set *set = calloc(1, sizeof(*set));
+
+	DIE(set == NULL, "Error allocating glob set.");
+
+	for (int i = 0; i < n; i++)
+		set->npos += globs[i]->ntoks + 1;
+	set->nwords = (set->npos + BITS_PER_WORD - 1) / BITS_PER_WORD;
+	if (set->nwords == 0)
+		set->nwords = 1;
+
+	set->pos_tok = calloc(set->npos + 1, sizeof(*set->pos_tok));
+	set->pos_arm = calloc(set->npos + 1, sizeof(*set->pos_arm));
+	DIE(set->pos_tok == NULL || set->pos_arm == NULL,
+			"Error allocating glob set.");
+
+	uint64_t *dead = calloc(set->nwords, sizeof(uint64_t));
+	uint64_t *start = calloc(set->nwords, sizeof(uint64_t));
+
+	DIE(dead == NULL || start == NULL, "Error allocating glob set.");
+
+	for (int i = 0, pos = 0; i < n; i++) {
+		run_add(start, pos);
+		for (int t = 0; t < globs[i]->ntoks; t++)
+			set->pos_tok[pos++] = &globs[i]->toks[t];
+		set->pos_arm[pos++] = arms[i];
+	}
+	dfa_close(set, start);
+
+	dfa_rehash(set);
+	dfa_intern(set, dead);		/* DFA_DEAD */
+	dfa_intern(set, start);
+
+	// Subset construction, breadth first, until the eager budget runs out
+	for (int s = 0; s < set->nstates; s++) {
+		if (set->nstates >= GLOB_SET_EAGER_STATES)
+			break;
+
+		for (int c = 0; c < 256; c++)
+			dfa_next(set, s, c);
+	}
+
+	return set;
+}
+
+void glob_set_free(struct glob_set *set)
+{
+	if (set == NULL)
+		return;
+
+	for (int i = 0; i < set->nstates; i++)
+		free(set->states[i].bits);
+
+	free(set->states);
+	free(set->table);
+	free(set->pos_tok);
+	free(set->pos_arm);
+	free(set);
+}
+
+int glob_set_match(struct glob_set *set, const char *s, size_t len)
+{
+	int state = DFA_DEAD + 1;
+
+	for (size_t i = 0; i < len && state != DFA_DEAD; i++)
+		state = dfa_next(set, state, s[i]);
+
+	return set->states[state].accept;
+}
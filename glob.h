@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _GLOB_H
+#define _GLOB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define GLOB_NO_MATCH		((size_t)-1)
+
+/* Kinds of tokens a glob pattern is compiled to. */
+enum glob_tok_kind {
+	GLOB_SET,	/* one character from 'set' ('c', '?' or '[...]') */
+	GLOB_STAR	/* any run of characters ('*') */
+};
+
+struct glob_tok {
+	enum glob_tok_kind kind;
+	unsigned char set[32];	/* bitmap over the 256 byte values */
+};
+
+/**
+ * A compiled glob pattern. Matching simulates the position automaton
+ * of the pattern, so it never backtracks.
+ */
+struct glob {
+	struct glob_tok *toks;
+	int ntoks;
+};
+
+/**
+ * Compile a shell pattern ('*', '?', '[...]', '\' escapes).
+ */
+struct glob *glob_compile(const char *pattern);
+
+void glob_free(struct glob *g);
+
+/**
+ * Check if the whole string s (of length len) matches the pattern.
+ */
+bool glob_match(const struct glob *g, const char *s, size_t len);
+
+/**
+ * Return the length of the shortest (or longest) prefix of s matching the
+ * pattern, or GLOB_NO_MATCH.
+ */
+size_t glob_match_prefix(const struct glob *g, const char *s, size_t len,
+		bool longest);
+
+/**
+ * Return the length of the shortest (or longest) suffix of s matching the
+ * pattern, or GLOB_NO_MATCH.
+ */
+size_t glob_match_suffix(const struct glob *g, const char *s, size_t len,
+		bool longest);
+
+/**
+ * Several patterns compiled into a single DFA. Each pattern belongs to an
+ * arm; matching a string reports the first arm with a matching pattern in
+ * one pass over the string, however many patterns there are. States are
+ * built by subset construction over the positions of all the patterns,
+ * eagerly up to GLOB_SET_EAGER_STATES and lazily past that.
+ */
+#define GLOB_SET_EAGER_STATES	256
+
+struct glob_set;
+
+/**
+ * Compile n patterns; pattern i belongs to arm arms[i]. The set keeps
+ * pointers into the globs, which must outlive it.
+ */
+struct glob_set *glob_set_compile(struct glob * const *globs, const int *arms,
+		int n);
+
+void glob_set_free(struct glob_set *set);
+
+/**
+ * Return the lowest arm with a pattern matching the whole string, or -1.
+ */
+int glob_set_match(struct glob_set *set, const char *s, size_t len);
+
+#endif /* _GLOB_H */
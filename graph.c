@@ -0,0 +1,423 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "graph.h"
+#include "jobs.h"
+#include "plan.h"
+#include "utils.h"
+
+struct graph_node {
+	char *label;
+	struct plan *plan;
+
+	// Labels after 'after', then the indexes of those nodes
+	char **after;
+	int *deps;
+	int ndeps;
+
+	// Number of nodes on the longest chain starting at this node
+	int priority;
+};
+
+struct graph {
+	struct graph_node *nodes;
+	int n;
+
+	// Node indexes in dependency order
+	int *order;
+};
+
+static inline bool is_blank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char *skip_blank(const char *p)
+{
+	while (is_blank(*p))
+		p++;
+
+	return p;
+}
+
+static inline bool is_label(char c)
+{
+	return isalnum((unsigned char)c) || c == '_' || c == '-' || c == '.';
+}
+
+/**
+ * Check if the line starting at p holds only the word kw.
+ */
+static bool line_is(const char *p, const char *kw)
+{
+	size_t n = strlen(kw);
+
+	p = skip_blank(p);
+	if (strncmp(p, kw, n))
+		return false;
+
+	p = skip_blank(p + n);
+
+	return *p == '\0' || *p == '\n';
+}
+
+static const char *next_line(const char *p)
+{
+	const char *nl = strchr(p, '\n');
+
+	return nl != NULL ? nl + 1 : NULL;
+}
+
+bool graph_is_graph(const char *text)
+{
+	return line_is(text, "graph");
+}
+
+bool graph_incomplete(const char *text)
+{
+	for (const char *p = next_line(text); p != NULL; p = next_line(p))
+		if (line_is(p, "end"))
+			return false;
+
+	return true;
+}
+
+static char *read_label(const char **p)
+{
+	const char *start = *p;
+
+	while (is_label(**p))
+		(*p)++;
+
+	if (*p == start)
+		return NULL;
+
+	char *label = strndup(start, *p - start);
+
+	DIE(label == NULL, "Error allocating graph label.");
+
+	return label;
+}
+
+/**
+ * Parse a 'LABEL [after LABEL...]: COMMAND' line into a new node.
+ */
+static bool graph_add_node(struct graph *g, const char *p, const char *eol)
+{
+	g->nodes = realloc(g->nodes, (g->n + 1) * sizeof(*g->nodes));
+	DIE(g->nodes == NULL, "Error allocating graph node.");
+
+	struct graph_node *node = &g->nodes[g->n++];
+
+	memset(node, 0, sizeof(*node));
+
+	p = skip_blank(p);
+	node->label = read_label(&p);
+	if (node->label == NULL)
+		return false;
+
+	p = skip_blank(p);
+	if (!strncmp(p, "after", 5) && is_blank(p[5])) {
+		for (p = skip_blank(p + 5); *p != ':'; p = skip_blank(p)) {
+			char *label = read_label(&p);
+
+			if (label == NULL)
+				return false;
+
+			node->after = realloc(node->after, (node->ndeps + 1)
+					* sizeof(*node->after));
+			DIE(node->after == NULL, "Error allocating graph.");
+			node->after[node->ndeps++] = label;
+		}
+	}
+
+	if (*p != ':')
+		return false;
+
+	char *command = strndup(p + 1, eol - p - 1);
+
+	DIE(command == NULL, "Error allocating graph node.");
+
+	node->plan = plan_compile(command);
+	free(command);
+
+	return node->plan != NULL;
+}
+
+static int graph_find(const struct graph *g, const char *label)
+{
+	for (int i = 0; i < g->n; i++)
+		if (!strcmp(g->nodes[i].label, label))
+			return i;
+
+	return -1;
+}
+
+/**
+ * Resolve the dependencies, sort the nodes in dependency order (Kahn's
+ * algorithm) and compute their priorities.
+ *
+ * @return false on an unknown or duplicate label, or a cycle
+ */
+static bool graph_link(struct graph *g)
+{
+	int *pending = calloc(g->n, sizeof(*pending));
+	int sorted = 0;
+
+	g->order = calloc(g->n, sizeof(*g->order));
+	DIE(pending == NULL || g->order == NULL, "Error allocating graph.");
+
+	for (int i = 0; i < g->n; i++) {
+		struct graph_node *node = &g->nodes[i];
+
+		if (graph_find(g, node->label) != i)
+			goto error;
+
+		node->deps = calloc(node->ndeps, sizeof(*node->deps));
+		DIE(node->ndeps > 0 && node->deps == NULL,
+				"Error allocating graph.");
+
+		for (int k = 0; k < node->ndeps; k++) {
+			node->deps[k] = graph_find(g, node->after[k]);
+			if (node->deps[k] < 0)
+				goto error;
+		}
+
+		pending[i] = node->ndeps;
+		if (pending[i] == 0)
+			g->order[sorted++] = i;
+	}
+
+	// A node is ready once all its dependencies are in the order
+	for (int done = 0; done < sorted; done++) {
+		int d = g->order[done];
+
+		for (int i = 0; i < g->n; i++) {
+			const struct graph_node *node = &g->nodes[i];
+
+			for (int k = 0; k < node->ndeps; k++)
+				if (node->deps[k] == d && --pending[i] == 0)
+					g->order[sorted++] = i;
+		}
+	}
+
+	if (sorted < g->n)
+		goto error;
+
+	// Dependents come later in the order, so go backwards
+	for (int i = g->n - 1; i >= 0; i--) {
+		struct graph_node *node = &g->nodes[g->order[i]];
+
+		node->priority++;
+		for (int k = 0; k < node->ndeps; k++) {
+			struct graph_node *dep = &g->nodes[node->deps[k]];
+
+			if (dep->priority < node->priority)
+				dep->priority = node->priority;
+		}
+	}
+
+	free(pending);
+
+	return true;
+
+error:
+	free(pending);
+
+	return false;
+}
+
+struct graph *graph_compile(const char *text)
+{
+	struct graph *g = calloc(1, sizeof(*g));
+	const char *p = next_line(text);
+
+	DIE(g == NULL, "Error allocating graph.");
+
+	for (; p != NULL && !line_is(p, "end"); p = next_line(p)) {
+		const char *eol = strchrnul(p, '\n');
+		const char *start = skip_blank(p);
+
+		if (start == eol || *start == '#')
+			continue;
+
+		if (!graph_add_node(g, p, eol))
+			goto syntax_error;
+	}
+
+	// Nothing may follow 'end'
+	for (const char *q = p != NULL ? next_line(p) : NULL; q != NULL;
+			q = next_line(q)) {
+		if (!line_is(q, "")) {
+			p = q;
+			goto syntax_error;
+		}
+	}
+
+	if (p == NULL || !graph_link(g))
+		goto syntax_error;
+
+	return g;
+
+syntax_error:
+	parse_error("invalid graph", (int)((p != NULL ? p : text) - text));
+	graph_free(g);
+
+	return NULL;
+}
+
+static int run_node(void *arg)
+{
+	return plan_run(arg);
+}
+
+/**
+ * Pick the waiting node with the highest priority whose dependencies all
+ * succeeded.
+ *
+ * @return its index, -1 if there is none
+ */
+static int graph_next(const struct graph *g, const struct job *jobs)
+{
+	int best = -1;
+
+	for (int i = 0; i < g->n; i++) {
+		const struct graph_node *node = &g->nodes[i];
+		bool ready = jobs[i].state == JOB_WAITING;
+
+		for (int k = 0; k < node->ndeps && ready; k++)
+			ready = jobs[node->deps[k]].state == JOB_DONE;
+
+		if (!ready)
+			continue;
+
+		if (best < 0 || node->priority > g->nodes[best].priority)
+			best = i;
+	}
+
+	return best;
+}
+
+static bool job_failed(const struct job *j)
+{
+	return j->state == JOB_SKIPPED || (j->state == JOB_DONE && j->status);
+}
+
+/**
+ * Skip the waiting nodes that depend on a failed or skipped node.
+ *
+ * @return the number of nodes skipped
+ */
+static int graph_skip(const struct graph *g, struct job *jobs)
+{
+	int skipped = 0;
+
+	// In dependency order, so that skipping cascades in one pass
+	for (int i = 0; i < g->n; i++) {
+		int idx = g->order[i];
+		const struct graph_node *node = &g->nodes[idx];
+
+		if (jobs[idx].state != JOB_WAITING)
+			continue;
+
+		for (int k = 0; k < node->ndeps; k++) {
+			const struct graph_node *dep = &g->nodes[node->deps[k]];
+
+			if (!job_failed(&jobs[node->deps[k]]))
+				continue;
+
+			fprintf(stderr, "graph: skipping '%s': '%s' failed\n",
+					node->label, dep->label);
+			jobs[idx].state = JOB_SKIPPED;
+			skipped++;
+			break;
+		}
+	}
+
+	return skipped;
+}
+
+int graph_run(struct graph *g)
+{
+	struct job *jobs = calloc(g->n, sizeof(*jobs));
+	int limit = jobs_limit();
+	int running = 0, finished = 0, ret = 0;
+
+	DIE(jobs == NULL, "Error allocating jobs.");
+
+	for (int i = 0; i < g->n; i++) {
+		jobs[i].run = run_node;
+		jobs[i].arg = g->nodes[i].plan;
+		jobs[i].out_fd = -1;
+		jobs[i].err_fd = -1;
+	}
+
+	while (finished < g->n) {
+		int idx;
+
+		finished += graph_skip(g, jobs);
+
+		while (running < limit && (idx = graph_next(g, jobs)) >= 0) {
+			if (job_start(&jobs[idx])) {
+				running++;
+				continue;
+			}
+
+			job_flush(&jobs[idx]);
+			finished++;
+			if (ret == 0)
+				ret = jobs[idx].status;
+		}
+
+		if (running == 0)
+			continue;
+
+		idx = jobs_reap(jobs, g->n);
+		if (idx < 0) {
+			ret = ret != 0 ? ret : EXIT_FAILURE;
+			break;
+		}
+
+		running--;
+		finished++;
+		job_flush(&jobs[idx]);
+
+		if (ret == 0 && jobs[idx].status != 0)
+			ret = jobs[idx].status;
+	}
+
+	// What the jobs lost by a failed wait wrote
+	for (int i = 0; i < g->n; i++)
+		if (jobs[i].out_fd >= 0 || jobs[i].err_fd >= 0)
+			job_flush(&jobs[i]);
+
+	free(jobs);
+
+	return ret;
+}
+
+void graph_free(struct graph *g)
+{
+	if (g == NULL)
+		return;
+
+	for (int i = 0; i < g->n; i++) {
+		struct graph_node *node = &g->nodes[i];
+
+		for (int k = 0; k < node->ndeps; k++)
+			free(node->after[k]);
+
+		free(node->label);
+		free(node->after);
+		free(node->deps);
+		plan_free(node->plan);
+	}
+
+	free(g->nodes);
+	free(g->order);
+	free(g);
+}
@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _GRAPH_H
+#define _GRAPH_H
+
+#include <stdbool.h>
+
+/**
+ * A job graph: commands with explicit dependencies, run as a DAG.
+ *
+ *   graph
+ *   a: cc -c a.c
+ *   b: cc -c b.c
+ *   prog after a b: cc -o prog a.o b.o
+ *   check after a: ./lint a.c
+ *   end
+ *
+ * Each line between 'graph' and 'end' is a node: a label, optionally
+ * 'after' and the labels it depends on, then ':' and a command line.
+ * Blank lines and lines starting with '#' are ignored.
+ *
+ * A node starts as soon as all its dependencies succeeded, up to
+ * jobs_limit() nodes at a time (see jobs.h). Among the nodes ready to
+ * start, the one heading the longest chain of dependents goes first. When
+ * a node fails, everything depending on it is skipped. Each node's output
+ * is written out in one piece when it finishes.
+ */
+struct graph;
+
+/**
+ * Check if the line is the 'graph' keyword alone.
+ */
+bool graph_is_graph(const char *text);
+
+/**
+ * Check if the graph still misses its closing 'end' line.
+ */
+bool graph_incomplete(const char *text);
+
+/**
+ * Compile a graph; labels must be unique and dependencies must exist and
+ * not form a cycle.
+ *
+ * @return the graph, or NULL on a syntax error, which is reported
+ */
+struct graph *graph_compile(const char *text);
+
+/**
+ * Run the graph.
+ *
+ * @return 0 if every node succeeded, the exit status of the first node
+ * that failed otherwise
+ */
+int graph_run(struct graph *g);
+
+void graph_free(struct graph *g);
+
+#endif /* _GRAPH_H */
@@ -0,0 +1,234 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "input.h"
+#include "utils.h"
+
+/*
+ * Block read from a file used for input, one per file so that reading one
+ * (e.g. a sourced script) leaves what is buffered for another (e.g. the
+ * shell's standard input) alone. For a regular file the block is tied to
+ * its offset in the file and to the file's size and modification time, so
+ * it is reused only while it still reflects the file and covers the
+ * current file offset. For anything else it holds the bytes read past the
+ * last record, which nobody else can get back anymore.
+ */
+struct input_cache {
+	char *data;
+	size_t start;
+	size_t end;
+
+	dev_t dev;
+	ino_t ino;
+	bool seekable;
+	off_t offset;		/* file offset of data[0] */
+	off_t size;
+	struct timespec mtime;
+
+	unsigned long used;	/* when it was last attached */
+};
+
+static struct input_cache caches[INPUT_CACHES];
+static unsigned long input_clock;
+
+/**
+ * Pick the cache to give to a file that has none: a free one, else the
+ * least recently used one that can be dropped without losing input, else
+ * the least recently used one.
+ */
+static struct input_cache *input_victim(void)
+{
+	struct input_cache *lru = NULL, *spare = NULL;
+
+	for (int i = 0; i < INPUT_CACHES; i++) {
+		struct input_cache *c = &caches[i];
+
+		if (c->data == NULL)
+			return c;
+
+		if (lru == NULL || c->used < lru->used)
+			lru = c;
+		if ((c->seekable || c->start == c->end)
+				&& (spare == NULL || c->used < spare->used))
+			spare = c;
+	}
+
+	return spare != NULL ? spare : lru;
+}
+
+/**
+ * Find the cache of the file open as fd, making a new one if it has none
+ * or if it is stale.
+ *
+ * @return the cache, or NULL on error
+ */
+static struct input_cache *input_attach(int fd)
+{
+	struct input_cache *c = NULL;
+	struct stat st;
+	off_t pos = -1;
+
+	if (fstat(fd, &st) < 0)
+		return NULL;
+
+	if (S_ISREG(st.st_mode))
+		pos = lseek(fd, 0, SEEK_CUR);
+
+	bool seekable = pos >= 0;
+
+	for (int i = 0; i < INPUT_CACHES && c == NULL; i++)
+		if (caches[i].data != NULL && caches[i].dev == st.st_dev
+				&& caches[i].ino == st.st_ino
+				&& caches[i].seekable == seekable)
+			c = &caches[i];
+
+	bool same = c != NULL;
+
+	if (same && seekable)
+		same = c->size == st.st_size
+			&& c->mtime.tv_sec == st.st_mtim.tv_sec
+			&& c->mtime.tv_nsec == st.st_mtim.tv_nsec
+			&& pos >= c->offset
+			&& pos <= c->offset + (off_t)c->end;
+
+	if (c == NULL)
+		c = input_victim();
+	c->used = ++input_clock;
+
+	if (same) {
+		if (seekable)
+			c->start = pos - c->offset;
+		return c;
+	}
+
+	if (c->data == NULL) {
+		c->data = malloc(INPUT_BLOCK_SIZE);
+		DIE(c->data == NULL, "Error allocating input buffer.");
+	}
+
+	c->start = 0;
+	c->end = 0;
+	c->dev = st.st_dev;
+	c->ino = st.st_ino;
+	c->seekable = seekable;
+	c->offset = seekable ? pos : 0;
+	c->size = st.st_size;
+	c->mtime = st.st_mtim;
+
+	return c;
+}
+
+/**
+ * Replace the (consumed) cached block with the next one.
+ *
+ * @return the number of bytes read, 0 at the end of the input, -1 on error
+ */
+static ssize_t input_fill(struct input_cache *c, int fd)
+{
+	ssize_t n;
+
+	do {
+		if (c->seekable)
+			n = pread(fd, c->data, INPUT_BLOCK_SIZE,
+					c->offset + c->end);
+		else
+			n = read(fd, c->data, INPUT_BLOCK_SIZE);
+	} while (n < 0 && errno == EINTR);
+
+	if (n < 0)
+		return -1;
+
+	c->offset += c->end;
+	c->start = 0;
+	c->end = n;
+
+	return n;
+}
+
+/**
+ * Leave the file offset of a regular file right after what was consumed.
+ */
+static int input_detach(struct input_cache *c, int fd)
+{
+	if (!c->seekable)
+		return 0;
+
+	return lseek(fd, c->offset + c->start, SEEK_SET) < 0 ? -1 : 0;
+}
+
+int input_read_line(int fd, char delim, struct word_buf *line)
+{
+	int ret;
+
+	line->len = 0;
+	word_buf_append(line, "", 0);
+
+	struct input_cache *c = input_attach(fd);
+
+	if (c == NULL)
+		return -1;
+
+	for (;;) {
+		char *base = c->data + c->start;
+		size_t avail = c->end - c->start;
+
+		// memchr() is the vectorized scan of the C library
+		char *found = memchr(base, delim, avail);
+		size_t take = found != NULL ? (size_t)(found - base) : avail;
+
+		word_buf_append(line, base, take);
+		c->start += take;
+
+		if (found != NULL) {
+			c->start++;
+			ret = 1;
+			break;
+		}
+
+		ssize_t n = input_fill(c, fd);
+
+		if (n <= 0) {
+			ret = n == 0 ? 0 : -1;
+			break;
+		}
+	}
+
+	if (input_detach(c, fd) < 0)
+		return -1;
+
+	return ret;
+}
+
+int input_read_all(int fd, struct word_buf *out)
+{
+	struct input_cache *c = input_attach(fd);
+
+	if (c == NULL)
+		return -1;
+
+	word_buf_append(out, c->data + c->start, c->end - c->start);
+	c->start = c->end;
+
+	for (;;) {
+		ssize_t n = input_fill(c, fd);
+
+		if (n < 0)
+			return -1;
+
+		if (n == 0)
+			break;
+
+		word_buf_append(out, c->data, n);
+		c->start = c->end;
+	}
+
+	return input_detach(c, fd);
+}
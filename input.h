@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _INPUT_H
+#define _INPUT_H
+
+#include "utils.h"
+
+#define INPUT_BLOCK_SIZE	(64 * 1024)
+#define INPUT_CACHES		8
+
+/**
+ * Read one delim terminated record (without the delimiter) from fd into
+ * line, which is reset first.
+ *
+ * Input is read in INPUT_BLOCK_SIZE blocks. On a seekable regular file the
+ * unused part of a block is given back with lseek(), so the file offset
+ * ends up right after the record, as if it had been read byte by byte; a
+ * process sharing the file descriptor sees exactly what follows. Other
+ * files (pipes, terminals) cannot be rewound, so what is read past the
+ * record stays in a shell-owned buffer for the next call on the same file.
+ * Each file has its own buffer, for up to INPUT_CACHES files at a time.
+ *
+ * @return 1 if a complete record was read, 0 at the end of the input (line
+ * holds whatever partial record preceded it), -1 on error
+ */
+int input_read_line(int fd, char delim, struct word_buf *line);
+
+/**
+ * Append everything left in fd to out, including what is buffered for it.
+ *
+ * @return 0 on success, -1 on error
+ */
+int input_read_all(int fd, struct word_buf *out);
+
+#endif /* _INPUT_H */
@@ -0,0 +1,154 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "jobs.h"
+#include "proc.h"
+#include "rate.h"
+#include "utils.h"
+
+int jobs_limit(void)
+{
+	const char *value = getenv("MINISHELL_JOBS");
+	long jobs = value != NULL ? strtol(value, NULL, 10) : 0;
+
+	if (jobs <= 0)
+		jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return jobs > 0 ? jobs : 1;
+}
+
+/**
+ * Give a job /dev/null for input and its own output, in the child.
+ */
+static int job_setup(void *arg)
+{
+	struct job *j = arg;
+	int null_fd = open("/dev/null", O_RDONLY);
+
+	if (null_fd >= 0) {
+		dup2(null_fd, STDIN_FILENO);
+		close(null_fd);
+	}
+
+	dup2(j->out_fd, STDOUT_FILENO);
+	dup2(j->err_fd, STDERR_FILENO);
+
+	return 0;
+}
+
+static int job_body(void *arg)
+{
+	struct job *j = arg;
+
+	return j->run(j->arg);
+}
+
+bool job_start(struct job *j)
+{
+	struct proc_child child = {
+		.body = job_body, .setup = job_setup, .arg = j,
+		.stdin_fd = -1, .stdout_fd = -1
+	};
+
+	j->out_fd = memfd_create("job-out", MFD_CLOEXEC);
+	j->err_fd = memfd_create("job-err", MFD_CLOEXEC);
+
+	rate_wait();
+
+	j->pid = j->out_fd >= 0 && j->err_fd >= 0 ? proc->start(&child) : -1;
+
+	if (j->pid < 0) {
+		perror("job");
+		j->status = EXIT_FAILURE;
+		j->state = JOB_DONE;
+		return false;
+	}
+
+	j->state = JOB_RUNNING;
+
+	return true;
+}
+
+int jobs_reap(struct job *jobs, int n)
+{
+	pid_t *pids = calloc(n, sizeof(*pids));
+	int status;
+	pid_t pid;
+
+	DIE(pids == NULL, "Error allocating jobs.");
+
+	// Only the jobs' own children: others belong to the rest of the shell
+	for (int i = 0; i < n; i++)
+		if (jobs[i].state == JOB_RUNNING)
+			pids[i] = jobs[i].pid;
+
+	pid = proc->wait_any(pids, n, &status, 0);
+	free(pids);
+
+	for (int i = 0; i < n && pid > 0; i++) {
+		if (jobs[i].state != JOB_RUNNING || jobs[i].pid != pid)
+			continue;
+
+		jobs[i].status = WIFEXITED(status) ? WEXITSTATUS(status)
+			: 128 + WTERMSIG(status);
+		jobs[i].state = JOB_DONE;
+
+		return i;
+	}
+
+	if (pid < 0 && errno != ECHILD)
+		perror("job");
+
+	// The running jobs can no longer be waited for
+	for (int i = 0; i < n; i++) {
+		if (jobs[i].state != JOB_RUNNING)
+			continue;
+
+		jobs[i].status = EXIT_FAILURE;
+		jobs[i].state = JOB_DONE;
+	}
+
+	return -1;
+}
+
+static void flush_fd(int buf_fd, int fd)
+{
+	char chunk[BUFSIZ];
+	off_t offset = 0;
+	ssize_t n;
+
+	if (buf_fd < 0)
+		return;
+
+	while ((n = pread(buf_fd, chunk, sizeof(chunk), offset)) > 0) {
+		offset += n;
+
+		for (ssize_t done = 0; done < n; ) {
+			ssize_t ret = write(fd, chunk + done, n - done);
+
+			if (ret < 0)
+				break;
+			done += ret;
+		}
+	}
+
+	close(buf_fd);
+}
+
+void job_flush(struct job *j)
+{
+	flush_fd(j->out_fd, STDOUT_FILENO);
+	flush_fd(j->err_fd, STDERR_FILENO);
+	j->out_fd = -1;
+	j->err_fd = -1;
+}
@@ -0,0 +1,60 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _JOBS_H
+#define _JOBS_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+/*
+ * Background jobs run by the shell's schedulers (autopar.h, graph.h). A
+ * job runs in a child process whose standard output and error go to
+ * memfds, so that the scheduler decides when its output is written out.
+ */
+
+enum job_state {
+	JOB_WAITING,
+	JOB_RUNNING,
+	JOB_DONE,
+	JOB_SKIPPED
+};
+
+struct job {
+	int (*run)(void *arg);	/* the job's body, run in the child */
+	void *arg;
+
+	enum job_state state;
+	pid_t pid;
+	int status;
+	int out_fd, err_fd;
+};
+
+/**
+ * Return the maximum number of jobs running at the same time:
+ * MINISHELL_JOBS, by default the number of online CPUs.
+ */
+int jobs_limit(void);
+
+/**
+ * Start a waiting job. Its standard input is /dev/null. If the job cannot
+ * be started, the error is reported and it is done with status 1.
+ *
+ * @return true if the job is running
+ */
+bool job_start(struct job *j);
+
+/**
+ * Wait for one of the running jobs to finish and record its status. Other
+ * children of the shell are left alone.
+ *
+ * @return the index of the job, or -1 if none of them is running or they
+ * cannot be waited for (all of them are then done, with status 1)
+ */
+int jobs_reap(struct job *jobs, int n);
+
+/**
+ * Write out the buffered output of a finished job and release it.
+ */
+void job_flush(struct job *j);
+
+#endif /* _JOBS_H */
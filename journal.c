@@ -0,0 +1,162 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "journal.h"
+#include "utils.h"
+
+#define JOURNAL_RECORD_SIZE	64
+
+struct journal_done {
+	int line;
+	unsigned long long hash;
+};
+
+static int journal_fd = -1;
+static struct journal_done *done;
+static int ndone;
+
+// Records written since the last sync, and when that was
+static int unsynced;
+static struct timespec synced_at;
+
+static int skipped;
+
+static unsigned long long text_hash(const char *text)
+{
+	return fnv1a(FNV_OFFSET, text, strlen(text));
+}
+
+static int by_line(const void *a, const void *b)
+{
+	const struct journal_done *x = a, *y = b;
+
+	if (x->line != y->line)
+		return x->line < y->line ? -1 : 1;
+	if (x->hash != y->hash)
+		return x->hash < y->hash ? -1 : 1;
+
+	return 0;
+}
+
+/**
+ * Load the successful commands of a journal; it is a text file with one
+ * line per command: line number, hash and status.
+ */
+static void journal_load(const char *path)
+{
+	struct journal_done d;
+	int status;
+	FILE *f = fopen(path, "r");
+
+	if (f == NULL)
+		return;
+
+	while (fscanf(f, "%d %llx %d", &d.line, &d.hash, &status) == 3) {
+		if (status != 0)
+			continue;
+
+		done = realloc(done, (ndone + 1) * sizeof(*done));
+		DIE(done == NULL, "Error allocating journal.");
+		done[ndone++] = d;
+	}
+
+	fclose(f);
+
+	// Resumed runs append records for the same lines again
+	qsort(done, ndone, sizeof(*done), by_line);
+}
+
+int journal_open(const char *path, bool resume)
+{
+	int flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC;
+
+	if (resume)
+		journal_load(path);
+	else
+		flags |= O_TRUNC;
+
+	journal_fd = fd_move_high(open(path, flags, 0644));
+	if (journal_fd < 0)
+		return -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &synced_at);
+
+	return 0;
+}
+
+bool journal_done(int line, const char *text)
+{
+	struct journal_done key = { line, 0 };
+
+	if (ndone == 0)
+		return false;
+
+	key.hash = text_hash(text);
+	if (bsearch(&key, done, ndone, sizeof(*done), by_line) == NULL)
+		return false;
+
+	skipped++;
+
+	return true;
+}
+
+static void journal_sync(void)
+{
+	if (unsynced > 0 && fdatasync(journal_fd) < 0)
+		perror("journal");
+
+	unsynced = 0;
+	clock_gettime(CLOCK_MONOTONIC, &synced_at);
+}
+
+void journal_record(int line, const char *text, int status)
+{
+	char record[JOURNAL_RECORD_SIZE];
+	struct timespec now;
+
+	if (journal_fd < 0)
+		return;
+
+	int n = snprintf(record, sizeof(record), "%d %016llx %d\n", line,
+			text_hash(text), status);
+
+	// One append each, so that a killed shell loses no record
+	if (write(journal_fd, record, n) != n) {
+		perror("journal");
+		return;
+	}
+	unsynced++;
+
+	// Syncing is what is expensive; it is batched
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	long long ms = (now.tv_sec - synced_at.tv_sec) * 1000
+		+ (now.tv_nsec - synced_at.tv_nsec) / 1000000;
+
+	if (unsynced >= JOURNAL_SYNC_RECORDS || ms >= JOURNAL_SYNC_MS)
+		journal_sync();
+}
+
+void journal_close(void)
+{
+	if (journal_fd < 0)
+		return;
+
+	journal_sync();
+	close(journal_fd);
+	journal_fd = -1;
+
+	free(done);
+	done = NULL;
+	ndone = 0;
+
+	if (skipped > 0)
+		fprintf(stderr, "journal: skipped %d commands already done\n",
+				skipped);
+}
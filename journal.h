@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _JOURNAL_H
+#define _JOURNAL_H
+
+#include <stdbool.h>
+
+#define JOURNAL_SYNC_RECORDS	64
+#define JOURNAL_SYNC_MS		200
+
+/*
+ * Journal of the top-level commands a shell ran, to resume a batch run
+ * after a crash.
+ *
+ * With 'mini-shell --journal FILE', each top-level command that completes
+ * appends a record to FILE: the number of the input line it starts at, a
+ * hash of its text and its exit status. Each record is written as soon as
+ * the command completes, so it survives the shell being killed; the file
+ * is only synced to disk every JOURNAL_SYNC_RECORDS records or
+ * JOURNAL_SYNC_MS milliseconds, and when the shell exits, so a crash of
+ * the whole machine may lose the last few.
+ *
+ * 'mini-shell --resume FILE', fed the same input, skips the commands that
+ * FILE records as successful at the same line with the same text, and
+ * keeps appending to FILE. Commands that run inside the shell itself (cd,
+ * assignments, builtins, case) are always run again, since later commands
+ * may depend on their effect.
+ */
+
+/**
+ * Start journaling to path. If resume is set, the successful commands it
+ * already records are loaded first and the new records are appended;
+ * otherwise it is truncated.
+ *
+ * @return 0 on success, -1 with errno set otherwise
+ */
+int journal_open(const char *path, bool resume);
+
+/**
+ * Check if the command with text starting at input line line already
+ * succeeded in the run being resumed.
+ */
+bool journal_done(int line, const char *text);
+
+/**
+ * Record the completion of a top-level command.
+ */
+void journal_record(int line, const char *text, int status);
+
+/**
+ * Sync and close the journal, and report the commands skipped.
+ */
+void journal_close(void);
+
+#endif /* _JOURNAL_H */
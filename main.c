@@ -4,93 +4,88 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "../util/parser/parser.h"
-#include "cmd.h"
-#include "utils.h"
+#include "journal.h"
+#include "minishell.h"
+#include "record.h"
+#include "remote.h"
+#include "replay.h"
 
 #define PROMPT             "> "
-#define CHUNK_SIZE         1024
 
 
-void parse_error(const char *str, const int where)
+static void usage(const char *name)
 {
-	fprintf(stderr, "Parse error near %d: %s\n", where, str);
+	fprintf(stderr, "usage: %s [--journal FILE | --resume FILE"
+			" | --record FILE | --replay FILE [SPEED]"
+			" | --serve SOCKET | --worker [HOST:]PORT]\n", name);
+	exit(EXIT_FAILURE);
 }
 
-/**
- * Readline from mini-shell.
- */
-static char *read_line(void)
+int main(int argc, char **argv)
 {
-	char *line = NULL;
-	int line_length = 0;
+	struct minishell_ctx *ctx;
 
-	char chunk[CHUNK_SIZE];
-	int chunk_length;
+	// Replayed commands are this binary under their names
+	if (getenv("MINISHELL_STUBS") != NULL) {
+		int ret = replay_stub(argv[0]);
 
-	char *rc;
-
-	int endline = 0;
-
-	while (!endline) {
-		rc = fgets(chunk, CHUNK_SIZE, stdin);
-		if (rc == NULL)
-			break;
+		if (ret >= 0)
+			return ret;
+	}
 
-		chunk_length = strlen(chunk);
-		if (chunk[chunk_length - 1] == '\n') {
-			if (chunk_length > 1 && chunk[chunk_length - 2] == '\r')
-				/* Windows */
-				chunk[chunk_length - 2] = 0;
-			else
-				chunk[chunk_length - 1] = 0;
-			endline = 1;
+	if (argc == 3 && !strcmp(argv[1], "--serve")) {
+		ctx = ms_ctx_new();
+		if (ctx == NULL) {
+			perror("minishell");
+			return EXIT_FAILURE;
 		}
-
-		line = realloc(line, line_length + CHUNK_SIZE);
-		DIE(line == NULL, "Error allocating command line");
-
-		line[line_length] = '\0';
-		strcat(line, chunk);
-
-		line_length += CHUNK_SIZE;
+		ms_serve(ctx, argv[2]);
+		perror(argv[2]);
+		return EXIT_FAILURE;
 	}
 
-	return line;
-}
-
-static void start_shell(void)
-{
-	char *line;
-	command_t *root;
-
-	int ret;
-
-	for (;;) {
-		printf(PROMPT);
-		fflush(stdout);
-		ret = 0;
-
-		root = NULL;
-		line = read_line();
-		if (line == NULL)
-			return;
-		parse_line(line, &root);
+	if ((argc == 3 || argc == 4) && !strcmp(argv[1], "--replay")) {
+		if (replay_run(argv[2], argc == 4 ? atof(argv[3]) : 1) < 0) {
+			perror(argv[2]);
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
 
-		if (root != NULL)
-			ret = parse_command(root, 0, NULL);
+	if (argc == 3 && !strcmp(argv[1], "--worker")) {
+		remote_worker(argv[2]);
+		perror(argv[2]);
+		return EXIT_FAILURE;
+	}
 
-		free_parse_memory();
-		free(line);
+	if (argc == 3 && (!strcmp(argv[1], "--journal")
+				|| !strcmp(argv[1], "--resume"))) {
+		if (journal_open(argv[2], !strcmp(argv[1], "--resume")) < 0) {
+			perror(argv[2]);
+			return EXIT_FAILURE;
+		}
+	} else if (argc == 3 && !strcmp(argv[1], "--record")) {
+		if (record_open(argv[2]) < 0) {
+			perror(argv[2]);
+			return EXIT_FAILURE;
+		}
+	} else if (argc != 1) {
+		usage(argv[0]);
+	}
 
-		if (ret == SHELL_EXIT)
-			break;
+	ctx = ms_ctx_new();
+	if (ctx == NULL) {
+		perror("minishell");
+		return EXIT_FAILURE;
 	}
-}
 
-int main(void)
-{
-	start_shell();
+	if (ms_shell(ctx, stdin, PROMPT) < 0)
+		perror("minishell");
+	ms_ctx_free(ctx);
+
+	journal_close();
+	record_close();
+	ms_report();
 
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,408 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <sys/file.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dirs.h"
+#include "make.h"
+#include "plan.h"
+#include "redir.h"
+#include "utils.h"
+
+/**
+ * What is known about a command: how long it took and, in database mode,
+ * the digest of its files when it last succeeded.
+ */
+struct make_entry {
+	unsigned long long key;
+	unsigned long long digest;
+	long long duration_ns;
+};
+
+static struct make_entry *entries;
+static int nentries;
+static bool db_loaded;
+static int db_lines;		/* records in the database file */
+
+static struct {
+	int checked;
+	int skipped;
+	int untimed;
+	long long saved_ns;
+} stats;
+
+static long long elapsed_ns(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) * 1000000000LL
+		+ now.tv_nsec - start->tv_nsec;
+}
+
+static const char *db_path(void)
+{
+	const char *path = getenv("MINISHELL_MAKE_DB");
+
+	return path != NULL && *path != '\0' ? path : NULL;
+}
+
+static struct make_entry *make_find(unsigned long long key)
+{
+	for (int i = 0; i < nentries; i++)
+		if (entries[i].key == key)
+			return &entries[i];
+
+	return NULL;
+}
+
+/**
+ * Read database records from f into the entries; a later record of a
+ * command replaces an earlier one.
+ *
+ * @return the number of records read
+ */
+static int db_read(FILE *f)
+{
+	struct make_entry e;
+	int lines = 0;
+
+	while (fscanf(f, "%llx %llx %lld", &e.key, &e.digest,
+				&e.duration_ns) == 3) {
+		struct make_entry *found = make_find(e.key);
+
+		lines++;
+		if (found != NULL) {
+			*found = e;
+			continue;
+		}
+
+		entries = realloc(entries, (nentries + 1) * sizeof(*entries));
+		DIE(entries == NULL, "Error allocating make database.");
+		entries[nentries++] = e;
+	}
+
+	return lines;
+}
+
+/**
+ * Load the database once; it is a text file with one record per line:
+ * key, digest and duration.
+ */
+static void db_load(void)
+{
+	const char *path = db_path();
+	FILE *f;
+
+	if (db_loaded || path == NULL)
+		return;
+	db_loaded = true;
+
+	f = fopen(path, "r");
+	if (f == NULL)
+		return;
+
+	db_lines = db_read(f);
+	fclose(f);
+}
+
+/**
+ * Open the database and lock it for an update. A compaction may replace
+ * the file while the lock is awaited, so it is only kept on the file the
+ * path still names.
+ *
+ * @return the fd, or -1 with errno set
+ */
+static int db_lock(const char *path)
+{
+	struct stat st_fd, st_path;
+
+	for (;;) {
+		int fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC,
+				0644);
+
+		if (fd < 0)
+			return -1;
+
+		if (flock(fd, LOCK_EX) < 0) {
+			close(fd);
+			return -1;
+		}
+
+		if (fstat(fd, &st_fd) == 0 && stat(path, &st_path) == 0
+				&& st_fd.st_dev == st_path.st_dev
+				&& st_fd.st_ino == st_path.st_ino)
+			return fd;
+
+		close(fd);
+	}
+}
+
+/**
+ * Rewrite the locked database fd with one record per command, read from
+ * the file itself so that what other shells appended is kept, and move it
+ * in place. The entries become those of the file.
+ */
+static void db_compact(int fd, const char *path)
+{
+	size_t len = strlen(path) + sizeof(".tmp");
+	char tmp[len];
+	FILE *in = fdopen(dup(fd), "r");
+
+	if (in == NULL)
+		return;
+
+	nentries = 0;
+	db_read(in);
+	fclose(in);
+
+	snprintf(tmp, len, "%s.tmp", path);
+
+	FILE *f = fopen(tmp, "w");
+
+	if (f == NULL) {
+		perror(tmp);
+		return;
+	}
+
+	for (int i = 0; i < nentries; i++)
+		fprintf(f, "%016llx %016llx %lld\n", entries[i].key,
+				entries[i].digest, entries[i].duration_ns);
+
+	if (fclose(f) != 0 || rename(tmp, path) < 0) {
+		perror(path);
+		unlink(tmp);
+		return;
+	}
+
+	db_lines = nentries;
+}
+
+/**
+ * Append the record of a command to the database, under its lock, so
+ * that concurrent shells never lose each other's records. The file is
+ * compacted once it holds more than twice as many records as commands.
+ */
+static void db_append(struct make_entry e)
+{
+	const char *path = db_path();
+	char line[64];
+
+	if (path == NULL)
+		return;
+
+	int fd = db_lock(path);
+
+	if (fd < 0) {
+		perror(path);
+		return;
+	}
+
+	int n = snprintf(line, sizeof(line), "%016llx %016llx %lld\n", e.key,
+			e.digest, e.duration_ns);
+
+	if (write(fd, line, n) != n)
+		perror(path);
+
+	if (++db_lines > MAKE_DB_COMPACT_MIN && db_lines > 2 * nentries)
+		db_compact(fd, path);
+
+	close(fd);
+}
+
+static void add_file(char ***files, int *n, const char *path)
+{
+	*files = realloc(*files, (*n + 1) * sizeof(**files));
+	DIE(*files == NULL, "Error allocating make files.");
+
+	(*files)[*n] = strdup(path);
+	DIE((*files)[*n] == NULL, "Error allocating make files.");
+	(*n)++;
+}
+
+static void add_word(char ***files, int *n, word_t *w)
+{
+	char *path = get_word(w);
+
+	if (path != NULL)
+		add_file(files, n, path);
+	free(path);
+}
+
+static bool make_digest(const struct make_job *job,
+		unsigned long long *digest)
+{
+	*digest = FNV_OFFSET;
+
+	for (int i = 0; i < job->ninputs; i++)
+		if (!fnv1a_file(digest, job->inputs[i]))
+			return false;
+
+	for (int i = 0; i < job->noutputs; i++)
+		if (!fnv1a_file(digest, job->outputs[i]))
+			return false;
+
+	return true;
+}
+
+static bool older(const struct timespec *a, const struct timespec *b)
+{
+	return a->tv_sec < b->tv_sec
+		|| (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+/**
+ * Check that every output exists and none is older than any input.
+ */
+static bool make_fresh(const struct make_job *job)
+{
+	struct timespec newest_in = { 0, 0 };
+	struct stat st;
+
+	for (int i = 0; i < job->ninputs; i++) {
+		if (stat(job->inputs[i], &st) < 0)
+			return false;
+
+		if (older(&newest_in, &st.st_mtim))
+			newest_in = st.st_mtim;
+	}
+
+	for (int i = 0; i < job->noutputs; i++)
+		if (stat(job->outputs[i], &st) < 0
+				|| older(&st.st_mtim, &newest_in))
+			return false;
+
+	return true;
+}
+
+static void make_job_free(struct make_job *job)
+{
+	for (int i = 0; i < job->ninputs; i++)
+		free(job->inputs[i]);
+	for (int i = 0; i < job->noutputs; i++)
+		free(job->outputs[i]);
+
+	free(job->inputs);
+	free(job->outputs);
+	memset(job, 0, sizeof(*job));
+}
+
+bool make_check(struct make_job *job, simple_command_t *s, char **argv,
+		int argc, const struct prefix_attrs *attrs)
+{
+	const char *cwd = dirs_pwd();
+
+	memset(job, 0, sizeof(*job));
+	db_load();
+
+	// The same words run in the same directory are the same command
+	job->key = fnv1a(FNV_OFFSET, cwd, strlen(cwd) + 1);
+	for (int i = 0; i < argc; i++)
+		job->key = fnv1a(job->key, argv[i], strlen(argv[i]) + 1);
+
+	for (int i = 0; i < attrs->nfiles; i++) {
+		if (attrs->files[i].write)
+			add_file(&job->outputs, &job->noutputs,
+					argv[attrs->files[i].arg]);
+		else
+			add_file(&job->inputs, &job->ninputs,
+					argv[attrs->files[i].arg]);
+	}
+
+	add_word(&job->inputs, &job->ninputs, s->in);
+	add_word(&job->outputs, &job->noutputs, s->out);
+
+	for (const struct fd_redir *r = plan_redirections(s); r != NULL;
+			r = r->next) {
+		if (r->kind != REDIR_FILE)
+			continue;
+
+		if ((r->flags & O_ACCMODE) == O_RDONLY)
+			add_word(&job->inputs, &job->ninputs, r->file);
+		else
+			add_word(&job->outputs, &job->noutputs, r->file);
+	}
+
+	struct make_entry *e = make_find(job->key);
+	unsigned long long digest;
+	bool skip = false;
+
+	stats.checked++;
+
+	if (job->noutputs > 0 && db_path() != NULL)
+		skip = e != NULL && make_digest(job, &digest)
+			&& digest == e->digest;
+	else if (job->noutputs > 0)
+		skip = make_fresh(job);
+
+	if (skip) {
+		stats.skipped++;
+		if (e != NULL)
+			stats.saved_ns += e->duration_ns;
+		else
+			stats.untimed++;
+
+		make_job_free(job);
+		return true;
+	}
+
+	job->active = true;
+	clock_gettime(CLOCK_MONOTONIC, &job->start);
+
+	return false;
+}
+
+void make_record(struct make_job *job, int status)
+{
+	if (!job->active)
+		return;
+
+	long long duration = elapsed_ns(&job->start);
+	struct make_entry *e = make_find(job->key);
+
+	if (status != 0) {
+		make_job_free(job);
+		return;
+	}
+
+	if (e == NULL) {
+		entries = realloc(entries, (nentries + 1) * sizeof(*entries));
+		DIE(entries == NULL, "Error allocating make database.");
+
+		e = &entries[nentries++];
+		e->key = job->key;
+		e->digest = 0;
+	}
+
+	e->duration_ns = duration;
+
+	if (db_path() != NULL) {
+		if (!make_digest(job, &e->digest))
+			e->digest = 0;
+		db_append(*e);
+	}
+
+	make_job_free(job);
+}
+
+void make_report(void)
+{
+	if (stats.checked == 0)
+		return;
+
+	fprintf(stderr, "make: %d of %d commands up to date, saved %.3fs",
+			stats.skipped, stats.checked, stats.saved_ns / 1e9);
+
+	if (stats.untimed > 0)
+		fprintf(stderr, " (plus %d never timed)", stats.untimed);
+
+	fprintf(stderr, "\n");
+}
@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _MAKE_H
+#define _MAKE_H
+
+#include <stdbool.h>
+#include <time.h>
+
+#include "../util/parser/parser.h"
+#include "prefix.h"
+
+#define MAKE_DB_COMPACT_MIN	256
+
+/*
+ * Make-style skipping of commands whose outputs are up to date.
+ *
+ * A command annotated with '@in FILE', '@out FILE' or just '@make' has as
+ * inputs the '@in' files and the file its input is redirected from, and as
+ * outputs the '@out' files and the files its output is redirected to (the
+ * standard error is not an output). It is skipped, with status 0, when it
+ * has outputs and:
+ *
+ *  - by default, every output exists and none is older than any input;
+ *  - if MINISHELL_MAKE_DB names a file, the contents of all its inputs and
+ *    outputs are those recorded in that database the last time the same
+ *    command (same words, same directory) succeeded.
+ *
+ * How long each command took when it last ran is remembered (across
+ * shells too, with the database), so that the time saved by skipping can
+ * be reported when the shell exits.
+ *
+ * The database is read once, when the first annotated command runs. Each
+ * run that succeeds appends its record under an flock() of the file, so
+ * shells sharing it never lose each other's records; the last record of a
+ * command is the one that counts. Past MAKE_DB_COMPACT_MIN records, a
+ * file holding twice as many records as commands is rewritten, under the
+ * same lock, with one record each.
+ */
+
+struct make_job {
+	bool active;
+	unsigned long long key;
+	struct timespec start;
+
+	char **inputs;
+	int ninputs;
+	char **outputs;
+	int noutputs;
+};
+
+/**
+ * Check if the annotated command is up to date; if it is not, start
+ * timing it.
+ *
+ * @return true if the command must be skipped
+ */
+bool make_check(struct make_job *job, simple_command_t *s, char **argv,
+		int argc, const struct prefix_attrs *attrs);
+
+/**
+ * Record the run of a command make_check() did not skip, and release the
+ * job.
+ */
+void make_record(struct make_job *job, int status);
+
+/**
+ * Print how many annotated commands were skipped and the time saved, if
+ * any were checked.
+ */
+void make_report(void);
+
+#endif /* _MAKE_H */
@@ -0,0 +1,457 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dirs.h"
+#include "memo.h"
+#include "utils.h"
+
+#define MEMO_MAGIC		"minishell-memo-1"
+#define MEMO_HEADER_SIZE	128
+
+/**
+ * An entry file is a header line with the exit status, the duration of
+ * the run and the sizes of both outputs, followed by the standard output
+ * and the standard error.
+ */
+struct memo_header {
+	int status;
+	long long duration_ns;
+	long long out_len;
+	long long err_len;
+	size_t size;		/* of the header line */
+};
+
+struct memo_file {
+	char *name;
+	off_t size;
+	struct timespec mtime;
+};
+
+static char *store_dir;
+static long long store_bytes = -1;
+
+static struct {
+	int hits;
+	int misses;
+	int evicted;
+	long long saved_ns;
+} stats;
+
+static const char *memo_dir(void)
+{
+	if (store_dir != NULL)
+		return store_dir;
+
+	const char *dir = getenv("MINISHELL_MEMO_DIR");
+	const char *home = getenv("HOME");
+	struct word_buf buf = { NULL, 0, 0 };
+
+	if (dir != NULL && *dir != '\0') {
+		word_buf_append(&buf, dir, strlen(dir));
+	} else {
+		home = home != NULL ? home : "/tmp";
+		word_buf_append(&buf, home, strlen(home));
+		word_buf_append(&buf, "/.cache/minishell/memo",
+				strlen("/.cache/minishell/memo"));
+	}
+
+	// Create it and its parents
+	for (char *p = strchr(buf.data + 1, '/'); p != NULL;
+			p = strchr(p + 1, '/')) {
+		*p = '\0';
+		mkdir(buf.data, 0700);
+		*p = '/';
+	}
+	mkdir(buf.data, 0700);
+
+	store_dir = buf.data;
+
+	return store_dir;
+}
+
+static long long max_bytes(void)
+{
+	const char *value = getenv("MINISHELL_MEMO_MAX_MB");
+	long long mb = value != NULL ? strtoll(value, NULL, 10) : 0;
+
+	return (mb > 0 ? mb : MEMO_DEFAULT_MAX_MB) * 1024 * 1024;
+}
+
+static long long elapsed_ns(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) * 1000000000LL
+		+ now.tv_nsec - start->tv_nsec;
+}
+
+static bool read_header(int fd, struct memo_header *h)
+{
+	char line[MEMO_HEADER_SIZE];
+	ssize_t n = pread(fd, line, sizeof(line) - 1, 0);
+	char *nl;
+
+	if (n <= 0)
+		return false;
+
+	line[n] = '\0';
+	nl = strchr(line, '\n');
+
+	if (nl == NULL || sscanf(line, MEMO_MAGIC " %d %lld %lld %lld",
+				&h->status, &h->duration_ns, &h->out_len,
+				&h->err_len) != 4)
+		return false;
+
+	h->size = nl - line + 1;
+
+	return true;
+}
+
+/**
+ * Hash what an inherited standard input holds: a regular file from its
+ * offset on, or nothing for /dev/null or a closed fd.
+ *
+ * @return false if it cannot be hashed (a pipe, a terminal, a socket...)
+ */
+static bool hash_stdin(unsigned long long *key)
+{
+	struct stat st, null_st;
+
+	if (fstat(STDIN_FILENO, &st) < 0)
+		return true;
+
+	if (S_ISCHR(st.st_mode))
+		return stat("/dev/null", &null_st) == 0
+			&& st.st_rdev == null_st.st_rdev;
+
+	if (!S_ISREG(st.st_mode))
+		return false;
+
+	off_t offset = lseek(STDIN_FILENO, 0, SEEK_CUR);
+	char block[BUFSIZ];
+	ssize_t len;
+
+	if (offset < 0)
+		return false;
+
+	while ((len = pread(STDIN_FILENO, block, sizeof(block), offset)) > 0) {
+		*key = fnv1a(*key, block, len);
+		offset += len;
+	}
+
+	return len == 0;
+}
+
+void memo_lookup(struct memo_job *job, simple_command_t *s, char **argv,
+		int argc, const struct prefix_attrs *attrs)
+{
+	unsigned long long key = FNV_OFFSET;
+	struct memo_header h;
+
+	memset(job, 0, sizeof(*job));
+
+	for (int i = 0; i < argc; i++)
+		key = fnv1a(key, argv[i], strlen(argv[i]) + 1);
+
+	// Relative paths in the words name other files elsewhere
+	const char *pwd = dirs_pwd();
+
+	key = fnv1a(key, pwd, strlen(pwd) + 1);
+
+	for (int i = 0; i < attrs->nenv; i++) {
+		const char *name = argv[attrs->env_args[i]];
+		const char *value = getenv(name);
+
+		key = fnv1a(key, name, strlen(name) + 1);
+		key = value != NULL ? fnv1a(key, value, strlen(value) + 1)
+			: fnv1a(key, "", 0);
+	}
+
+	for (int i = 0; i < attrs->nfiles; i++)
+		if (!attrs->files[i].write
+				&& !fnv1a_file(&key, argv[attrs->files[i].arg]))
+			return;
+
+	char *in = get_word(s->in);
+	bool readable = in == NULL ? hash_stdin(&key) : fnv1a_file(&key, in);
+
+	free(in);
+
+	// A command whose inputs cannot be read is just run
+	if (!readable)
+		return;
+
+	const char *dir = memo_dir();
+	size_t len = strlen(dir) + 18;
+
+	job->path = malloc(len);
+	DIE(job->path == NULL, "Error allocating memo entry.");
+	snprintf(job->path, len, "%s/%016llx", dir, key);
+
+	int fd = open(job->path, O_RDONLY | O_CLOEXEC);
+
+	if (fd >= 0) {
+		job->hit = read_header(fd, &h);
+		job->duration_ns = h.duration_ns;
+		close(fd);
+	}
+
+	job->active = true;
+	clock_gettime(CLOCK_MONOTONIC, &job->start);
+}
+
+/**
+ * Copy len bytes at offset of in_fd to out_fd.
+ */
+static void copy_range(int in_fd, off_t offset, long long len, int out_fd)
+{
+	char chunk[BUFSIZ];
+
+	while (len > 0) {
+		size_t want = len < (long long)sizeof(chunk) ? len
+			: sizeof(chunk);
+		ssize_t n = pread(in_fd, chunk, want, offset);
+
+		if (n <= 0)
+			return;
+
+		for (ssize_t done = 0; done < n; ) {
+			ssize_t ret = write(out_fd, chunk + done, n - done);
+
+			if (ret < 0)
+				return;
+			done += ret;
+		}
+
+		offset += n;
+		len -= n;
+	}
+}
+
+/**
+ * Replay the entry; only returns if it is gone (e.g. trimmed by another
+ * shell since the lookup).
+ */
+static void memo_replay(struct memo_job *job)
+{
+	struct memo_header h;
+	int fd = open(job->path, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0 || !read_header(fd, &h)) {
+		if (fd >= 0)
+			close(fd);
+		job->hit = false;
+		return;
+	}
+
+	copy_range(fd, h.size, h.out_len, STDOUT_FILENO);
+	copy_range(fd, h.size + h.out_len, h.err_len, STDERR_FILENO);
+
+	_exit(h.status);
+}
+
+/**
+ * Write the entry to a temporary file in the store and move it in place.
+ */
+static void memo_store(struct memo_job *job, int status, int out_fd,
+		int err_fd)
+{
+	struct stat out_st, err_st;
+	char header[MEMO_HEADER_SIZE];
+	size_t len = strlen(job->path) + 32;
+	char tmp[len];
+
+	if (fstat(out_fd, &out_st) < 0 || fstat(err_fd, &err_st) < 0)
+		return;
+
+	// Hidden, so that trimming never counts it
+	snprintf(tmp, len, "%s/.%s.%d", memo_dir(),
+			strrchr(job->path, '/') + 1, getpid());
+
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+
+	if (fd < 0)
+		return;
+
+	int n = snprintf(header, sizeof(header),
+			MEMO_MAGIC " %d %lld %lld %lld\n", status,
+			elapsed_ns(&job->start), (long long)out_st.st_size,
+			(long long)err_st.st_size);
+
+	if (write(fd, header, n) != n) {
+		close(fd);
+		unlink(tmp);
+		return;
+	}
+
+	copy_range(out_fd, 0, out_st.st_size, fd);
+	copy_range(err_fd, 0, err_st.st_size, fd);
+
+	if (close(fd) < 0 || rename(tmp, job->path) < 0)
+		unlink(tmp);
+}
+
+void memo_exec(struct memo_job *job, char **argv)
+{
+	if (job->hit)
+		memo_replay(job);
+
+	int out_fd = memfd_create("memo-out", MFD_CLOEXEC);
+	int err_fd = memfd_create("memo-err", MFD_CLOEXEC);
+	int status;
+
+	if (out_fd < 0 || err_fd < 0) {
+		execvp(argv[0], argv);
+		fprintf(stderr, "Execution failed for '%s'\n", argv[0]);
+		_exit(127);
+	}
+
+	pid_t pid = fork();
+
+	if (pid == 0) {
+		dup2(out_fd, STDOUT_FILENO);
+		dup2(err_fd, STDERR_FILENO);
+
+		execvp(argv[0], argv);
+		fprintf(stderr, "Execution failed for '%s'\n", argv[0]);
+		_exit(127);
+	}
+
+	if (pid < 0 || waitpid(pid, &status, 0) < 0) {
+		perror("memo");
+		_exit(EXIT_FAILURE);
+	}
+
+	// Only successful runs are stored: a failure may be transient, and
+	// replaying it forever would also defeat 'retry'
+	if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+		memo_store(job, 0, out_fd, err_fd);
+
+	copy_range(out_fd, 0, lseek(out_fd, 0, SEEK_END), STDOUT_FILENO);
+	copy_range(err_fd, 0, lseek(err_fd, 0, SEEK_END), STDERR_FILENO);
+
+	_exit(WIFEXITED(status) ? WEXITSTATUS(status)
+			: 128 + WTERMSIG(status));
+}
+
+static int by_mtime(const void *a, const void *b)
+{
+	const struct memo_file *x = a, *y = b;
+
+	if (x->mtime.tv_sec != y->mtime.tv_sec)
+		return x->mtime.tv_sec < y->mtime.tv_sec ? -1 : 1;
+	if (x->mtime.tv_nsec != y->mtime.tv_nsec)
+		return x->mtime.tv_nsec < y->mtime.tv_nsec ? -1 : 1;
+
+	return 0;
+}
+
+/**
+ * Measure the store and remove the least recently used entries while it
+ * is over the limit.
+ */
+static void memo_trim(void)
+{
+	DIR *dir = opendir(memo_dir());
+	struct memo_file *files = NULL;
+	int n = 0;
+	struct dirent *d;
+
+	if (dir == NULL)
+		return;
+
+	store_bytes = 0;
+
+	while ((d = readdir(dir)) != NULL) {
+		struct stat st;
+
+		if (d->d_name[0] == '.' || fstatat(dirfd(dir), d->d_name, &st,
+					0) < 0 || !S_ISREG(st.st_mode))
+			continue;
+
+		files = realloc(files, (n + 1) * sizeof(*files));
+		DIE(files == NULL, "Error allocating memo store.");
+
+		files[n].name = strdup(d->d_name);
+		DIE(files[n].name == NULL, "Error allocating memo store.");
+		files[n].size = st.st_size;
+		files[n].mtime = st.st_mtim;
+		store_bytes += st.st_size;
+		n++;
+	}
+
+	qsort(files, n, sizeof(*files), by_mtime);
+
+	long long limit = max_bytes();
+
+	// Oldest first
+	for (int i = 0; i < n; i++) {
+		const char *name = files[i].name;
+
+		if (store_bytes > limit && unlinkat(dirfd(dir), name, 0) == 0) {
+			store_bytes -= files[i].size;
+			stats.evicted++;
+		}
+		free(files[i].name);
+	}
+
+	free(files);
+	closedir(dir);
+}
+
+void memo_finish(struct memo_job *job)
+{
+	struct stat st;
+
+	if (!job->active)
+		return;
+
+	if (job->hit) {
+		stats.hits++;
+		stats.saved_ns += job->duration_ns - elapsed_ns(&job->start);
+
+		// Replaying an entry makes it the most recently used
+		utimensat(AT_FDCWD, job->path, NULL, 0);
+	} else {
+		stats.misses++;
+
+		// The store is scanned once, then kept track of
+		if (store_bytes < 0)
+			memo_trim();
+		else if (stat(job->path, &st) == 0)
+			store_bytes += st.st_size;
+
+		if (store_bytes > max_bytes())
+			memo_trim();
+	}
+
+	free(job->path);
+	memset(job, 0, sizeof(*job));
+}
+
+void memo_report(void)
+{
+	if (stats.hits + stats.misses == 0)
+		return;
+
+	fprintf(stderr, "memo: %d hits, %d misses, saved %.3fs", stats.hits,
+			stats.misses, stats.saved_ns / 1e9);
+
+	if (stats.evicted > 0)
+		fprintf(stderr, ", %d entries evicted", stats.evicted);
+
+	fprintf(stderr, "\n");
+}
@@ -0,0 +1,67 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _MEMO_H
+#define _MEMO_H
+
+#include <stdbool.h>
+#include <time.h>
+
+#include "../util/parser/parser.h"
+#include "prefix.h"
+
+#define MEMO_DEFAULT_MAX_MB	64
+
+/*
+ * Content-addressed memoization of deterministic commands.
+ *
+ * 'memo [-e VAR]... [-i FILE]... CMD' treats CMD as a pure function of its
+ * words, of the working directory, of the VARs, and of the contents of the
+ * FILEs and of its input: the file it is redirected from, or the regular
+ * file it inherits. A command whose input is a pipe, a terminal or a
+ * socket is just run. The standard output and standard error of the
+ * first successful run (exit status 0) are stored under a hash of all of
+ * these; later runs with the same hash replay them instead of running
+ * CMD. A run that fails is not stored, so the next one runs CMD again
+ * (and 'retry' still retries it). The output of a run that may be stored
+ * only shows up once CMD exited.
+ *
+ * Entries live in MINISHELL_MEMO_DIR (default ~/.cache/minishell/memo),
+ * one file each. Replaying an entry refreshes its modification time, and
+ * the least recently used entries are removed when the store grows over
+ * MINISHELL_MEMO_MAX_MB (default MEMO_DEFAULT_MAX_MB) megabytes. Hits,
+ * misses and the time saved are reported when the shell exits.
+ */
+
+struct memo_job {
+	bool active;
+	bool hit;
+	char *path;		/* entry file */
+	long long duration_ns;	/* of the stored run, on a hit */
+	struct timespec start;
+};
+
+/**
+ * Hash a memo command and look its entry up.
+ */
+void memo_lookup(struct memo_job *job, simple_command_t *s, char **argv,
+		int argc, const struct prefix_attrs *attrs);
+
+/**
+ * In the child, once its redirections are in place: replay the entry on a
+ * hit, otherwise (or if the entry is gone by now) run argv, capturing its
+ * output into a new entry. Never returns.
+ */
+void memo_exec(struct memo_job *job, char **argv);
+
+/**
+ * In the shell, once the child exited: account for the run, trim the store
+ * and release the job.
+ */
+void memo_finish(struct memo_job *job);
+
+/**
+ * Print the memoization statistics, if any memo command ran.
+ */
+void memo_report(void);
+
+#endif /* _MEMO_H */
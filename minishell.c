@@ -0,0 +1,714 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../util/parser/parser.h"
+#include "account.h"
+#include "cmd.h"
+#include "dirs.h"
+#include "fair.h"
+#include "input.h"
+#include "journal.h"
+#include "make.h"
+#include "memo.h"
+#include "minishell.h"
+#include "plan.h"
+#include "proc.h"
+#include "rate.h"
+#include "record.h"
+#include "remote.h"
+#include "utils.h"
+
+extern char **environ;
+
+struct minishell_ctx {
+	struct dir_entry *cwd;	/* held, see dirs_hold() */
+	char **env;		/* NULL terminated copy of the environment */
+	bool exited;
+
+	// Pids of the submitted runs, 0 for a free id
+	pid_t jobs[MS_MAX_JOBS];
+};
+
+/**
+ * What ms_enter() switched away from, for ms_leave().
+ */
+struct ms_saved {
+	struct dir_entry *cwd;
+	char **env;
+	int fds[3];
+};
+
+/**
+ * Input of a run: a stream and the number of lines read from it so far.
+ */
+struct ms_input {
+	FILE *in;
+	int lines_read;
+	bool nomem;	/* a statement could not be allocated */
+};
+
+// Set when the statement being compiled did not parse. The parser reports
+// errors through the parse_error() callback, which has no argument to
+// tell it the context, hence the global.
+static bool parse_failed;
+
+void parse_error(const char *str, const int where)
+{
+	fprintf(stderr, "Parse error near %d: %s\n", where, str);
+	parse_failed = true;
+}
+
+/**
+ * Read a line of input, counting it.
+ *
+ * A stream on a file is read through input_read_line() rather than stdio,
+ * so that the 'read' builtin, which reads the same file through the same
+ * buffer, gets the line that follows the statement and not what stdio read
+ * ahead. Streams with no file (ms_run() text) go through read_line().
+ */
+static char *ms_read_line(struct ms_input *input)
+{
+	struct word_buf line = { NULL, 0, 0 };
+	int fd = fileno(input->in);
+	int ret;
+
+	if (fd < 0) {
+		line.data = read_line(input->in);
+		if (line.data != NULL)
+			input->lines_read++;
+		return line.data;
+	}
+
+	enum account_site prev = account_enter(ACCOUNT_READ_LINE);
+
+	ret = input_read_line(fd, '\n', &line);
+	account_leave(prev);
+
+	if (ret < 0 || (ret == 0 && line.len == 0)) {
+		free(line.data);
+		return NULL;
+	}
+
+	/* Windows */
+	if (line.len > 0 && line.data[line.len - 1] == '\r')
+		line.data[line.len - 1] = '\0';
+
+	input->lines_read++;
+
+	return line.data;
+}
+
+/**
+ * Read a full statement: keep appending lines while the text opens a
+ * construct (e.g. case ... esac) that is not closed yet.
+ *
+ * @param first_line set to the number of the line the statement starts at
+ */
+static char *read_statement(struct ms_input *input, int *first_line)
+{
+	char *text = ms_read_line(input);
+
+	*first_line = input->lines_read;
+
+	while (text != NULL && plan_incomplete(text)) {
+		char *more = ms_read_line(input);
+
+		if (more == NULL)
+			break;
+
+		size_t text_length = strlen(text);
+
+		char *grown = realloc(text, text_length + strlen(more) + 2);
+
+		if (grown == NULL) {
+			free(text);
+			free(more);
+			input->nomem = true;
+			return NULL;
+		}
+		text = grown;
+
+		text[text_length] = '\n';
+		strcpy(text + text_length + 1, more);
+		free(more);
+	}
+
+	return text;
+}
+
+/**
+ * Run the statements of input until it ends or 'exit' is run.
+ *
+ * @param prompt printed before each statement, if not NULL
+ * @param journal whether top-level commands are journaled
+ * @param status set to the exit status of the last statement run
+ *
+ * @return 0, or -1 with errno set to EINVAL if a statement did not parse,
+ * or to ENOMEM if one could not be read
+ */
+static int ms_loop(struct minishell_ctx *ctx, struct ms_input *input,
+		const char *prompt, bool journal, int *status)
+{
+	char *line;
+	struct plan *plan;
+
+	int ret, first_line, err = 0;
+
+	*status = 0;
+
+	// What the shell holds open before the first statement is its own
+	account_fds_mark();
+
+	for (;;) {
+		if (prompt != NULL) {
+			printf("%s", prompt);
+			fflush(stdout);
+		}
+		ret = 0;
+
+		line = read_statement(input, &first_line);
+		if (line == NULL && input->nomem) {
+			errno = ENOMEM;
+			return -1;
+		}
+		if (line == NULL)
+			break;
+
+		int64_t arrival = record_clock();
+
+		parse_failed = false;
+		plan = plan_compile(line);
+		if (parse_failed)
+			err = -1;
+
+		int64_t parsed = record_clock();
+
+		// When resuming, what already succeeded is not run again
+		if (journal && plan != NULL && !plan_in_shell(plan)
+				&& journal_done(first_line, line)) {
+			plan_free(plan);
+			free(line);
+			continue;
+		}
+
+		if (plan != NULL)
+			ret = plan_run(plan);
+
+		account_fds_check(first_line, line);
+
+		if (journal && plan != NULL && ret != SHELL_EXIT)
+			journal_record(first_line, line, ret);
+
+		if (plan != NULL && ret != SHELL_EXIT)
+			record_statement(first_line, line, arrival,
+					parsed - arrival,
+					record_clock() - parsed,
+					ret < 0 ? -1 : ret);
+
+		plan_free(plan);
+		free(line);
+
+		if (ret == SHELL_EXIT) {
+			ctx->exited = true;
+			break;
+		}
+
+		if (plan != NULL)
+			*status = ret < 0 ? EXIT_FAILURE : ret;
+	}
+
+	if (err < 0)
+		errno = EINVAL;
+
+	return err;
+}
+
+/**
+ * @return a copy of env, or NULL if it cannot be allocated
+ */
+static char **env_copy(char **env)
+{
+	int n = 0;
+
+	while (env != NULL && env[n] != NULL)
+		n++;
+
+	char **copy = malloc((n + 1) * sizeof(*copy));
+
+	if (copy == NULL)
+		return NULL;
+
+	for (int i = 0; i < n; i++) {
+		copy[i] = strdup(env[i]);
+		if (copy[i] != NULL)
+			continue;
+
+		while (i-- > 0)
+			free(copy[i]);
+		free(copy);
+		return NULL;
+	}
+	copy[n] = NULL;
+
+	return copy;
+}
+
+static void env_free(char **env)
+{
+	for (int i = 0; env != NULL && env[i] != NULL; i++)
+		free(env[i]);
+
+	free(env);
+}
+
+/**
+ * Replace the environment of the process with env.
+ */
+static void env_load(char **env)
+{
+	clearenv();
+
+	for (int i = 0; env[i] != NULL; i++) {
+		char *eq = strchr(env[i], '=');
+
+		if (eq == NULL)
+			continue;
+
+		*eq = '\0';
+		setenv(env[i], eq + 1, 1);
+		*eq = '=';
+	}
+
+	dirs_cdpath_changed();
+}
+
+/**
+ * Switch the process to the directory, environment and fds of a run in
+ * ctx.
+ *
+ * @return 0, or -1 with errno set, the process left as it was, if what it
+ * switches away from cannot be saved
+ */
+static int ms_enter(struct minishell_ctx *ctx, const int fds[3],
+		struct ms_saved *saved)
+{
+	saved->env = env_copy(environ);
+	if (saved->env == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	saved->cwd = dirs_hold();
+
+	// The directory first: entering it sets PWD and OLDPWD
+	if (dirs_enter(ctx->cwd) < 0)
+		perror("cd");
+	env_load(ctx->env);
+
+	fflush(stdout);
+	fflush(stderr);
+
+	for (int i = 0; i < 3; i++) {
+		saved->fds[i] = -1;
+
+		if (fds == NULL || fds[i] < 0 || fds[i] == i)
+			continue;
+
+		saved->fds[i] = fcntl(i, F_DUPFD_CLOEXEC, SHELL_FD_MIN);
+		if (saved->fds[i] >= 0)
+			dup2(fds[i], i);
+		else
+			perror("dup");
+	}
+
+	return 0;
+}
+
+/**
+ * Keep the directory and environment the run left in ctx, and switch the
+ * process back.
+ *
+ * @return 0, or -1 with errno set to ENOMEM if the environment of ctx could
+ * not be saved; it then keeps the one it had before the run
+ */
+static int ms_leave(struct minishell_ctx *ctx, struct ms_saved *saved)
+{
+	char **env;
+
+	fflush(stdout);
+	fflush(stderr);
+
+	for (int i = 2; i >= 0; i--) {
+		if (saved->fds[i] < 0)
+			continue;
+
+		dup2(saved->fds[i], i);
+		close(saved->fds[i]);
+	}
+
+	env = env_copy(environ);
+	if (env != NULL) {
+		env_free(ctx->env);
+		ctx->env = env;
+	}
+
+	dirs_release(ctx->cwd);
+	ctx->cwd = dirs_hold();
+
+	if (dirs_enter(saved->cwd) < 0)
+		perror("cd");
+	env_load(saved->env);
+
+	env_free(saved->env);
+	dirs_release(saved->cwd);
+
+	if (env == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	return 0;
+}
+
+struct minishell_ctx *ms_ctx_new(void)
+{
+	// Once per process, not per context: see minishell.h
+	static bool initialized;
+	struct minishell_ctx *ctx = calloc(1, sizeof(*ctx));
+
+	if (ctx == NULL)
+		return NULL;
+
+	// Shared with every child, so it must exist before any of them
+	if (!initialized) {
+		if (remote_init() < 0) {
+			free(ctx);
+			errno = ENOMEM;
+			return NULL;
+		}
+		rate_init();
+		fair_init();
+		proc_init();
+		account_init();
+		initialized = true;
+	}
+
+	ctx->env = env_copy(environ);
+	if (ctx->env == NULL) {
+		free(ctx);
+		errno = ENOMEM;
+		return NULL;
+	}
+	ctx->cwd = dirs_hold();
+
+	return ctx;
+}
+
+void ms_ctx_free(struct minishell_ctx *ctx)
+{
+	int status;
+
+	if (ctx == NULL)
+		return;
+
+	for (int i = 0; i < MS_MAX_JOBS; i++)
+		if (ctx->jobs[i] != 0)
+			waitpid(ctx->jobs[i], &status, 0);
+
+	env_free(ctx->env);
+	dirs_release(ctx->cwd);
+	free(ctx);
+}
+
+/**
+ * Run text in ctx, in the current process.
+ */
+static int ms_run_text(struct minishell_ctx *ctx, const char *text,
+		int *status)
+{
+	struct ms_input input = { NULL, 0, false };
+	int ret;
+
+	input.in = fmemopen((void *)text, strlen(text), "r");
+	if (input.in == NULL)
+		return -1;
+
+	ret = ms_loop(ctx, &input, NULL, false, status);
+
+	int err = errno;
+
+	fclose(input.in);
+	errno = err;
+
+	return ret;
+}
+
+int ms_run(struct minishell_ctx *ctx, const char *text, const int fds[3],
+		int *status)
+{
+	struct ms_saved saved;
+	int ret;
+
+	*status = 0;
+	if (ctx->exited || *text == '\0')
+		return 0;
+
+	if (ms_enter(ctx, fds, &saved) < 0)
+		return -1;
+
+	ret = ms_run_text(ctx, text, status);
+
+	int err = errno;
+
+	if (ms_leave(ctx, &saved) < 0)
+		return -1;
+	errno = err;
+
+	return ret;
+}
+
+int ms_submit(struct minishell_ctx *ctx, const char *text,
+		const int fds[3])
+{
+	struct ms_saved saved;
+	int id, status;
+
+	for (id = 0; id < MS_MAX_JOBS && ctx->jobs[id] != 0; id++)
+		;
+
+	if (id == MS_MAX_JOBS) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+
+	pid_t pid = fork();
+
+	if (pid < 0)
+		return -1;
+
+	if (pid == 0) {
+		if (ms_enter(ctx, fds, &saved) < 0) {
+			perror("minishell");
+			child_exit(EXIT_FAILURE);
+		}
+		if (ms_run_text(ctx, text, &status) < 0 && errno == ENOMEM)
+			status = EXIT_FAILURE;
+		child_exit(status);
+	}
+
+	ctx->jobs[id] = pid;
+
+	return id;
+}
+
+int ms_poll(struct minishell_ctx *ctx, int id, int *status, bool wait)
+{
+	int wstatus;
+
+	if (id < 0 || id >= MS_MAX_JOBS || ctx->jobs[id] == 0) {
+		errno = ECHILD;
+		return -1;
+	}
+
+	pid_t pid = waitpid(ctx->jobs[id], &wstatus, wait ? 0 : WNOHANG);
+
+	if (pid == 0)
+		return 0;
+
+	ctx->jobs[id] = 0;
+	if (pid < 0)
+		return -1;
+
+	*status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus)
+		: 128 + WTERMSIG(wstatus);
+
+	return 1;
+}
+
+bool ms_exited(const struct minishell_ctx *ctx)
+{
+	return ctx->exited;
+}
+
+int ms_shell(struct minishell_ctx *ctx, FILE *in, const char *prompt)
+{
+	struct ms_input input = { in, 0, false };
+	struct ms_saved saved;
+	int status, ret;
+
+	if (ms_enter(ctx, NULL, &saved) < 0)
+		return -1;
+
+	ret = ms_loop(ctx, &input, prompt, true, &status);
+
+	int err = errno;
+
+	if (ms_leave(ctx, &saved) < 0)
+		return -1;
+
+	if (ret < 0 && err == ENOMEM) {
+		errno = err;
+		return -1;
+	}
+
+	return status;
+}
+
+/**
+ * Serve one session on a connection, in its own process. Never returns.
+ */
+static void ms_session(struct minishell_ctx *ctx, int fd,
+		const sigset_t *mask)
+{
+	struct sigaction sa = { .sa_handler = SIG_DFL };
+
+	// Its commands get their share of MINISHELL_SLOTS as a whole
+	fair_session_start();
+	sigaction(SIGCHLD, &sa, NULL);
+	sigprocmask(SIG_SETMASK, mask, NULL);
+
+	for (int i = 0; i < 3; i++)
+		dup2(fd, i);
+	if (fd > 2)
+		close(fd);
+
+	int status = ms_shell(ctx, stdin, NULL);
+
+	if (status < 0) {
+		perror("session");
+		status = EXIT_FAILURE;
+	}
+
+	child_exit(status);
+}
+
+static void on_child(int sig)
+{
+	// Only there to interrupt ppoll()
+}
+
+int ms_serve(struct minishell_ctx *ctx, const char *path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	struct sigaction sa = { .sa_handler = on_child };
+	struct pollfd pfd = { .events = POLLIN };
+	sigset_t chld, mask;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	pfd.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (pfd.fd < 0)
+		return -1;
+
+	// A socket left behind by an earlier server is replaced, but nothing
+	// else: the path may well be a mistake
+	struct stat st;
+
+	if (lstat(path, &st) == 0) {
+		if (!S_ISSOCK(st.st_mode)) {
+			close(pfd.fd);
+			errno = EEXIST;
+			return -1;
+		}
+		unlink(path);
+	}
+
+	// Only the owner may connect, from the moment the socket exists
+	mode_t umask_saved = umask(0177);
+	int ret = bind(pfd.fd, (struct sockaddr *)&addr, sizeof(addr));
+
+	umask(umask_saved);
+
+	if (ret < 0 || listen(pfd.fd, SOMAXCONN) < 0) {
+		close(pfd.fd);
+		return -1;
+	}
+
+	// Sessions that end are only noticed while waiting, so none is missed
+	sigemptyset(&chld);
+	sigaddset(&chld, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &chld, &mask);
+	sigaction(SIGCHLD, &sa, NULL);
+
+	for (;;) {
+		struct ucred peer;
+		socklen_t len = sizeof(peer);
+
+		ret = ppoll(&pfd, 1, NULL, &mask);
+		int err = errno;
+
+		while (waitpid(-1, NULL, WNOHANG) > 0)
+			;
+
+		if (ret < 0 && err == EINTR)
+			continue;
+		if (ret < 0) {
+			errno = err;
+			break;
+		}
+
+		int fd = accept4(pfd.fd, NULL, NULL, SOCK_CLOEXEC);
+
+		if (fd < 0) {
+			if (errno == ECONNABORTED || errno == EAGAIN)
+				continue;
+			break;
+		}
+
+		// The mode of the socket aside, sessions are only served to
+		// processes of the same user
+		if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &len) < 0
+				|| peer.uid != geteuid()) {
+			close(fd);
+			continue;
+		}
+
+		fflush(stdout);
+		fflush(stderr);
+
+		pid_t pid = fork();
+
+		if (pid == 0) {
+			close(pfd.fd);
+			ms_session(ctx, fd, &mask);
+		}
+
+		if (pid < 0)
+			perror("session");
+		close(fd);
+	}
+
+	close(pfd.fd);
+	sigprocmask(SIG_SETMASK, &mask, NULL);
+
+	return -1;
+}
+
+void ms_report(void)
+{
+	make_report();
+	memo_report();
+	rate_report();
+	proc_report();
+	account_report();
+}
@@ -0,0 +1,155 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _MINISHELL_H
+#define _MINISHELL_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#define MS_MAX_JOBS	64
+
+/*
+ * libminishell: the shell as a library, for programs that would otherwise
+ * run /bin/sh -c for each command line.
+ *
+ * A context holds what a shell session owns: its working directory, its
+ * environment, whether it ran 'exit', and the commands submitted to it
+ * that are still running. The directory is kept open (see dirs_hold()).
+ * Running a command line in a context fchdir()s the process to the
+ * context's directory and switches to its environment for the length
+ * of the call, then switches back; contexts can therefore be used one
+ * after the other from the same thread, but not at the same time.
+ *
+ * These switches are made to the whole process, not to the calling
+ * thread, for as long as ms_run() and ms_shell() run (ms_submit() only
+ * makes them in its child):
+ * - the working directory, with fchdir();
+ * - the environment, replaced with clearenv() and one setenv() per
+ *   variable, and copied back when the call returns, at a cost that grows
+ *   with the size of the environment;
+ * - the standard input, output and error, with dup2() over fds 0 to 2,
+ *   for the fds given to ms_run().
+ * Other threads of the program must not use relative paths, getenv() or
+ * setenv(), or fds 0 to 2 meanwhile; they see the context's, and a
+ * setenv() of theirs is lost or leaks into the context.
+ *
+ * The rest of the state is process-wide, and none of it is locked; no
+ * two calls into the library may therefore run at the same time, whether
+ * on the same context or not:
+ * - the parser (../util/parser) keeps its arena in globals, and reports
+ *   errors through parse_error() with no context, to a flag of this file;
+ * - the current directory, environment and standard fds are the
+ *   process's own, which every call switches (see above);
+ * - the directory fd cache, the directory stack and the CDPATH memo
+ *   (dirs.c), the ${...} operator cache (expand.c), the regex cache
+ *   (cond.c), the sourced files (source.c), the arrays (vars.c), the
+ *   read-ahead cache of the input (input.c), the make database (make.c)
+ *   and the memo store (memo.c) are shared on purpose, so that each
+ *   context starts warm; a context sees the arrays and directory stack
+ *   another one left;
+ * - the journal and record files (journal.c, record.c) the program opens
+ *   cover all contexts, and so do the accounting and simulated backend
+ *   counters (account.c, proc.c) and the launch rate and slot limits
+ *   (rate.c, fair.c), which the first ms_ctx_new() sets up.
+ *
+ * Commands run in child processes, which never return into the caller:
+ * they end with _exit(), so the embedding program's atexit() handlers
+ * never run in them. The entry points report their own allocation
+ * failures with ENOMEM; one inside a command's builtins, expansions or
+ * caches still exits the process, as DIE() does everywhere in the shell.
+ * 'exec CMD' replaces the process, as in any shell.
+ */
+
+struct minishell_ctx;
+
+/**
+ * Create a context whose directory and environment are the process's
+ * current ones.
+ *
+ * @return the context, or NULL with errno set to ENOMEM
+ */
+struct minishell_ctx *ms_ctx_new(void);
+
+/**
+ * Wait for the commands still running in ctx and free it.
+ */
+void ms_ctx_free(struct minishell_ctx *ctx);
+
+/**
+ * Run text, one or more statements, in ctx. Each of fds that is not -1
+ * replaces the standard input, output or error for the run.
+ *
+ * @param status set to the exit status of the last statement run
+ *
+ * @return 0 on success, -1 with errno set to EINVAL if a statement did not
+ * parse (the statements after it are still run), or to ENOMEM if the run
+ * could not be set up or a statement could not be read (the ones before
+ * it did run)
+ */
+int ms_run(struct minishell_ctx *ctx, const char *text, const int fds[3],
+		int *status);
+
+/**
+ * Start running text in ctx, like ms_run(), in a child process; what it
+ * changes in the directory or the environment does not outlive it, as in
+ * a subshell.
+ *
+ * @return the id of the run, or -1 with errno set (EAGAIN if MS_MAX_JOBS
+ * runs are pending already)
+ */
+int ms_submit(struct minishell_ctx *ctx, const char *text,
+		const int fds[3]);
+
+/**
+ * Check if the run id submitted to ctx finished, waiting for it if wait
+ * is set. Once it is reported finished, the id is released.
+ *
+ * @return 1 if it finished, with its exit status in status, 0 if it is
+ * still running, -1 with errno set to ECHILD if there is no such run
+ */
+int ms_poll(struct minishell_ctx *ctx, int id, int *status, bool wait);
+
+/**
+ * Check if 'exit' or 'quit' was run in ctx.
+ */
+bool ms_exited(const struct minishell_ctx *ctx);
+
+/**
+ * Run the statements read from in, printing prompt before each, until the
+ * input ends or 'exit' is run. Top-level commands are journaled (see
+ * journal.h).
+ *
+ * A stream on a file is read through its file descriptor with
+ * input_read_line(), sharing its buffer with the 'read' builtin; anything
+ * already buffered by stdio in the stream is not seen.
+ *
+ * @return the exit status of the last statement run, or -1 with errno set
+ * to ENOMEM
+ */
+int ms_shell(struct minishell_ctx *ctx, FILE *in, const char *prompt);
+
+/**
+ * Serve shell sessions on the Unix socket at path, replacing any socket
+ * there: each connection is a session, run as by ms_shell() on the
+ * connection (no prompt), in its own process forked from the server.
+ *
+ * The socket is created with mode 0600, whatever the umask, and a
+ * connection from a process of another user (SO_PEERCRED) is closed
+ * unserved. A path that exists and is not a socket is left alone.
+ *
+ * A session starts with the directory, environment and warm caches of ctx
+ * as they are when it connects, and owns them from then on: its cd and
+ * assignments never reach the server or the other sessions. Sessions run
+ * concurrently, with nothing shared to contend on.
+ *
+ * @return -1 with errno set (EEXIST if path is not a socket), once the
+ * socket cannot be set up or accept() fails for good
+ */
+int ms_serve(struct minishell_ctx *ctx, const char *path);
+
+/**
+ * Print what the make, memo and launch rate features did, if anything.
+ */
+void ms_report(void);
+
+#endif /* _MINISHELL_H */
@@ -0,0 +1,428 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fair.h"
+#include "input.h"
+#include "jobs.h"
+#include "parmap.h"
+#include "proc.h"
+#include "rate.h"
+#include "remote.h"
+#include "replay.h"
+#include "utils.h"
+
+// How often runs that exited are reaped while waiting for a slot
+#define PARMAP_RECHECK_MS	10
+
+/**
+ * A command template, lowered once for all the runs.
+ */
+struct parmap_template {
+	char **argv;
+	int argc;
+	char *path;	/* CMD found in PATH, NULL to search on each run */
+	bool has_slot;	/* some ARG holds '{}' */
+};
+
+struct parmap_batch {
+	char **lines;
+	int n;
+};
+
+/**
+ * The runs in flight, and the MINISHELL_SLOTS slot each holds (see fair.h).
+ */
+struct parmap_runs {
+	pid_t *pids;
+	int *held;
+	int njobs;
+	int running;
+	bool failed;
+};
+
+static bool parmap_executable(const char *path)
+{
+	struct stat st;
+
+	return stat(path, &st) == 0 && S_ISREG(st.st_mode)
+		&& access(path, X_OK) == 0;
+}
+
+/**
+ * Find name in PATH once, instead of on each exec. Like execvp(), entries
+ * holding a directory or a file that cannot be run are skipped.
+ *
+ * @return the path of the file to run (to be freed by the caller), or NULL
+ * if there is none or name holds '{}'
+ */
+static char *parmap_resolve(const char *name)
+{
+	const char *path = getenv("PATH");
+	struct word_buf buf = { NULL, 0, 0 };
+
+	if (strstr(name, "{}") != NULL)
+		return NULL;
+
+	if (strchr(name, '/') != NULL) {
+		if (!parmap_executable(name))
+			return NULL;
+
+		word_buf_append(&buf, name, strlen(name));
+		return buf.data;
+	}
+
+	if (path == NULL)
+		path = "/bin:/usr/bin";
+
+	for (const char *p = path; ; p++) {
+		const char *end = strchrnul(p, ':');
+
+		buf.len = 0;
+		word_buf_append(&buf, p, end - p);
+		if (end == p)
+			word_buf_append(&buf, ".", 1);
+		word_buf_append(&buf, "/", 1);
+		word_buf_append(&buf, name, strlen(name));
+
+		if (parmap_executable(buf.data))
+			return buf.data;
+
+		p = end;
+		if (*p == '\0')
+			break;
+	}
+
+	free(buf.data);
+
+	return NULL;
+}
+
+/**
+ * Append the words of one run to args: the template with the lines of the
+ * batch in place of '{}'.
+ */
+static void parmap_expand(const struct parmap_template *t,
+		const struct parmap_batch *b, char ***args, int *nargs)
+{
+	int n = 0;
+
+	*args = malloc((t->argc + b->n + 1) * sizeof(**args));
+	DIE(*args == NULL, "Error allocating parmap arguments.");
+
+	for (int i = 0; i < t->argc; i++) {
+		const char *arg = t->argv[i];
+		const char *slot = strstr(arg, "{}");
+
+		if (!strcmp(arg, "{}")) {
+			for (int k = 0; k < b->n; k++)
+				(*args)[n++] = strdup(b->lines[k]);
+		} else if (slot != NULL) {
+			struct word_buf buf = { NULL, 0, 0 };
+
+			word_buf_append(&buf, arg, slot - arg);
+			for (int k = 0; k < b->n; k++) {
+				const char *line = b->lines[k];
+
+				if (k > 0)
+					word_buf_append(&buf, " ", 1);
+				word_buf_append(&buf, line, strlen(line));
+			}
+			word_buf_append(&buf, slot + 2, strlen(slot + 2));
+			(*args)[n++] = buf.data;
+		} else {
+			(*args)[n++] = strdup(arg);
+		}
+	}
+
+	if (!t->has_slot)
+		for (int k = 0; k < b->n; k++)
+			(*args)[n++] = strdup(b->lines[k]);
+
+	for (int i = 0; i < n; i++)
+		DIE((*args)[i] == NULL, "Error allocating parmap argument.");
+
+	(*args)[n] = NULL;
+	*nargs = n;
+}
+
+/**
+ * Read up to size lines into the batch.
+ *
+ * @return the number of lines read, -1 on error
+ */
+static int parmap_read(struct parmap_batch *b, int size)
+{
+	struct word_buf line = { NULL, 0, 0 };
+	int ret = 1;
+
+	for (b->n = 0; b->n < size && ret > 0; ) {
+		ret = input_read_line(STDIN_FILENO, '\n', &line);
+
+		// A last line without a newline still counts
+		if (ret < 0 || (ret == 0 && line.len == 0))
+			break;
+
+		b->lines[b->n] = strdup(line.data);
+		DIE(b->lines[b->n] == NULL, "Error allocating parmap line.");
+		b->n++;
+	}
+
+	free(line.data);
+
+	return ret < 0 ? -1 : b->n;
+}
+
+/**
+ * Reap one of the runs that exited, waiting for one if wait is set, and
+ * free its slot.
+ *
+ * @return false if none exited
+ */
+static bool parmap_reap(struct parmap_runs *r, bool wait)
+{
+	int status;
+	pid_t pid = proc->wait_any(r->pids, r->njobs, &status,
+			wait ? 0 : WNOHANG);
+
+	for (int i = 0; i < r->njobs && pid > 0; i++) {
+		if (r->pids[i] != pid)
+			continue;
+
+		r->pids[i] = 0;
+		fair_release(r->held[i]);
+		r->running--;
+		r->failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+
+		return true;
+	}
+
+	if (pid == 0 || r->running == 0)
+		return false;
+
+	if (errno != ECHILD)
+		perror("parmap");
+
+	// The runs can no longer be waited for: they count as failed
+	for (int i = 0; i < r->njobs; i++) {
+		if (r->pids[i] == 0)
+			continue;
+
+		r->pids[i] = 0;
+		fair_release(r->held[i]);
+	}
+
+	r->running = 0;
+	r->failed = true;
+
+	return false;
+}
+
+/**
+ * Take a MINISHELL_SLOTS slot for the next run. Runs that exit keep theirs
+ * until they are reaped, so they are reaped while waiting.
+ */
+static int parmap_acquire(struct parmap_runs *r)
+{
+	for (;;) {
+		int timeout_ms = r->running > 0 ? PARMAP_RECHECK_MS : -1;
+		int slot = fair_acquire(timeout_ms);
+
+		if (slot != FAIR_BUSY)
+			return slot;
+
+		while (parmap_reap(r, false))
+			;
+	}
+}
+
+/**
+ * Start one run. The shell is not copied: the child borrows its memory
+ * until it execs, which is all it does.
+ */
+static pid_t parmap_spawn(const struct parmap_template *t, char **args,
+		int null_fd)
+{
+	struct proc_child child = {
+		.argv = args, .path = t->path,
+		.stdin_fd = null_fd, .stdout_fd = -1
+	};
+
+	if (t->path == NULL)
+		replay_command_name(args[0]);
+
+	rate_wait();
+
+	return proc->start(&child);
+}
+
+static int parmap_usage(void)
+{
+	fprintf(stderr, "usage: parmap [-r] [-j N] [-n BATCH] CMD [ARG...]\n");
+
+	return 2;
+}
+
+/**
+ * Ship the runs to the workers of MINISHELL_WORKERS instead (see remote.h).
+ */
+static int parmap_remote(const struct parmap_template *t, int size)
+{
+	struct remote_pool *pool = remote_connect();
+	struct parmap_batch b = { calloc(size, sizeof(char *)), 0 };
+	bool failed = false;
+	int n;
+
+	DIE(b.lines == NULL, "Error allocating parmap.");
+
+	if (pool == NULL) {
+		fprintf(stderr, "parmap: no worker in MINISHELL_WORKERS\n");
+		free(b.lines);
+		return 2;
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+
+	while ((n = parmap_read(&b, size)) > 0) {
+		char **args;
+		int nargs;
+
+		parmap_expand(t, &b, &args, &nargs);
+		remote_submit(pool, args);
+
+		free_argv(args, nargs);
+		for (int k = 0; k < b.n; k++)
+			free(b.lines[k]);
+	}
+
+	failed |= n < 0;
+	failed |= !remote_finish(pool);
+	free(b.lines);
+
+	return failed ? 123 : 0;
+}
+
+int parmap_run(int argc, char **argv)
+{
+	struct parmap_template t = { NULL, 0, NULL, false };
+	int njobs = jobs_limit(), size = 1;
+	bool remote = false;
+	int i;
+
+	for (i = 1; i + 1 < argc && argv[i][0] == '-'; i += 2) {
+		if (!strcmp(argv[i], "-r")) {
+			remote = true;
+			i--;
+			continue;
+		}
+
+		int value = atoi(argv[i + 1]);
+
+		if (value <= 0)
+			return parmap_usage();
+
+		if (!strcmp(argv[i], "-j"))
+			njobs = value;
+		else if (!strcmp(argv[i], "-n"))
+			size = value;
+		else
+			return parmap_usage();
+	}
+
+	if (i >= argc)
+		return parmap_usage();
+
+	t.argv = argv + i;
+	t.argc = argc - i;
+	for (int k = 0; k < t.argc; k++)
+		t.has_slot |= strstr(t.argv[k], "{}") != NULL;
+
+	if (remote)
+		return parmap_remote(&t, size);
+
+	// A replay runs the stub of a command given by its path
+	replay_command_name(t.argv[0]);
+
+	// A CMD holding '{}' is only known, and looked up, on each run
+	t.path = parmap_resolve(t.argv[0]);
+	if (t.path == NULL && strstr(t.argv[0], "{}") == NULL) {
+		fprintf(stderr, "parmap: %s: command not found\n", t.argv[0]);
+		return 127;
+	}
+
+	// Runs must not take the lines still to be read
+	int null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+	struct parmap_batch b = { calloc(size, sizeof(char *)), 0 };
+	struct parmap_runs r = { calloc(njobs, sizeof(pid_t)),
+		calloc(njobs, sizeof(int)), njobs, 0, false };
+	int slot = 0;
+
+	DIE(b.lines == NULL || r.pids == NULL || r.held == NULL,
+			"Error allocating parmap.");
+
+	fflush(stdout);
+	fflush(stderr);
+
+	for (;;) {
+		// Backpressure: no more input is read while all slots are busy
+		if (r.running == njobs)
+			parmap_reap(&r, true);
+
+		int n = parmap_read(&b, size);
+
+		if (n <= 0) {
+			r.failed |= n < 0;
+			break;
+		}
+
+		char **args;
+		int nargs;
+
+		parmap_expand(&t, &b, &args, &nargs);
+
+		// Runs share MINISHELL_SLOTS with the other sessions
+		int held = parmap_acquire(&r);
+
+		while (r.pids[slot] != 0)
+			slot = (slot + 1) % njobs;
+
+		r.held[slot] = held;
+		r.pids[slot] = parmap_spawn(&t, args, null_fd);
+		if (r.pids[slot] < 0) {
+			perror("parmap");
+			fair_release(held);
+			r.pids[slot] = 0;
+			r.failed = true;
+		} else {
+			r.running++;
+		}
+
+		free_argv(args, nargs);
+		for (int k = 0; k < b.n; k++)
+			free(b.lines[k]);
+	}
+
+	while (r.running > 0)
+		parmap_reap(&r, true);
+
+	if (null_fd >= 0)
+		close(null_fd);
+	free(t.path);
+	free(b.lines);
+	free(r.pids);
+	free(r.held);
+
+	return r.failed ? 123 : 0;
+}
@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _PARMAP_H
+#define _PARMAP_H
+
+/**
+ * 'parmap [-r] [-j N] [-n BATCH] CMD [ARG...]': run CMD once per BATCH (default
+ * 1) lines of the standard input, at most N (default MINISHELL_JOBS, see
+ * jobs.h) at a time, like 'xargs -P N -n BATCH'.
+ *
+ * An ARG that is exactly '{}' is replaced by the lines, one argument each;
+ * '{}' inside a longer ARG by the lines joined with spaces. Without any
+ * '{}', the lines are appended to the arguments.
+ *
+ * The template is prepared once: its '{}' are located and CMD is looked up
+ * in PATH, so each run is a single posix_spawn(), not a fork of the
+ * whole shell. Input is read in blocks (see input.h), but only as fast as runs
+ * finish: once N are running, nothing more is read until one exits. The
+ * runs share the shell's standard output and error and read /dev/null.
+ *
+ * With -r, the runs go to the worker daemons of MINISHELL_WORKERS instead,
+ * as many at a time as they have slots (see remote.h); -j is ignored.
+ *
+ * @return 0 if every run succeeded, 123 if any failed (as xargs), 127 if
+ * CMD is not an executable file, 2 on a usage error
+ */
+int parmap_run(int argc, char **argv);
+
+#endif /* _PARMAP_H */
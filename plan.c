@@ -0,0 +1,251 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "account.h"
+#include "case.h"
+#include "cmd.h"
+#include "graph.h"
+#include "plan.h"
+#include "redir.h"
+#include "utils.h"
+
+/**
+ * Copy a single word with all its parts.
+ */
+static word_t *plan_clone_one(const word_t *w)
+{
+	word_t *copy = calloc(1, sizeof(*copy));
+
+	DIE(copy == NULL, "Error allocating plan word.");
+
+	copy->string = strdup(w->string);
+	DIE(copy->string == NULL, "Error allocating plan word.");
+	copy->expand = w->expand;
+
+	if (w->next_part != NULL)
+		copy->next_part = plan_clone_one(w->next_part);
+
+	return copy;
+}
+
+word_t *plan_clone_word(const word_t *w)
+{
+	word_t *head = NULL;
+	word_t **tail = &head;
+
+	// Iterate over the words, recurse only over their (few) parts
+	for (; w != NULL; w = w->next_word) {
+		*tail = plan_clone_one(w);
+		tail = &(*tail)->next_word;
+	}
+
+	return head;
+}
+
+void plan_free_word(word_t *w)
+{
+	while (w != NULL) {
+		word_t *next = w->next_word;
+
+		plan_free_word(w->next_part);
+		free((char *)w->string);
+		free(w);
+
+		w = next;
+	}
+}
+
+static simple_command_t *plan_clone_simple(const simple_command_t *s,
+		command_t *up)
+{
+	simple_command_t *copy = calloc(1, sizeof(*copy));
+
+	DIE(copy == NULL, "Error allocating plan command.");
+
+	// fd redirection markers may sit anywhere among verb and parameters
+	word_t *words = plan_clone_one(s->verb);
+
+	words->next_word = plan_clone_word(s->params);
+	copy->aux = redir_extract(&words);
+
+	// A command made only of redirections runs the no-op builtin
+	if (words == NULL) {
+		words = calloc(1, sizeof(*words));
+		DIE(words == NULL, "Error allocating plan word.");
+		words->string = strdup(":");
+		DIE(words->string == NULL, "Error allocating plan word.");
+	}
+
+	copy->verb = words;
+	copy->params = words->next_word;
+	words->next_word = NULL;
+
+	copy->in = plan_clone_word(s->in);
+	copy->out = plan_clone_word(s->out);
+	copy->err = plan_clone_word(s->err);
+	copy->io_flags = s->io_flags;
+	copy->up = up;
+
+	return copy;
+}
+
+const struct fd_redir *plan_redirections(const simple_command_t *s)
+{
+	return s != NULL ? s->aux : NULL;
+}
+
+command_t *plan_clone_command(const command_t *c, command_t *up)
+{
+	if (c == NULL)
+		return NULL;
+
+	command_t *copy = calloc(1, sizeof(*copy));
+
+	DIE(copy == NULL, "Error allocating plan command.");
+
+	copy->up = up;
+	copy->op = c->op;
+	copy->cmd1 = plan_clone_command(c->cmd1, copy);
+	copy->cmd2 = plan_clone_command(c->cmd2, copy);
+
+	if (c->scmd != NULL)
+		copy->scmd = plan_clone_simple(c->scmd, copy);
+
+	return copy;
+}
+
+void plan_free_command(command_t *c)
+{
+	if (c == NULL)
+		return;
+
+	plan_free_command(c->cmd1);
+	plan_free_command(c->cmd2);
+
+	if (c->scmd != NULL) {
+		plan_free_word(c->scmd->verb);
+		plan_free_word(c->scmd->params);
+		plan_free_word(c->scmd->in);
+		plan_free_word(c->scmd->out);
+		plan_free_word(c->scmd->err);
+		redir_free(c->scmd->aux);
+		free(c->scmd);
+	}
+
+	free(c);
+}
+
+bool plan_incomplete(const char *text)
+{
+	if (graph_is_graph(text))
+		return graph_incomplete(text);
+
+	return case_is_case(text) && case_incomplete(text);
+}
+
+struct plan *plan_compile(const char *line)
+{
+	struct plan *plan;
+
+	if (case_is_case(line)) {
+		struct case_stmt *stmt = case_compile(line);
+
+		if (stmt == NULL)
+			return NULL;
+
+		plan = calloc(1, sizeof(*plan));
+		DIE(plan == NULL, "Error allocating plan.");
+
+		plan->kind = PLAN_CASE;
+		plan->case_stmt = stmt;
+
+		return plan;
+	}
+
+	if (graph_is_graph(line)) {
+		struct graph *g = graph_compile(line);
+
+		if (g == NULL)
+			return NULL;
+
+		plan = calloc(1, sizeof(*plan));
+		DIE(plan == NULL, "Error allocating plan.");
+
+		plan->kind = PLAN_GRAPH;
+		plan->graph = g;
+
+		return plan;
+	}
+
+	command_t *root = NULL;
+	char *text = redir_rewrite(line);
+
+	enum account_site prev = account_enter(ACCOUNT_PARSER);
+
+	parse_line(text, &root);
+	account_leave(prev);
+
+	if (root == NULL) {
+		free_parse_memory();
+		free(text);
+		return NULL;
+	}
+
+	plan = calloc(1, sizeof(*plan));
+	DIE(plan == NULL, "Error allocating plan.");
+
+	plan->kind = PLAN_COMMAND;
+	plan->cmd = plan_clone_command(root, NULL);
+
+	// Nothing points into the parser's arena anymore
+	free_parse_memory();
+	free(text);
+
+	return plan;
+}
+
+int plan_run(struct plan *plan)
+{
+	if (plan == NULL)
+		return 0;
+
+	switch (plan->kind) {
+	case PLAN_COMMAND:
+		return parse_command(plan->cmd, 0, NULL);
+	case PLAN_CASE:
+		return case_run(plan->case_stmt);
+	case PLAN_GRAPH:
+		return graph_run(plan->graph);
+	default:
+		return -1;
+	}
+}
+
+bool plan_in_shell(const struct plan *plan)
+{
+	if (plan == NULL)
+		return false;
+
+	switch (plan->kind) {
+	case PLAN_COMMAND:
+		return cmd_in_shell(plan->cmd);
+	case PLAN_GRAPH:
+		return false;
+	default:
+		return true;
+	}
+}
+
+void plan_free(struct plan *plan)
+{
+	if (plan == NULL)
+		return;
+
+	plan_free_command(plan->cmd);
+	case_free(plan->case_stmt);
+	graph_free(plan->graph);
+	free(plan);
+}
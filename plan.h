@@ -0,0 +1,76 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _PLAN_H
+#define _PLAN_H
+
+#include <stdbool.h>
+
+#include "../util/parser/parser.h"
+
+struct case_stmt;
+struct fd_redir;
+struct graph;
+
+enum plan_kind {
+	PLAN_COMMAND,
+	PLAN_CASE,
+	PLAN_GRAPH
+};
+
+/**
+ * A lowered command line. The parser keeps everything it builds in one
+ * global arena, so the tree is copied out of it right after parsing; plans
+ * can therefore be kept, nested and run while other lines get parsed.
+ */
+struct plan {
+	enum plan_kind kind;
+	command_t *cmd;			/* PLAN_COMMAND */
+	struct case_stmt *case_stmt;	/* PLAN_CASE */
+	struct graph *graph;		/* PLAN_GRAPH */
+};
+
+/**
+ * Return the fd redirections the parser does not know about (see redir.h)
+ * of a simple command: a plan keeps them in its aux field, which is NULL
+ * for the commands the parser built.
+ */
+const struct fd_redir *plan_redirections(const simple_command_t *s);
+
+/**
+ * Parse and lower a command line.
+ *
+ * @return the plan, or NULL for an empty line or a parse error
+ */
+struct plan *plan_compile(const char *line);
+
+/**
+ * Check if text opens a multi-line construct (case ... esac, graph ... end)
+ * that is not closed yet, so more lines must be read before compiling it.
+ */
+bool plan_incomplete(const char *text);
+
+/**
+ * Execute a plan in the current shell.
+ *
+ * @return the exit status, or SHELL_EXIT
+ */
+int plan_run(struct plan *plan);
+
+/**
+ * Check if running a plan may change the state of the shell itself (see
+ * cmd_in_shell()). The commands of a graph all run in children; a case is
+ * assumed to.
+ */
+bool plan_in_shell(const struct plan *plan);
+
+void plan_free(struct plan *plan);
+
+/**
+ * Deep copies of parser structures and their release.
+ */
+word_t *plan_clone_word(const word_t *w);
+command_t *plan_clone_command(const command_t *c, command_t *up);
+void plan_free_word(word_t *w);
+void plan_free_command(command_t *c);
+
+#endif /* _PLAN_H */
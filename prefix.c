@@ -0,0 +1,633 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "retry.h"
+#include "prefix.h"
+
+#define DEFAULT_NICE		10
+
+/* ioprio_set() has no C library wrapper. */
+#define IOPRIO_WHO_PROCESS	1
+#define IOPRIO_CLASS_SHIFT	13
+#define IOPRIO_PRIO_VALUE(class, data)	\
+	(((class) << IOPRIO_CLASS_SHIFT) | (data))
+
+static const struct {
+	char option;
+	int resource;
+	rlim_t unit;
+} ulimit_options[] = {
+	{ 'c', RLIMIT_CORE, 1024 },
+	{ 'd', RLIMIT_DATA, 1024 },
+	{ 'f', RLIMIT_FSIZE, 1024 },
+	{ 'm', RLIMIT_RSS, 1024 },
+	{ 'n', RLIMIT_NOFILE, 1 },
+	{ 's', RLIMIT_STACK, 1024 },
+	{ 't', RLIMIT_CPU, 1 },
+	{ 'u', RLIMIT_NPROC, 1 },
+	{ 'v', RLIMIT_AS, 1024 },
+};
+
+/* ionice classes, by number. */
+static const char * const ioprio_classes[] = {
+	"none", "realtime", "best-effort", "idle"
+};
+
+bool prefix_is_name(const char *name)
+{
+	return !strcmp(name, "nice") || !strcmp(name, "ionice")
+		|| !strcmp(name, "taskset") || !strcmp(name, "ulimit")
+		|| !strcmp(name, "pure") || !strcmp(name, "@in")
+		|| !strcmp(name, "@out") || !strcmp(name, "@make")
+		|| !strcmp(name, "memo") || !strcmp(name, "retry");
+}
+
+static bool parse_int(const char *s, long *value)
+{
+	char *end;
+
+	if (s == NULL || *s == '\0')
+		return false;
+
+	*value = strtol(s, &end, 10);
+
+	return *end == '\0';
+}
+
+/**
+ * Parse a CPU list such as "0-3,8,10-11".
+ */
+static bool parse_cpu_list(const char *s, cpu_set_t *cpus)
+{
+	CPU_ZERO(cpus);
+
+	while (*s != '\0') {
+		char *end;
+		long lo = strtol(s, &end, 10), hi = lo;
+
+		if (end == s)
+			return false;
+
+		if (*end == '-') {
+			s = end + 1;
+			hi = strtol(s, &end, 10);
+			if (end == s)
+				return false;
+		}
+
+		if (lo < 0 || hi < lo || hi >= CPU_SETSIZE)
+			return false;
+
+		for (long cpu = lo; cpu <= hi; cpu++)
+			CPU_SET(cpu, cpus);
+
+		if (*end == ',')
+			end++;
+		else if (*end != '\0')
+			return false;
+
+		s = end;
+	}
+
+	return true;
+}
+
+static bool parse_cpu_mask(const char *s, cpu_set_t *cpus)
+{
+	int cpu = 0;
+
+	CPU_ZERO(cpus);
+
+	if (!strncmp(s, "0x", 2) || !strncmp(s, "0X", 2))
+		s += 2;
+
+	// Hex digits, least significant last
+	for (const char *p = s + strlen(s); p > s; ) {
+		char c = *--p;
+		int digit;
+
+		if (c >= '0' && c <= '9')
+			digit = c - '0';
+		else if (c >= 'a' && c <= 'f')
+			digit = c - 'a' + 10;
+		else if (c >= 'A' && c <= 'F')
+			digit = c - 'A' + 10;
+		else
+			return false;
+
+		for (int bit = 0; bit < 4; bit++, cpu++)
+			if ((digit & (1 << bit)) && cpu < CPU_SETSIZE)
+				CPU_SET(cpu, cpus);
+	}
+
+	return *s != '\0';
+}
+
+/**
+ * Take the value of the option argv[*i] if it is -name or --long_name (if
+ * not NULL), attached as in '-n5' and '--adjustment=5' or in the next word,
+ * and move *i past it.
+ *
+ * @return the value, or NULL if argv[*i] is another option or the value is
+ * missing
+ */
+static const char *option_value(char **argv, int argc, int *i, char name,
+		const char *long_name)
+{
+	const char *arg = argv[*i];
+	size_t len = long_name != NULL ? strlen(long_name) : 0;
+	bool attached;
+
+	if (arg[0] == '-' && arg[1] == name) {
+		arg += 2;
+		attached = *arg != '\0';
+	} else if (long_name != NULL && !strncmp(arg, "--", 2)
+			&& !strncmp(arg + 2, long_name, len)
+			&& (arg[2 + len] == '\0' || arg[2 + len] == '=')) {
+		arg += 2 + len;
+		attached = *arg == '=';
+		arg += attached;
+	} else {
+		return NULL;
+	}
+
+	if (attached) {
+		(*i)++;
+		return arg;
+	}
+
+	if (*i + 1 >= argc)
+		return NULL;
+
+	*i += 2;
+
+	return argv[*i - 1];
+}
+
+/*
+ * nice, ionice and taskset are also real tools. Given options the shell
+ * does not know (e.g. 'taskset -p'), these parsers return the index of the
+ * tool itself, which then runs as the command.
+ */
+
+static int parse_nice(char **argv, int argc, int i, struct prefix_attrs *attrs)
+{
+	long value = DEFAULT_NICE;
+	bool given = false;
+	int start = i;
+
+	for (i++; i < argc && argv[i][0] == '-'; given = true) {
+		if (!strcmp(argv[i], "--")) {
+			i++;
+			break;
+		}
+
+		// '-N' is the obsolete form of '-n N'
+		if (parse_int(argv[i] + 1, &value)) {
+			i++;
+			continue;
+		}
+
+		if (!parse_int(option_value(argv, argc, &i, 'n',
+						"adjustment"), &value))
+			return start;
+	}
+
+	attrs->has_nice = true;
+	attrs->nice_given = given;
+	attrs->nice = value;
+
+	return i;
+}
+
+/**
+ * Parse an ionice class, by number or by name.
+ */
+static bool parse_ioprio_class(const char *s, int *class)
+{
+	long value;
+
+	for (int c = 0; c < 4 && s != NULL; c++)
+		if (!strcasecmp(s, ioprio_classes[c])) {
+			*class = c;
+			return true;
+		}
+
+	if (!parse_int(s, &value) || value < 0 || value > 3)
+		return false;
+
+	*class = value;
+
+	return true;
+}
+
+static int parse_ionice(char **argv, int argc, int i,
+		struct prefix_attrs *attrs)
+{
+	int class = 2, level = 4;	/* best effort */
+	bool given = false;
+	int start = i;
+
+	for (i++; i < argc && argv[i][0] == '-'; given = true) {
+		const char *arg;
+		long value;
+
+		if (!strcmp(argv[i], "--")) {
+			i++;
+			break;
+		}
+
+		arg = option_value(argv, argc, &i, 'c', "class");
+		if (arg != NULL) {
+			if (!parse_ioprio_class(arg, &class))
+				return start;
+			continue;
+		}
+
+		arg = option_value(argv, argc, &i, 'n', "classdata");
+		if (!parse_int(arg, &value) || value < 0 || value > 7)
+			return start;
+		level = value;
+	}
+
+	attrs->has_ioprio = true;
+	attrs->ioprio_given = given;
+	attrs->ioprio_class = class;
+	attrs->ioprio_level = level;
+
+	return i;
+}
+
+static int parse_taskset(char **argv, int argc, int i,
+		struct prefix_attrs *attrs)
+{
+	bool list = false;
+	int start = i;
+
+	for (i++; i < argc && argv[i][0] == '-'; i++) {
+		if (!strcmp(argv[i], "--")) {
+			i++;
+			break;
+		}
+
+		if (strcmp(argv[i], "-c") && strcmp(argv[i], "--cpu-list"))
+			return start;
+		list = true;
+	}
+
+	if (i >= argc)
+		return start;
+
+	if (list ? !parse_cpu_list(argv[i], &attrs->cpus)
+			: !parse_cpu_mask(argv[i], &attrs->cpus))
+		return start;
+
+	attrs->has_affinity = true;
+
+	return i + 1;
+}
+
+static void print_limit(int resource, rlim_t unit)
+{
+	struct rlimit limit;
+
+	if (getrlimit(resource, &limit) < 0) {
+		perror("ulimit");
+		return;
+	}
+
+	if (limit.rlim_cur == RLIM_INFINITY)
+		printf("unlimited\n");
+	else
+		printf("%llu\n", (unsigned long long)(limit.rlim_cur / unit));
+}
+
+static int parse_ulimit(char **argv, int argc, int i,
+		struct prefix_attrs *attrs)
+{
+	for (i++; i < argc && argv[i][0] == '-'; i++) {
+		size_t opt;
+
+		for (opt = 0; opt < sizeof(ulimit_options)
+				/ sizeof(ulimit_options[0]); opt++)
+			if (argv[i][1] == ulimit_options[opt].option
+					&& argv[i][2] == '\0')
+				break;
+
+		if (opt == sizeof(ulimit_options) / sizeof(ulimit_options[0]))
+			return -1;
+
+		int resource = ulimit_options[opt].resource;
+		rlim_t unit = ulimit_options[opt].unit;
+
+		// A bare option queries the current limit
+		if (i + 1 == argc) {
+			print_limit(resource, unit);
+			continue;
+		}
+
+		rlim_t value;
+		long number;
+
+		if (!strcmp(argv[i + 1], "unlimited"))
+			value = RLIM_INFINITY;
+		else if (parse_int(argv[i + 1], &number) && number >= 0)
+			value = (rlim_t)number * unit;
+		else
+			return -1;
+
+		if (attrs->nlimits == PREFIX_MAX_LIMITS)
+			return -1;
+
+		attrs->limits[attrs->nlimits].resource = resource;
+		attrs->limits[attrs->nlimits].limit.rlim_cur = value;
+		attrs->limits[attrs->nlimits].limit.rlim_max = value;
+		attrs->nlimits++;
+		i++;
+	}
+
+	return i;
+}
+
+static int parse_pure(char **argv, int argc, int i, struct prefix_attrs *attrs)
+{
+	attrs->pure = true;
+
+	for (i++; i < argc && argv[i][0] == '-'; i += 2) {
+		bool write = !strcmp(argv[i], "-w");
+
+		if ((!write && strcmp(argv[i], "-r")) || i + 1 >= argc
+				|| attrs->nfiles == PREFIX_MAX_FILES)
+			return -1;
+
+		attrs->files[attrs->nfiles].arg = i + 1;
+		attrs->files[attrs->nfiles].write = write;
+		attrs->nfiles++;
+	}
+
+	return i;
+}
+
+static int parse_make(char **argv, int argc, int i, struct prefix_attrs *attrs)
+{
+	attrs->make = true;
+
+	if (!strcmp(argv[i], "@make"))
+		return i + 1;
+
+	if (i + 1 >= argc || attrs->nfiles == PREFIX_MAX_FILES)
+		return -1;
+
+	attrs->files[attrs->nfiles].arg = i + 1;
+	attrs->files[attrs->nfiles].write = !strcmp(argv[i], "@out");
+	attrs->nfiles++;
+
+	return i + 2;
+}
+
+static int parse_memo(char **argv, int argc, int i, struct prefix_attrs *attrs)
+{
+	attrs->memo = true;
+
+	for (i++; i < argc && argv[i][0] == '-'; i += 2) {
+		if (i + 1 >= argc)
+			return -1;
+
+		if (!strcmp(argv[i], "-e") && attrs->nenv < PREFIX_MAX_FILES) {
+			attrs->env_args[attrs->nenv++] = i + 1;
+		} else if (!strcmp(argv[i], "-i")
+				&& attrs->nfiles < PREFIX_MAX_FILES) {
+			attrs->files[attrs->nfiles].arg = i + 1;
+			attrs->files[attrs->nfiles].write = false;
+			attrs->nfiles++;
+		} else {
+			return -1;
+		}
+	}
+
+	return i;
+}
+
+/**
+ * Parse a list of exit codes such as "1,75-78" into the retry bitmap.
+ */
+static bool parse_codes(const char *s, struct prefix_attrs *attrs)
+{
+	attrs->has_retry_codes = true;
+
+	while (*s != '\0') {
+		char *end;
+		long lo = strtol(s, &end, 10), hi = lo;
+
+		if (end == s)
+			return false;
+
+		if (*end == '-') {
+			s = end + 1;
+			hi = strtol(s, &end, 10);
+			if (end == s)
+				return false;
+		}
+
+		if (lo < 0 || hi > 255 || lo > hi)
+			return false;
+
+		for (long code = lo; code <= hi; code++)
+			attrs->retry_codes[code / 64] |= 1ULL << (code % 64);
+
+		s = end;
+		if (*s == ',')
+			s++;
+		else if (*s != '\0')
+			return false;
+	}
+
+	return true;
+}
+
+static int parse_retry(char **argv, int argc, int i,
+		struct prefix_attrs *attrs)
+{
+	long value;
+
+	attrs->attempts = RETRY_DEFAULT_ATTEMPTS;
+	attrs->backoff_ms = RETRY_DEFAULT_BACKOFF_MS;
+
+	for (i++; i < argc && argv[i][0] == '-'; ) {
+		char option = argv[i][1];
+		const char *arg = NULL;
+
+		if (!strcmp(argv[i], "--"))
+			return i + 1;
+
+		// The value may be attached, as in -n3
+		if (option != '\0' && strchr("nbtc", option) != NULL)
+			arg = option_value(argv, argc, &i, option, NULL);
+		if (arg == NULL)
+			return -1;
+
+		if (option == 'c') {
+			if (!parse_codes(arg, attrs))
+				return -1;
+			continue;
+		}
+
+		if (!parse_int(arg, &value) || value < 0)
+			return -1;
+
+		if (option == 'n' && value > 0)
+			attrs->attempts = value;
+		else if (option == 'b')
+			attrs->backoff_ms = value;
+		else if (option == 't')
+			attrs->timeout_ms = value * 1000;
+		else
+			return -1;
+	}
+
+	return i;
+}
+
+int prefix_parse(char **argv, int argc, struct prefix_attrs *attrs)
+{
+	int i = 0, next;
+
+	memset(attrs, 0, sizeof(*attrs));
+
+	while (i < argc && prefix_is_name(argv[i])) {
+		const char *prefix = argv[i];
+
+		if (!strcmp(prefix, "nice"))
+			next = parse_nice(argv, argc, i, attrs);
+		else if (!strcmp(prefix, "ionice"))
+			next = parse_ionice(argv, argc, i, attrs);
+		else if (!strcmp(prefix, "taskset"))
+			next = parse_taskset(argv, argc, i, attrs);
+		else if (!strcmp(prefix, "pure"))
+			next = parse_pure(argv, argc, i, attrs);
+		else if (!strcmp(prefix, "memo"))
+			next = parse_memo(argv, argc, i, attrs);
+		else if (!strcmp(prefix, "retry"))
+			next = parse_retry(argv, argc, i, attrs);
+		else if (prefix[0] == '@')
+			next = parse_make(argv, argc, i, attrs);
+		else
+			next = parse_ulimit(argv, argc, i, attrs);
+
+		if (next < 0) {
+			fprintf(stderr, "%s: invalid arguments\n", prefix);
+			return -1;
+		}
+
+		// The real tool runs for options only it knows
+		if (next == i)
+			break;
+		i = next;
+	}
+
+	return i;
+}
+
+int prefix_apply(const struct prefix_attrs *attrs)
+{
+	for (int i = 0; i < attrs->nlimits; i++) {
+		struct rlimit limit = attrs->limits[i].limit;
+		struct rlimit current;
+
+		// Never try to raise the hard limit of an unprivileged process
+		if (getrlimit(attrs->limits[i].resource, &current) == 0
+				&& limit.rlim_max > current.rlim_max)
+			limit.rlim_max = current.rlim_max;
+		if (limit.rlim_cur > limit.rlim_max)
+			limit.rlim_cur = limit.rlim_max;
+
+		if (setrlimit(attrs->limits[i].resource, &limit) < 0) {
+			perror("ulimit");
+			return -1;
+		}
+	}
+
+	if (attrs->has_nice) {
+		// Like nice(1), the niceness is relative to the current one
+		errno = 0;
+		int prio = getpriority(PRIO_PROCESS, 0);
+
+		if ((prio == -1 && errno != 0) || setpriority(PRIO_PROCESS, 0,
+					prio + attrs->nice) < 0) {
+			perror("nice");
+			return -1;
+		}
+	}
+
+	if (attrs->has_ioprio) {
+		int prio = IOPRIO_PRIO_VALUE(attrs->ioprio_class,
+				attrs->ioprio_level);
+
+		if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, prio) < 0) {
+			perror("ionice");
+			return -1;
+		}
+	}
+
+	if (attrs->has_affinity
+			&& sched_setaffinity(0, sizeof(attrs->cpus),
+				&attrs->cpus) < 0) {
+		perror("taskset");
+		return -1;
+	}
+
+	return 0;
+}
+
+int prefix_apply_shell(const struct prefix_attrs *attrs)
+{
+	if ((attrs->has_nice && attrs->nice_given) || attrs->has_affinity
+			|| (attrs->has_ioprio && attrs->ioprio_given)) {
+		fprintf(stderr, "%s: a command must be given\n",
+				attrs->has_affinity ? "taskset"
+				: attrs->has_nice ? "nice" : "ionice");
+		return EXIT_FAILURE;
+	}
+
+	// The limits are the shell's own, and its children's
+	struct prefix_attrs limits = { .nlimits = attrs->nlimits };
+
+	memcpy(limits.limits, attrs->limits, sizeof(limits.limits));
+	if (prefix_apply(&limits) < 0)
+		return EXIT_FAILURE;
+
+	if (attrs->has_nice) {
+		errno = 0;
+		int prio = getpriority(PRIO_PROCESS, 0);
+
+		if (prio == -1 && errno != 0) {
+			perror("nice");
+			return EXIT_FAILURE;
+		}
+		printf("%d\n", prio);
+	}
+
+	if (attrs->has_ioprio) {
+		int prio = syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0);
+
+		if (prio < 0) {
+			perror("ionice");
+			return EXIT_FAILURE;
+		}
+		printf("%s: prio %d\n",
+				ioprio_classes[(prio >> IOPRIO_CLASS_SHIFT) & 3],
+				prio & 0xff);
+	}
+
+	return 0;
+}
@@ -0,0 +1,117 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _PREFIX_H
+#define _PREFIX_H
+
+#include <sched.h>
+#include <stdbool.h>
+#include <sys/resource.h>
+
+#define PREFIX_MAX_LIMITS	8
+#define PREFIX_MAX_FILES		16
+
+/**
+ * Process attributes requested by resource prefixes:
+ *
+ *   nice [-n N | -N] CMD              scheduling priority (default 10)
+ *   ionice [-c CLASS] [-n LEVEL] CMD  I/O scheduling class (a number or
+ *                                     a name) and level
+ *   taskset MASK CMD                  CPU affinity, hex mask
+ *   taskset -c LIST CMD               CPU affinity, list like 0-3,8
+ *   ulimit -c|d|f|m|n|s|t|u|v N CMD   resource limit (sizes in KiB)
+ *   pure [-r FILE] [-w FILE] CMD      no effect on CMD itself; declares it
+ *                                     independent (see autopar.h), with
+ *                                     the files it reads and writes
+ *   @in FILE CMD, @out FILE CMD       declare an input or output of CMD,
+ *   @make CMD                         which is skipped when its outputs
+ *                                     are up to date (see make.h)
+ *   memo [-e VAR] [-i FILE] CMD       replay CMD's output from a cache if
+ *                                     it ran with the same words, VARs and
+ *                                     FILE contents before (see memo.h)
+ *   retry [-n N] [-b MS] [-t SECS]    run CMD up to N times while it fails,
+ *         [-c CODES] CMD              backing off from MS milliseconds,
+ *                                     each run killed after SECS seconds
+ *                                     (see retry.h)
+ *
+ * Option values may be attached ('-n5', '-c3') or given in the long form
+ * of the tools ('--adjustment=5', '--class idle', '--cpu-list'). nice,
+ * ionice and taskset are real tools too: given options the shell does not
+ * know, the tool itself is run as the command.
+ *
+ * Prefixes can be chained. Instead of exec'ing one helper per prefix, the
+ * shell applies them itself in the child, right before the final exec, so
+ * a prefixed command still costs a single exec.
+ */
+struct prefix_attrs {
+	bool has_nice;
+	bool nice_given;	/* not the default adjustment */
+	int nice;
+
+	bool has_ioprio;
+	bool ioprio_given;	/* a class or level was given */
+	int ioprio_class;
+	int ioprio_level;
+
+	bool has_affinity;
+	cpu_set_t cpus;
+
+	int nlimits;
+	struct {
+		int resource;
+		struct rlimit limit;
+	} limits[PREFIX_MAX_LIMITS];
+
+	bool pure;
+	bool make;
+	bool memo;
+	int nfiles;
+	struct {
+		int arg;	/* index of the file name in argv */
+		bool write;
+	} files[PREFIX_MAX_FILES];
+
+	// Indexes in argv of the variable names given to 'memo -e'
+	int nenv;
+	int env_args[PREFIX_MAX_FILES];
+
+	// 'retry': no retries if attempts is 0, no timeout if timeout_ms is 0
+	int attempts;
+	long backoff_ms;
+	long timeout_ms;
+	bool has_retry_codes;
+	unsigned long long retry_codes[4];	/* bitmap of exit codes */
+};
+
+/**
+ * Check if name is a resource prefix.
+ */
+bool prefix_is_name(const char *name);
+
+/**
+ * Parse the resource prefixes at the start of argv into attrs. A bare
+ * 'ulimit -X' with no value prints the current soft limit.
+ *
+ * @return the index of the command following the prefixes (argc if there
+ * is none; that of the tool for options only the tool knows), or -1 on a
+ * syntax error, which is reported
+ */
+int prefix_parse(char **argv, int argc, struct prefix_attrs *attrs);
+
+/**
+ * Apply attrs to the calling process.
+ *
+ * @return 0 on success, -1 on error, which is reported
+ */
+int prefix_apply(const struct prefix_attrs *attrs);
+
+/**
+ * Run prefixes given without a command, in the shell itself. Like the
+ * real tools, only 'ulimit' changes anything: a bare 'nice' or 'ionice'
+ * prints the current setting, and an adjustment, a class or a CPU mask
+ * without a command is a usage error.
+ *
+ * @return the exit status
+ */
+int prefix_apply_shell(const struct prefix_attrs *attrs);
+
+#endif /* _PREFIX_H */
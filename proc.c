@@ -0,0 +1,568 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "proc.h"
+#include "retry.h"
+#include "utils.h"
+
+// How long a wait for one of several children sleeps between checks
+// when the kernel has no pidfds
+#define PROC_WAIT_POLL_NS	(1000 * 1000)
+
+extern char **environ;
+
+/*
+ * The real backend
+ */
+
+/**
+ * Give a child its input and output; async-signal-safe.
+ */
+static void proc_move_fds(const struct proc_child *child)
+{
+	if (child->stdin_fd > STDIN_FILENO) {
+		dup2(child->stdin_fd, STDIN_FILENO);
+		close(child->stdin_fd);
+	}
+
+	if (child->stdout_fd > STDOUT_FILENO) {
+		dup2(child->stdout_fd, STDOUT_FILENO);
+		close(child->stdout_fd);
+	}
+}
+
+/**
+ * Start a child that runs nothing of the shell with posix_spawn(), which
+ * neither copies the shell's memory nor runs anything before the exec.
+ *
+ * @return its pid; if the command cannot be executed, that of a child
+ * exiting with 127 like a failed exec, so that callers see no difference
+ */
+static pid_t real_spawn(const struct proc_child *child)
+{
+	posix_spawn_file_actions_t actions;
+	pid_t pid;
+	int err;
+
+	if (posix_spawn_file_actions_init(&actions) != 0)
+		return -1;
+
+	if (child->stdin_fd > STDIN_FILENO) {
+		posix_spawn_file_actions_adddup2(&actions, child->stdin_fd,
+				STDIN_FILENO);
+		posix_spawn_file_actions_addclose(&actions, child->stdin_fd);
+	}
+
+	if (child->stdout_fd > STDOUT_FILENO) {
+		posix_spawn_file_actions_adddup2(&actions, child->stdout_fd,
+				STDOUT_FILENO);
+		if (child->stdout_fd != child->stdin_fd)
+			posix_spawn_file_actions_addclose(&actions,
+					child->stdout_fd);
+	}
+
+	if (child->path != NULL)
+		err = posix_spawn(&pid, child->path, &actions, NULL,
+				child->argv, environ);
+	else
+		err = posix_spawnp(&pid, child->argv[0], &actions, NULL,
+				child->argv, environ);
+
+	posix_spawn_file_actions_destroy(&actions);
+
+	if (err == 0)
+		return pid;
+
+	if (err == ENOMEM || err == EAGAIN) {
+		errno = err;
+		return -1;
+	}
+
+	fprintf(stderr, "Execution failed for '%s'\n", child->argv[0]);
+
+	pid = vfork();
+	if (pid == 0)
+		_exit(127);
+
+	return pid;
+}
+
+static pid_t real_start(const struct proc_child *child)
+{
+	pid_t pid;
+
+	// Nothing of the shell runs in the child: it can borrow its memory
+	if (child->body == NULL && child->setup == NULL)
+		return real_spawn(child);
+
+	// Children must not inherit (and later repeat) pending output
+	fflush(stdout);
+	fflush(stderr);
+
+	pid = fork();
+	if (pid != 0)
+		return pid;
+
+	proc_move_fds(child);
+
+	if (child->setup != NULL && child->setup(child->arg) < 0)
+		child_exit(EXIT_FAILURE);
+
+	if (child->body != NULL) {
+		int ret = child->body(child->arg);
+
+		child_exit(ret < 0 ? EXIT_FAILURE : ret);
+	}
+
+	execvp(child->argv[0], child->argv);
+	fprintf(stderr, "Execution failed for '%s'\n", child->argv[0]);
+
+	// 127 is what a command not found exits with, and is never retried
+	child_exit(127);
+}
+
+static void real_sleep(int64_t ns);
+
+/**
+ * Block until one of pids may have exited: its pidfd is readable (or, on
+ * kernels without pidfds, a short while passed).
+ */
+static void real_wait_exit(const pid_t *pids, int n)
+{
+	struct pollfd *fds = calloc(n, sizeof(*fds));
+	bool pidfds = true;
+	int nfds = 0;
+
+	DIE(fds == NULL, "Error allocating pidfds.");
+
+	for (int i = 0; i < n && pidfds; i++) {
+		if (pids[i] <= 0)
+			continue;
+
+		fds[nfds].fd = syscall(SYS_pidfd_open, pids[i], 0);
+		fds[nfds].events = POLLIN;
+		pidfds = fds[nfds].fd >= 0;
+		nfds += pidfds;
+	}
+
+	// Interrupted, the caller just checks again
+	if (pidfds)
+		poll(fds, nfds, -1);
+	else
+		real_sleep(PROC_WAIT_POLL_NS);
+
+	for (int i = 0; i < nfds; i++)
+		close(fds[i].fd);
+	free(fds);
+}
+
+static pid_t real_wait_any(const pid_t *pids, int n, int *status,
+		int options)
+{
+	for (;;) {
+		bool any = false;
+
+		for (int i = 0; i < n; i++) {
+			if (pids[i] <= 0)
+				continue;
+
+			pid_t ret = waitpid(pids[i], status, WNOHANG);
+
+			if (ret != 0)
+				return ret;
+			any = true;
+		}
+
+		if (!any) {
+			errno = ECHILD;
+			return -1;
+		}
+
+		if (options & WNOHANG)
+			return 0;
+
+		real_wait_exit(pids, n);
+	}
+}
+
+static void real_sleep(int64_t ns)
+{
+	struct timespec until;
+
+	clock_gettime(CLOCK_MONOTONIC, &until);
+	until.tv_sec += ns / 1000000000;
+	until.tv_nsec += ns % 1000000000;
+	if (until.tv_nsec >= 1000000000) {
+		until.tv_sec++;
+		until.tv_nsec -= 1000000000;
+	}
+
+	// An absolute deadline survives being interrupted
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until,
+				NULL) == EINTR)
+		;
+}
+
+static const struct proc_backend real_backend = {
+	.name = "real",
+	.simulated = false,
+	.start = real_start,
+	.wait = waitpid,
+	.wait_any = real_wait_any,
+	.wait_timeout = retry_wait,
+	.sleep = real_sleep,
+	.pipe = pipe,
+};
+
+/*
+ * The simulated backend
+ */
+
+struct sim_rule {
+	char *name;		/* "*" for any other command */
+	int64_t ns, jitter_ns;
+	double fail;		/* probability, 0 to 1 */
+	int status;
+};
+
+/**
+ * A child that was started and not waited for yet.
+ */
+struct sim_proc {
+	pid_t pid;
+	int64_t start, end;
+	int status;
+};
+
+static struct sim_rule *rules;
+static int nrules;
+
+static int64_t sim_clock;
+static uint64_t sim_seed = 1;
+static pid_t last_pid;
+
+// Children not waited for; those from index mark on are the current
+// child's (or the shell's)
+static struct sim_proc *procs;
+static int nprocs, procs_size, mark;
+
+static uint64_t started, failed;
+
+/**
+ * xorshift64*: enough for the spec's jitter and failures, and the same
+ * for a given seed on every machine.
+ */
+static double sim_random(void)
+{
+	sim_seed ^= sim_seed >> 12;
+	sim_seed ^= sim_seed << 25;
+	sim_seed ^= sim_seed >> 27;
+
+	return (sim_seed * 2685821657736338717ULL >> 11) * 0x1.0p-53;
+}
+
+static void sim_load(const char *path)
+{
+	char name[256];
+	double ms, jitter_ms, fail;
+	int status;
+	char line[512];
+	FILE *f = fopen(path, "r");
+
+	if (f == NULL) {
+		perror(path);
+		return;
+	}
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		jitter_ms = fail = 0;
+		status = EXIT_FAILURE;
+
+		if (line[0] == '#' || sscanf(line, "%255s %lf %lf %lf %d",
+					name, &ms, &jitter_ms, &fail,
+					&status) < 2)
+			continue;
+
+		rules = realloc(rules, (nrules + 1) * sizeof(*rules));
+		DIE(rules == NULL, "Error allocating simulation spec.");
+
+		struct sim_rule *r = &rules[nrules++];
+
+		r->name = strdup(name);
+		DIE(r->name == NULL, "Error allocating simulation spec.");
+		r->ns = ms * 1e6;
+		r->jitter_ns = jitter_ms * 1e6;
+		r->fail = fail / 100;
+		r->status = status;
+	}
+
+	fclose(f);
+}
+
+static const struct sim_rule *sim_rule(const char *argv0)
+{
+	const char *name = strrchr(argv0, '/');
+	const struct sim_rule *other = NULL;
+
+	name = name != NULL ? name + 1 : argv0;
+
+	for (int i = 0; i < nrules; i++) {
+		if (!strcmp(rules[i].name, name))
+			return &rules[i];
+		if (!strcmp(rules[i].name, "*"))
+			other = &rules[i];
+	}
+
+	return other;
+}
+
+static pid_t sim_add(int64_t start, int64_t end, int status)
+{
+	if (nprocs == procs_size) {
+		procs_size = procs_size ? 2 * procs_size : 64;
+		procs = realloc(procs, procs_size * sizeof(*procs));
+		DIE(procs == NULL, "Error allocating simulated processes.");
+	}
+
+	struct sim_proc *p = &procs[nprocs++];
+
+	p->pid = ++last_pid;
+	p->start = start;
+	p->end = end;
+	p->status = status;
+
+	started++;
+	failed += status != 0;
+
+	return p->pid;
+}
+
+/**
+ * Make fd the shell's own fd target while a child runs in it.
+ *
+ * @return what target was, for sim_restore_fd(), or -1 if fd is -1
+ */
+static int sim_swap_fd(int fd, int target)
+{
+	if (fd < 0)
+		return -1;
+
+	fflush(stdout);
+
+	int saved = fcntl(target, F_DUPFD_CLOEXEC, SHELL_FD_MIN);
+
+	dup2(fd, target);
+
+	return saved;
+}
+
+static void sim_restore_fd(int saved, int target)
+{
+	if (saved < 0)
+		return;
+
+	fflush(stdout);
+	dup2(saved, target);
+	close(saved);
+}
+
+static pid_t sim_start(const struct proc_child *child)
+{
+	if (child->body == NULL) {
+		const struct sim_rule *r = sim_rule(child->argv[0]);
+		int64_t ns = 0;
+		int status = 0;
+
+		if (r != NULL) {
+			ns = r->ns + (2 * sim_random() - 1) * r->jitter_ns;
+			if (ns < 0)
+				ns = 0;
+			if (r->fail > 0 && sim_random() < r->fail)
+				status = r->status;
+		}
+
+		return sim_add(sim_clock, sim_clock + ns, status);
+	}
+
+	// The child runs now, in virtual time, from when it starts; the
+	// parent goes on from that same time
+	int64_t start = sim_clock;
+	int parent_mark = mark;
+	int saved_in = sim_swap_fd(child->stdin_fd, STDIN_FILENO);
+	int saved_out = sim_swap_fd(child->stdout_fd, STDOUT_FILENO);
+
+	mark = nprocs;
+
+	int ret = child->body(child->arg);
+
+	mark = parent_mark;
+
+	sim_restore_fd(saved_out, STDOUT_FILENO);
+	sim_restore_fd(saved_in, STDIN_FILENO);
+
+	int64_t end = sim_clock;
+
+	sim_clock = start;
+
+	return sim_add(start, end, ret < 0 ? EXIT_FAILURE : ret);
+}
+
+static pid_t sim_take(int found, int *status, int options);
+
+/**
+ * Find the child pid (or, for -1, the one that ends first) of the current
+ * child, and take it out of the table.
+ */
+static pid_t sim_wait(pid_t pid, int *status, int options)
+{
+	int found = -1;
+
+	for (int i = mark; i < nprocs; i++) {
+		if (pid > 0 ? procs[i].pid != pid : found >= 0
+				&& procs[i].end >= procs[found].end)
+			continue;
+		found = i;
+	}
+
+	if (found < 0) {
+		errno = ECHILD;
+		return -1;
+	}
+
+	return sim_take(found, status, options);
+}
+
+/**
+ * Reap the child found, moving the clock to when it ended.
+ */
+static pid_t sim_take(int found, int *status, int options)
+{
+	struct sim_proc p = procs[found];
+
+	if ((options & WNOHANG) && p.end > sim_clock)
+		return 0;
+
+	procs[found] = procs[--nprocs];
+	if (p.end > sim_clock)
+		sim_clock = p.end;
+
+	if (status != NULL)
+		*status = p.status << 8;
+
+	return p.pid;
+}
+
+static pid_t sim_wait_any(const pid_t *pids, int n, int *status,
+		int options)
+{
+	int found = -1;
+
+	for (int i = mark; i < nprocs; i++) {
+		if (found >= 0 && procs[i].end >= procs[found].end)
+			continue;
+
+		for (int k = 0; k < n; k++)
+			if (pids[k] > 0 && procs[i].pid == pids[k])
+				found = i;
+	}
+
+	if (found < 0) {
+		errno = ECHILD;
+		return -1;
+	}
+
+	return sim_take(found, status, options);
+}
+
+static pid_t sim_wait_timeout(pid_t pid, long timeout_ms, int *status,
+		bool *timed_out)
+{
+	*timed_out = false;
+
+	for (int i = mark; i < nprocs && timeout_ms > 0; i++) {
+		struct sim_proc *p = &procs[i];
+
+		if (p->pid != pid || p->end - p->start <= timeout_ms * 1000000)
+			continue;
+
+		// Killed at the deadline
+		p->end = p->start + timeout_ms * 1000000;
+		p->status = RETRY_TIMEOUT_STATUS;
+		*timed_out = true;
+	}
+
+	return sim_wait(pid, status, 0);
+}
+
+static void sim_sleep(int64_t ns)
+{
+	sim_clock += ns;
+}
+
+static int sim_pipe(int fds[2])
+{
+	// Nothing flows: the sides of a pipe only run at the same time
+	fds[0] = open("/dev/null", O_RDONLY | O_CLOEXEC);
+	fds[1] = open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+	if (fds[0] < 0 || fds[1] < 0) {
+		if (fds[0] >= 0)
+			close(fds[0]);
+		return -1;
+	}
+
+	return 0;
+}
+
+static const struct proc_backend sim_backend = {
+	.name = "sim",
+	.simulated = true,
+	.start = sim_start,
+	.wait = sim_wait,
+	.wait_any = sim_wait_any,
+	.wait_timeout = sim_wait_timeout,
+	.sleep = sim_sleep,
+	.pipe = sim_pipe,
+};
+
+const struct proc_backend *proc = &real_backend;
+
+void proc_init(void)
+{
+	const char *backend = getenv("MINISHELL_BACKEND");
+	const char *spec = getenv("MINISHELL_SIM");
+	const char *seed = getenv("MINISHELL_SIM_SEED");
+
+	if (backend == NULL || strcmp(backend, "sim"))
+		return;
+
+	proc = &sim_backend;
+
+	if (spec != NULL)
+		sim_load(spec);
+	if (seed != NULL && strtoull(seed, NULL, 10) != 0)
+		sim_seed = strtoull(seed, NULL, 10);
+}
+
+void proc_report(void)
+{
+	if (!proc->simulated)
+		return;
+
+	fprintf(stderr, "sim: %llu processes, %llu failed, %.6fs virtual\n",
+			(unsigned long long)started,
+			(unsigned long long)failed, sim_clock / 1e9);
+}
@@ -0,0 +1,99 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _PROC_H
+#define _PROC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Process backends: how the shell's engines (simple commands, '&', '|',
+ * the job schedulers and parmap) start children and wait for them.
+ *
+ * The real backend forks and execs. The simulated one, selected with
+ * MINISHELL_BACKEND=sim, never forks: it keeps a virtual clock, and models
+ * each command as taking some virtual time and exiting with some status,
+ * as read from the spec file named by MINISHELL_SIM. A line of the spec is
+ *
+ *	NAME MS [JITTER_MS [FAIL_PERCENT [STATUS]]]
+ *
+ * a command NAME (or '*' for any other) taking MS milliseconds, give or
+ * take up to JITTER_MS, and exiting with STATUS (default 1) FAIL_PERCENT
+ * of the time, 0 otherwise. Commands the spec does not cover take no time
+ * and succeed. Randomness comes from MINISHELL_SIM_SEED (default 1), so
+ * runs are deterministic.
+ *
+ * Children that run shell code (the sides of '&' and '|', scheduler jobs)
+ * are run in the shell process, from the virtual time they start at; a
+ * wait moves the clock to when the child ended. What they change in the
+ * shell (cd, assignments) therefore sticks. Nothing is redirected for
+ * commands, and both ends of a pipe are /dev/null: only the scheduling is
+ * simulated.
+ */
+
+/**
+ * A child to start: either body, or the command argv.
+ */
+struct proc_child {
+	int (*body)(void *arg);		/* the child's work, or NULL */
+	int (*setup)(void *arg);	/* run first in a real child, or NULL */
+	void *arg;
+
+	char **argv;
+	const char *path;	/* argv[0] found in PATH, or NULL */
+	int stdin_fd;		/* moved to the child's input, if not -1 */
+	int stdout_fd;		/* moved to the child's output, if not -1 */
+};
+
+struct proc_backend {
+	const char *name;
+	bool simulated;
+
+	/**
+	 * Start a child; one that has neither body nor setup is started
+	 * without copying the shell (posix_spawn()).
+	 *
+	 * @return its pid, or -1 with errno set
+	 */
+	pid_t (*start)(const struct proc_child *child);
+
+	/**
+	 * Wait for a child, as waitpid() (pid -1 and WNOHANG included).
+	 */
+	pid_t (*wait)(pid_t pid, int *status, int options);
+
+	/**
+	 * Wait for the first of the n children pids (0 for none) to exit,
+	 * leaving the shell's other children alone; options may be WNOHANG.
+	 *
+	 * @return its pid, 0 if none exited yet with WNOHANG, or -1 with
+	 * errno set (ECHILD if pids holds no child)
+	 */
+	pid_t (*wait_any)(const pid_t *pids, int n, int *status, int options);
+
+	/**
+	 * Wait for a child, killing it after timeout_ms if not 0 (see
+	 * retry_wait()).
+	 */
+	pid_t (*wait_timeout)(pid_t pid, long timeout_ms, int *status,
+			bool *timed_out);
+
+	void (*sleep)(int64_t ns);
+
+	int (*pipe)(int fds[2]);
+};
+
+extern const struct proc_backend *proc;
+
+/**
+ * Pick the backend from MINISHELL_BACKEND; called once, at startup.
+ */
+void proc_init(void);
+
+/**
+ * Print what the simulated backend ran, if it was used.
+ */
+void proc_report(void);
+
+#endif /* _PROC_H */
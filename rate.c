@@ -0,0 +1,225 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <sys/mman.h>
+#include <sys/timerfd.h>
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rate.h"
+#include "utils.h"
+
+/**
+ * The bucket and its statistics, in memory shared with the children.
+ */
+struct rate_state {
+	int64_t due_ns;		/* when the next launch is due */
+	int64_t launches;
+	int64_t first_ns;
+	int64_t last_ns;
+	int64_t delayed;
+	int64_t jitter_ns;	/* summed over the delayed launches */
+	int64_t max_jitter_ns;
+};
+
+static struct rate_state *state;
+
+// Parsed MINISHELL_SPAWN_RATE, and the text it was parsed from
+static char *setting;
+static double rate;		/* launches per second */
+static long burst;
+static int64_t interval_ns;
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void rate_init(void)
+{
+	state = mmap(NULL, sizeof(*state), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (state == MAP_FAILED)
+		state = NULL;
+}
+
+/**
+ * Parse MINISHELL_SPAWN_RATE, again only when it changed.
+ *
+ * @return true if a valid rate is set
+ */
+static bool rate_enabled(void)
+{
+	const char *value = getenv("MINISHELL_SPAWN_RATE");
+	char *end;
+
+	if (state == NULL || value == NULL || *value == '\0')
+		return false;
+
+	if (setting != NULL && !strcmp(setting, value))
+		return rate > 0;
+
+	free(setting);
+	setting = strdup(value);
+	DIE(setting == NULL, "Error allocating spawn rate.");
+
+	rate = strtod(value, &end);
+	if (!strncmp(end, "/m", 2)) {
+		rate /= 60;
+		end += 2;
+	} else if (!strncmp(end, "/s", 2)) {
+		end += 2;
+	}
+
+	burst = 1;
+	if (*end == ':')
+		burst = strtol(end + 1, &end, 10);
+
+	if (rate <= 0 || burst <= 0 || *end != '\0') {
+		fprintf(stderr, "Invalid MINISHELL_SPAWN_RATE '%s'\n", value);
+		rate = 0;
+		return false;
+	}
+
+	interval_ns = 1e9 / rate;
+
+	return true;
+}
+
+/**
+ * Take the next launch slot.
+ *
+ * @return when it is due
+ */
+static int64_t rate_reserve(int64_t now)
+{
+	int64_t tolerance = (burst - 1) * interval_ns;
+	int64_t due, slot;
+
+	// Lock free, as the children launch from other processes
+	do {
+		due = __atomic_load_n(&state->due_ns, __ATOMIC_RELAXED);
+		slot = due > now - tolerance ? due : now - tolerance;
+	} while (!__atomic_compare_exchange_n(&state->due_ns, &due,
+				slot + interval_ns, false, __ATOMIC_ACQ_REL,
+				__ATOMIC_RELAXED));
+
+	return slot;
+}
+
+/**
+ * Sleep until the monotonic clock reaches at_ns.
+ *
+ * @return 0, or -1 with errno set if the sleep failed for another reason
+ * than a signal
+ */
+static int sleep_until(int64_t at_ns)
+{
+	struct itimerspec its = { 0 };
+	uint64_t expirations;
+	int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	int ret = 0;
+
+	if (fd < 0) {
+		struct timespec ts = { at_ns / 1000000000, at_ns % 1000000000 };
+
+		while ((ret = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+						&ts, NULL)) == EINTR)
+			;
+
+		if (ret != 0) {
+			errno = ret;
+			return -1;
+		}
+		return 0;
+	}
+
+	its.it_value.tv_sec = at_ns / 1000000000;
+	its.it_value.tv_nsec = at_ns % 1000000000;
+
+	if (timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+		ret = -1;
+
+	while (ret == 0 && read(fd, &expirations, sizeof(expirations)) < 0)
+		if (errno != EINTR)
+			ret = -1;
+
+	int err = errno;
+
+	close(fd);
+	errno = err;
+
+	return ret;
+}
+
+static void atomic_max(int64_t *p, int64_t value)
+{
+	int64_t old = __atomic_load_n(p, __ATOMIC_RELAXED);
+
+	while (old < value && !__atomic_compare_exchange_n(p, &old, value,
+				false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+void rate_wait(void)
+{
+	if (!rate_enabled())
+		return;
+
+	int64_t now = now_ns();
+	int64_t due = rate_reserve(now);
+
+	// If the sleep fails, the launch goes ahead early rather than not at
+	// all, and is not counted as delayed
+	if (due > now && sleep_until(due) < 0) {
+		perror("rate");
+	} else if (due > now) {
+		now = now_ns();
+
+		__atomic_add_fetch(&state->delayed, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&state->jitter_ns, now - due,
+				__ATOMIC_RELAXED);
+		atomic_max(&state->max_jitter_ns, now - due);
+	}
+
+	int64_t first = 0;
+
+	__atomic_compare_exchange_n(&state->first_ns, &first, now, false,
+			__ATOMIC_RELAXED, __ATOMIC_RELAXED);
+	atomic_max(&state->last_ns, now);
+	__atomic_add_fetch(&state->launches, 1, __ATOMIC_RELAXED);
+}
+
+void rate_report(void)
+{
+	if (state == NULL || state->launches == 0)
+		return;
+
+	const struct rate_state *st = state;
+	double span = (st->last_ns - st->first_ns) / 1e9;
+
+	fprintf(stderr, "spawn rate: %lld launches", (long long)st->launches);
+	if (st->launches > 1 && span > 0)
+		fprintf(stderr, " at %.1f/s", (st->launches - 1) / span);
+	if (rate > 0)
+		fprintf(stderr, " (limit %.1f/s, burst %ld)", rate, burst);
+
+	if (st->delayed > 0) {
+		fprintf(stderr, ", %lld delayed, wake-up jitter avg %.3fms",
+				(long long)st->delayed,
+				st->jitter_ns / 1e6 / st->delayed);
+		fprintf(stderr, " max %.3fms", st->max_jitter_ns / 1e6);
+	}
+
+	fprintf(stderr, "\n");
+}
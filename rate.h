@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _RATE_H
+#define _RATE_H
+
+/*
+ * Launch rate limit of the parallel schedulers ('&', autopar.h, graph.h,
+ * parmap.h).
+ *
+ * MINISHELL_SPAWN_RATE=N[/s|/m][:BURST] allows at most N launches per
+ * second (or minute), and at most BURST (default 1) at once after being
+ * idle. It is a token bucket, kept as the time the next launch is due
+ * (the generic cell rate algorithm), which the shell and all its children
+ * share, so nested fan-outs draw from the same bucket. A launch that is
+ * not due yet sleeps on a timerfd until it is.
+ *
+ * The observed launch rate and how late the sleeps woke up are reported
+ * when the shell exits.
+ */
+
+/**
+ * Map the state shared with the children; called once, at startup.
+ */
+void rate_init(void);
+
+/**
+ * Wait until one more process may be launched, if a rate is set. If the
+ * wait fails, it says so and returns early.
+ */
+void rate_wait(void);
+
+/**
+ * Print the observed launch rate and wake-up jitter, if a rate is set.
+ */
+void rate_report(void);
+
+#endif /* _RATE_H */
@@ -0,0 +1,238 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "record.h"
+#include "utils.h"
+
+// Longest LEB128 encoding of a 64-bit number
+#define VARINT_MAX		10
+
+static int record_fd = -1;
+static int64_t started_at;
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int record_open(const char *path)
+{
+	record_fd = fd_move_high(open(path, O_WRONLY | O_CREAT | O_TRUNC
+				| O_APPEND | O_CLOEXEC, 0644));
+	if (record_fd < 0)
+		return -1;
+
+	if (write(record_fd, RECORD_MAGIC, RECORD_MAGIC_SIZE)
+			!= RECORD_MAGIC_SIZE) {
+		close(record_fd);
+		record_fd = -1;
+		return -1;
+	}
+
+	started_at = now_ns();
+
+	return 0;
+}
+
+int64_t record_clock(void)
+{
+	return record_fd < 0 ? 0 : now_ns();
+}
+
+static char *put_varint(char *p, uint64_t value)
+{
+	while (value >= 0x80) {
+		*p++ = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+	*p++ = value;
+
+	return p;
+}
+
+/**
+ * Append a string, cut to what fits in a record of RECORD_MAX bytes.
+ */
+static char *put_string(char *p, const char *end, const char *s)
+{
+	size_t len = strlen(s);
+	size_t room = end - p - VARINT_MAX;
+
+	if (len > room)
+		len = room;
+
+	p = put_varint(p, len);
+	memcpy(p, s, len);
+
+	return p + len;
+}
+
+static void record_write(const char *buf, size_t len)
+{
+	// One append each, so that concurrent writers never interleave
+	if (write(record_fd, buf, len) != (ssize_t)len)
+		perror("record");
+}
+
+void record_statement(int line, const char *text, int64_t arrival,
+		int64_t parse_ns, int64_t run_ns, int status)
+{
+	char buf[RECORD_MAX];
+	char *p = buf;
+
+	if (record_fd < 0)
+		return;
+
+	*p++ = RECORD_STATEMENT;
+	p = put_varint(p, (arrival - started_at) / 1000);
+	p = put_varint(p, parse_ns);
+	p = put_varint(p, run_ns);
+	p = put_varint(p, status + 1);
+	p = put_varint(p, line);
+	p = put_string(p, buf + sizeof(buf), text);
+
+	record_write(buf, p - buf);
+}
+
+void record_command(const char *name, int64_t started, int status)
+{
+	char buf[RECORD_MAX];
+	char *p = buf;
+
+	if (record_fd < 0 || started == 0)
+		return;
+
+	*p++ = RECORD_COMMAND;
+	p = put_varint(p, now_ns() - started);
+	p = put_varint(p, status + 1);
+	p = put_string(p, buf + sizeof(buf), name);
+
+	record_write(buf, p - buf);
+}
+
+void record_close(void)
+{
+	if (record_fd < 0)
+		return;
+
+	close(record_fd);
+	record_fd = -1;
+}
+
+int record_load(const char *path, struct record_file *f)
+{
+	struct stat st;
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+		return -1;
+
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	f->data = malloc(st.st_size + 1);
+	DIE(f->data == NULL, "Error allocating recording.");
+
+	ssize_t n = read(fd, f->data, st.st_size);
+
+	close(fd);
+
+	if (n < RECORD_MAGIC_SIZE
+			|| memcmp(f->data, RECORD_MAGIC, RECORD_MAGIC_SIZE)) {
+		free(f->data);
+		errno = n < 0 ? errno : EINVAL;
+		return -1;
+	}
+
+	f->len = n;
+	f->pos = RECORD_MAGIC_SIZE;
+
+	return 0;
+}
+
+static bool get_varint(struct record_file *f, uint64_t *value)
+{
+	*value = 0;
+
+	for (int shift = 0; shift < 64 && f->pos < f->len; shift += 7) {
+		unsigned char c = f->data[f->pos++];
+
+		*value |= (uint64_t)(c & 0x7f) << shift;
+		if (!(c & 0x80))
+			return true;
+	}
+
+	return false;
+}
+
+static bool get_string(struct record_file *f, const char **s, size_t *len)
+{
+	uint64_t n;
+
+	if (!get_varint(f, &n) || n > f->len - f->pos)
+		return false;
+
+	*s = f->data + f->pos;
+	*len = n;
+	f->pos += n;
+
+	return true;
+}
+
+bool record_next(struct record_file *f, struct record *r)
+{
+	uint64_t status, line;
+
+	if (f->pos >= f->len)
+		return false;
+
+	memset(r, 0, sizeof(*r));
+	r->kind = f->data[f->pos++];
+
+	switch (r->kind) {
+	case RECORD_STATEMENT:
+		if (!get_varint(f, &r->arrival_us)
+				|| !get_varint(f, &r->parse_ns)
+				|| !get_varint(f, &r->run_ns)
+				|| !get_varint(f, &status)
+				|| !get_varint(f, &line)
+				|| !get_string(f, &r->text, &r->text_len))
+			return false;
+		r->line = line;
+		break;
+
+	case RECORD_COMMAND:
+		if (!get_varint(f, &r->run_ns) || !get_varint(f, &status)
+				|| !get_string(f, &r->text, &r->text_len))
+			return false;
+		break;
+
+	default:
+		return false;
+	}
+
+	r->status = (int)status - 1;
+
+	return true;
+}
+
+void record_unload(struct record_file *f)
+{
+	free(f->data);
+	f->data = NULL;
+}
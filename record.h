@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _RECORD_H
+#define _RECORD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define RECORD_MAGIC		"MSRC\001"
+#define RECORD_MAGIC_SIZE	5
+#define RECORD_MAX		4096
+
+/*
+ * Recording of the statements a shell runs, for replay.h.
+ *
+ * A recording is a binary file: RECORD_MAGIC, then one record per
+ * statement and one per external command run. A record is a kind byte,
+ * then unsigned LEB128 numbers and a string (its length, then its bytes):
+ *
+ *	'S' arrival_us parse_ns run_ns status+1 line text
+ *	'C' run_ns status+1 name
+ *
+ * The arrival time of a statement is when the shell read it, since the
+ * recording started. Its status is -1 if it failed to run. Commands come
+ * before the statement that ran them. Each record is written with a
+ * single append, so that those of subshells and sessions never interleave
+ * and a killed shell loses none.
+ */
+
+enum record_kind {
+	RECORD_STATEMENT = 'S',
+	RECORD_COMMAND = 'C'
+};
+
+struct record {
+	enum record_kind kind;
+	uint64_t arrival_us;	/* statements only */
+	uint64_t parse_ns;	/* statements only */
+	uint64_t run_ns;
+	int status;
+	int line;		/* statements only */
+	const char *text;	/* the statement, or the command's name */
+	size_t text_len;
+};
+
+/**
+ * A recording loaded for reading.
+ */
+struct record_file {
+	char *data;
+	size_t len, pos;
+};
+
+/**
+ * Start recording to path, truncating it.
+ */
+int record_open(const char *path);
+
+/**
+ * Return the monotonic time in ns, or 0 if nothing is recorded.
+ */
+int64_t record_clock(void);
+
+/**
+ * Record a statement read at arrival (see record_clock()) and run.
+ */
+void record_statement(int line, const char *text, int64_t arrival,
+		int64_t parse_ns, int64_t run_ns, int status);
+
+/**
+ * Record an external command started at started (see record_clock()).
+ */
+void record_command(const char *name, int64_t started, int status);
+
+void record_close(void);
+
+/**
+ * Load the recording at path.
+ *
+ * @return 0, or -1 with errno set (EINVAL if it is not a recording)
+ */
+int record_load(const char *path, struct record_file *f);
+
+/**
+ * Decode the next record of f; its text points into f.
+ *
+ * @return false at the end, or if the rest is truncated or malformed
+ */
+bool record_next(struct record_file *f, struct record *r);
+
+void record_unload(struct record_file *f);
+
+#endif /* _RECORD_H */
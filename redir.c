@@ -0,0 +1,314 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "plan.h"
+#include "redir.h"
+#include "replay.h"
+#include "utils.h"
+
+#define MARKER_SIZE		32
+
+static inline bool is_delim(char c)
+{
+	return c == '\0' || c == ' ' || c == '\t' || c == '\n' || c == ';'
+		|| c == '|' || c == '&' || c == '(' || c == ')';
+}
+
+/**
+ * Match a redirection operator the parser handles at p: <, >, >>, 2>,
+ * 2>> or &>, and encode where it is as a marker word: REDIR_MARKER, the fd
+ * (-1 for &>), then ':s'.
+ *
+ * @return the position after the operator, or NULL if there is none here
+ */
+static const char *redir_match_std(const char *p, bool word_start,
+		char *marker)
+{
+	long fd;
+
+	if (p[0] == '&' && p[1] == '>') {
+		fd = -1;
+		p += 2;
+	} else if (word_start && p[0] == '2' && p[1] == '>' && p[2] != '&') {
+		fd = STDERR_FILENO;
+		p += p[2] == '>' ? 3 : 2;
+	} else if (p[0] == '>' && p[1] != '&') {
+		fd = STDOUT_FILENO;
+		p += p[1] == '>' ? 2 : 1;
+	} else if (p[0] == '<' && p[1] != '&') {
+		fd = STDIN_FILENO;
+		p++;
+	} else {
+		return NULL;
+	}
+
+	snprintf(marker, MARKER_SIZE, "%c%ld:s", REDIR_MARKER, fd);
+
+	return p;
+}
+
+/**
+ * Match an fd redirection operator at p and encode it as a marker word:
+ * REDIR_MARKER, the fd, then ':w', ':a' or ':r' (file, followed by the
+ * file word), ':d:M' (copy of fd M) or ':c' (close).
+ *
+ * @return the position after the operator, or NULL if there is none here
+ */
+static const char *redir_match(const char *p, bool word_start, char *marker)
+{
+	long fd = -1, target = -1;
+	char kind;
+	char *end;
+
+	if (word_start && isdigit((unsigned char)*p)) {
+		fd = strtol(p, &end, 10);
+		p = end;
+	} else if (*p != '>' && *p != '<') {
+		return NULL;
+	}
+
+	char op = *p;
+	bool append = op == '>' && p[1] == '>';
+
+	if (op != '>' && op != '<')
+		return NULL;
+	p += append ? 2 : 1;
+
+	if (*p == '&') {
+		if (append)
+			return NULL;
+
+		p++;
+		if (*p == '-') {
+			kind = 'c';
+			p++;
+		} else if (isdigit((unsigned char)*p)) {
+			kind = 'd';
+			target = strtol(p, &end, 10);
+			p = end;
+		} else {
+			return NULL;
+		}
+
+		if (!is_delim(*p))
+			return NULL;
+
+		if (fd < 0)
+			fd = op == '>' ? STDOUT_FILENO : STDIN_FILENO;
+	} else {
+		// The parser handles plain >, >>, <, 2> and 2>> on its own
+		if (fd < 0 || (fd == STDERR_FILENO && op == '>'))
+			return NULL;
+
+		kind = op == '<' ? 'r' : append ? 'a' : 'w';
+	}
+
+	if (kind == 'd')
+		snprintf(marker, MARKER_SIZE, "%c%ld:d:%ld", REDIR_MARKER, fd,
+				target);
+	else
+		snprintf(marker, MARKER_SIZE, "%c%ld:%c", REDIR_MARKER, fd,
+				kind);
+
+	return p;
+}
+
+char *redir_rewrite(const char *line)
+{
+	struct word_buf out = { NULL, 0, 0 };
+	char marker[MARKER_SIZE];
+	bool word_start = true;
+	char quote = '\0';
+
+	word_buf_append(&out, "", 0);
+
+	for (const char *p = line; *p != '\0'; ) {
+		if (quote != '\0') {
+			if (*p == quote)
+				quote = '\0';
+			word_buf_append(&out, p++, 1);
+			continue;
+		}
+
+		if (*p == '\'' || *p == '"') {
+			quote = *p;
+			word_start = false;
+			word_buf_append(&out, p++, 1);
+			continue;
+		}
+
+		if (*p == '\\' && p[1] != '\0') {
+			word_start = false;
+			word_buf_append(&out, p, 2);
+			p += 2;
+			continue;
+		}
+
+		const char *end = redir_match(p, word_start, marker);
+
+		if (end != NULL) {
+			word_buf_append(&out, " ", 1);
+			word_buf_append(&out, marker, strlen(marker));
+			word_buf_append(&out, " ", 1);
+			word_start = true;
+			p = end;
+			continue;
+		}
+
+		// The operator itself is kept for the parser
+		end = redir_match_std(p, word_start, marker);
+
+		if (end != NULL) {
+			word_buf_append(&out, " ", 1);
+			word_buf_append(&out, marker, strlen(marker));
+			word_buf_append(&out, " ", 1);
+			word_buf_append(&out, p, end - p);
+			word_start = false;
+			p = end;
+			continue;
+		}
+
+		word_start = is_delim(*p);
+		word_buf_append(&out, p++, 1);
+	}
+
+	return out.data;
+}
+
+static struct fd_redir *redir_decode(const char *marker)
+{
+	struct fd_redir *r = calloc(1, sizeof(*r));
+	char *end;
+
+	DIE(r == NULL, "Error allocating redirection.");
+
+	r->fd = strtol(marker + 1, &end, 10);
+
+	switch (end[1]) {
+	case 'w':
+		r->kind = REDIR_FILE;
+		r->flags = O_WRONLY | O_CREAT | O_TRUNC;
+		break;
+	case 'a':
+		r->kind = REDIR_FILE;
+		r->flags = O_WRONLY | O_CREAT | O_APPEND;
+		break;
+	case 'r':
+		r->kind = REDIR_FILE;
+		r->flags = O_RDONLY;
+		break;
+	case 'd':
+		r->kind = REDIR_DUP;
+		r->target = strtol(end + 3, NULL, 10);
+		break;
+	case 's':
+		r->kind = REDIR_STD;
+		break;
+	default:
+		r->kind = REDIR_CLOSE;
+		break;
+	}
+
+	return r;
+}
+
+struct fd_redir *redir_extract(word_t **words)
+{
+	struct fd_redir *head = NULL;
+	struct fd_redir **tail = &head;
+	word_t **link = words;
+
+	while (*link != NULL) {
+		word_t *w = *link;
+
+		if (w->string[0] != REDIR_MARKER || w->next_part != NULL) {
+			link = &w->next_word;
+			continue;
+		}
+
+		struct fd_redir *r = redir_decode(w->string);
+
+		// Unlink the marker, and the file word following it
+		*link = w->next_word;
+		w->next_word = NULL;
+		plan_free_word(w);
+
+		if (r->kind == REDIR_FILE && *link != NULL) {
+			r->file = *link;
+			*link = r->file->next_word;
+			r->file->next_word = NULL;
+		}
+
+		*tail = r;
+		tail = &r->next;
+	}
+
+	return head;
+}
+
+int redir_apply(const struct fd_redir *r)
+{
+	char *path;
+	int fd;
+
+	switch (r->kind) {
+	case REDIR_FILE:
+		path = get_word(r->file);
+		if (path == NULL) {
+			fprintf(stderr, "Missing file for fd %d\n", r->fd);
+			return -1;
+		}
+
+		if (replay_confine(path) < 0) {
+			free(path);
+			return -1;
+		}
+
+		fd = open(path, r->flags, 0644);
+		if (fd < 0) {
+			fprintf(stderr, "%s: %s\n", path, strerror(errno));
+			free(path);
+			return -1;
+		}
+
+		free(path);
+
+		if (fd != r->fd) {
+			dup2(fd, r->fd);
+			close(fd);
+		}
+		break;
+	case REDIR_DUP:
+		if (r->target != r->fd && dup2(r->target, r->fd) < 0) {
+			fprintf(stderr, "%d: %s\n", r->target,
+					strerror(errno));
+			return -1;
+		}
+		break;
+	case REDIR_CLOSE:
+		close(r->fd);
+		break;
+	case REDIR_STD:
+		break;
+	}
+
+	return 0;
+}
+
+void redir_free(struct fd_redir *r)
+{
+	while (r != NULL) {
+		struct fd_redir *next = r->next;
+
+		plan_free_word(r->file);
+		free(r);
+		r = next;
+	}
+}
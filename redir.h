@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _REDIR_H
+#define _REDIR_H
+
+#include "../util/parser/parser.h"
+
+/*
+ * Redirections on arbitrary file descriptors, which the parser does not
+ * know about:
+ *
+ *   N>FILE  N>>FILE  N<FILE    open FILE on fd N (N >= 0, except 2> and
+ *                              2>> which the parser handles itself)
+ *   N>&M  N<&M  >&M  <&M       make fd N a copy of fd M
+ *   N>&-  N<&-                 close fd N
+ *
+ * redir_rewrite() replaces them in the command line with marker words
+ * before it reaches the parser; when the parsed command is lowered,
+ * redir_extract() turns the markers back into fd_redir lists.
+ *
+ * The redirections the parser handles (<, >, >>, 2>, 2>> and &>) stay in
+ * the command line for it, but get a marker too, so that the list tells
+ * where they are among the others: all of them are applied in command line
+ * order, and 'cmd 2>&1 >file' leaves the error on the old output.
+ *
+ * The fds the shell keeps open for itself are at SHELL_FD_MIN or above,
+ * out of the way of redirections of fds 0 to 9.
+ */
+
+#define REDIR_MARKER		'\x1f'
+
+enum fd_redir_kind {
+	REDIR_FILE,
+	REDIR_DUP,
+	REDIR_CLOSE,
+	REDIR_STD	/* where the parser's redirection of fd is, -1 for &> */
+};
+
+struct fd_redir {
+	int fd;
+	enum fd_redir_kind kind;
+	int flags;		/* REDIR_FILE: open() flags */
+	word_t *file;		/* REDIR_FILE: target, expanded when applied */
+	int target;		/* REDIR_DUP: fd to copy */
+	struct fd_redir *next;
+};
+
+/**
+ * Return a copy of line with the fd redirections replaced by markers.
+ */
+char *redir_rewrite(const char *line);
+
+/**
+ * Remove the markers (and the file words following them) from a command's
+ * word list, given as its first word.
+ *
+ * @return the redirections, in command line order
+ */
+struct fd_redir *redir_extract(word_t **words);
+
+/**
+ * Apply the redirection to the calling process; REDIR_STD ones are left
+ * to the caller.
+ *
+ * @return 0 on success, -1 on error, which is reported
+ */
+int redir_apply(const struct fd_redir *r);
+
+void redir_free(struct fd_redir *r);
+
+#endif /* _REDIR_H */
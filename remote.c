@@ -0,0 +1,1102 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dirs.h"
+#include "jobs.h"
+#include "remote.h"
+#include "utils.h"
+
+#define REMOTE_HEADER		9
+#define REMOTE_MAX_FRAME	(16 << 20)
+
+extern char **environ;
+
+/**
+ * A run, kept encoded as the payload of its REMOTE_JOB frame: the number
+ * of variables and of words, then the directory, the variables (NAME=VALUE
+ * to set, NAME to unset) and the words, each ending with a NUL.
+ */
+struct remote_job {
+	uint32_t id;
+	uint32_t len;
+	char *payload;
+};
+
+struct remote_deque {
+	struct remote_job **v;
+	int head, tail, cap;
+};
+
+struct remote_host {
+	char *name;
+	int fd;			/* -1 once it went away */
+	int slots;
+	int running;
+	struct remote_job **inflight;	/* slots entries, NULL if free */
+	struct remote_deque queue;
+};
+
+struct remote_pool {
+	struct remote_host *hosts;
+	int nhosts;
+	int live;
+	int next;		/* the host dealt the next run */
+	int window;
+	int pending;		/* runs queued or running */
+	uint32_t last_id;
+	bool failed;
+
+	// What every run starts with: the counts, directory and env delta
+	char *prefix;
+	size_t prefix_len;
+};
+
+// The environment at startup, for the env deltas
+static char **initial_env;
+
+int remote_init(void)
+{
+	int n = 0;
+
+	while (environ[n] != NULL)
+		n++;
+
+	initial_env = calloc(n + 1, sizeof(*initial_env));
+	if (initial_env == NULL)
+		return -1;
+
+	for (int i = 0; i < n; i++) {
+		initial_env[i] = strdup(environ[i]);
+		if (initial_env[i] != NULL)
+			continue;
+
+		while (i-- > 0)
+			free(initial_env[i]);
+		free(initial_env);
+		initial_env = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+static void put32(char *p, uint32_t value)
+{
+	value = htonl(value);
+	memcpy(p, &value, 4);
+}
+
+static uint32_t get32(const char *p)
+{
+	uint32_t value;
+
+	memcpy(&value, p, 4);
+
+	return ntohl(value);
+}
+
+static int send_all(int fd, const void *buf, size_t len, int flags)
+{
+	const char *p = buf;
+
+	while (len > 0) {
+		ssize_t n = send(fd, p, len, flags | MSG_NOSIGNAL);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return -1;
+
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int recv_all(int fd, void *buf, size_t len)
+{
+	char *p = buf;
+
+	while (len > 0) {
+		ssize_t n = recv(fd, p, len, 0);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static void write_all(int fd, const char *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t n = write(fd, buf, len);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return;
+
+		buf += n;
+		len -= n;
+	}
+}
+
+static int remote_send(int fd, enum remote_frame type, uint32_t id,
+		const void *data, uint32_t len)
+{
+	char header[REMOTE_HEADER];
+
+	header[0] = type;
+	put32(header + 1, id);
+	put32(header + 5, len);
+
+	// One segment for the header and the payload
+	if (send_all(fd, header, sizeof(header), len > 0 ? MSG_MORE : 0) < 0)
+		return -1;
+
+	return send_all(fd, data, len, 0);
+}
+
+/**
+ * Read a frame; its payload is allocated, with a NUL after it.
+ */
+static int remote_recv(int fd, enum remote_frame *type, uint32_t *id,
+		char **data, uint32_t *len)
+{
+	char header[REMOTE_HEADER];
+
+	if (recv_all(fd, header, sizeof(header)) < 0)
+		return -1;
+
+	*type = header[0];
+	*id = get32(header + 1);
+	*len = get32(header + 5);
+	if (*len > REMOTE_MAX_FRAME) {
+		errno = EPROTO;
+		return -1;
+	}
+
+	*data = malloc(*len + 1);
+	DIE(*data == NULL, "Error allocating frame.");
+
+	if (recv_all(fd, *data, *len) < 0) {
+		free(*data);
+		return -1;
+	}
+	(*data)[*len] = '\0';
+
+	return 0;
+}
+
+/**
+ * Resolve [HOST:]PORT for a worker to listen on, or HOST[:PORT] for a
+ * coordinator to connect to.
+ */
+static struct addrinfo *remote_resolve(const char *spec, bool listening)
+{
+	struct addrinfo hints = { .ai_socktype = SOCK_STREAM };
+	struct addrinfo *res;
+	char *copy = strdup(spec);
+	char *colon;
+	const char *host, *port;
+
+	DIE(copy == NULL, "Error allocating address.");
+
+	colon = strrchr(copy, ':');
+	if (colon != NULL) {
+		*colon = '\0';
+		host = copy;
+		port = colon + 1;
+	} else if (listening) {
+		host = "127.0.0.1";
+		port = copy;
+	} else {
+		host = copy;
+		port = REMOTE_PORT;
+	}
+
+	if (listening)
+		hints.ai_flags = AI_PASSIVE;
+
+	int ret = getaddrinfo(host, port, &hints, &res);
+
+	free(copy);
+	if (ret != 0) {
+		fprintf(stderr, "%s: %s\n", spec, gai_strerror(ret));
+		return NULL;
+	}
+
+	return res;
+}
+
+static void no_delay(int fd)
+{
+	int one = 1;
+
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+/*
+ * The coordinator
+ */
+
+static void deque_push(struct remote_deque *d, struct remote_job *job)
+{
+	if (d->tail == d->cap) {
+		if (d->head > 0) {
+			memmove(d->v, d->v + d->head,
+					(d->tail - d->head) * sizeof(*d->v));
+			d->tail -= d->head;
+			d->head = 0;
+		} else {
+			d->cap = d->cap ? 2 * d->cap : 16;
+			d->v = realloc(d->v, d->cap * sizeof(*d->v));
+			DIE(d->v == NULL, "Error allocating run queue.");
+		}
+	}
+
+	d->v[d->tail++] = job;
+}
+
+static int deque_size(const struct remote_deque *d)
+{
+	return d->tail - d->head;
+}
+
+/**
+ * Return the env delta: the variables set or changed since startup as
+ * NAME=VALUE, and those unset as NAME.
+ */
+static char **env_delta(int *n)
+{
+	char **delta = NULL;
+
+	*n = 0;
+
+	for (int i = 0; environ[i] != NULL; i++) {
+		bool same = false;
+
+		for (int k = 0; initial_env != NULL && initial_env[k] != NULL
+				&& !same; k++)
+			same = !strcmp(environ[i], initial_env[k]);
+
+		if (same)
+			continue;
+
+		delta = realloc(delta, (*n + 1) * sizeof(*delta));
+		DIE(delta == NULL, "Error allocating env delta.");
+		delta[(*n)++] = strdup(environ[i]);
+	}
+
+	for (int k = 0; initial_env != NULL && initial_env[k] != NULL; k++) {
+		char *name = strdup(initial_env[k]);
+		char *eq;
+
+		DIE(name == NULL, "Error allocating env delta.");
+
+		// Only NAME=VALUE entries are variables
+		eq = strchr(name, '=');
+		if (eq != NULL)
+			*eq = '\0';
+		if (eq == NULL || getenv(name) != NULL) {
+			free(name);
+			continue;
+		}
+
+		delta = realloc(delta, (*n + 1) * sizeof(*delta));
+		DIE(delta == NULL, "Error allocating env delta.");
+		delta[(*n)++] = name;
+	}
+
+	return delta;
+}
+
+static void remote_lower_prefix(struct remote_pool *pool)
+{
+	int nenv;
+	char **delta = env_delta(&nenv);
+	const char *cwd = dirs_pwd();
+	size_t len = 8 + strlen(cwd) + 1;
+
+	for (int i = 0; i < nenv; i++)
+		len += strlen(delta[i]) + 1;
+
+	pool->prefix = malloc(len);
+	DIE(pool->prefix == NULL, "Error allocating run.");
+	pool->prefix_len = len;
+
+	char *p = pool->prefix;
+
+	put32(p, nenv);
+	p += 8;
+	p = stpcpy(p, cwd) + 1;
+	for (int i = 0; i < nenv; i++) {
+		p = stpcpy(p, delta[i]) + 1;
+		free(delta[i]);
+	}
+
+	free(delta);
+}
+
+static int remote_dial(const char *spec)
+{
+	struct addrinfo *res = remote_resolve(spec, false);
+	int fd = -1;
+
+	if (res == NULL)
+		return -1;
+
+	for (struct addrinfo *ai = res; ai != NULL && fd < 0;
+			ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC,
+				ai->ai_protocol);
+		if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+			close(fd);
+			fd = -1;
+		}
+	}
+
+	if (fd < 0)
+		perror(spec);
+	else
+		no_delay(fd);
+
+	freeaddrinfo(res);
+
+	return fd;
+}
+
+struct remote_pool *remote_connect(void)
+{
+	const char *workers = getenv("MINISHELL_WORKERS");
+	const char *token = getenv("MINISHELL_WORKER_TOKEN");
+	struct remote_pool *pool;
+	char *list, *save = NULL;
+
+	if (workers == NULL || *workers == '\0')
+		return NULL;
+
+	if (token == NULL)
+		token = "";
+
+	pool = calloc(1, sizeof(*pool));
+	list = strdup(workers);
+	DIE(pool == NULL || list == NULL, "Error allocating worker pool.");
+
+	for (char *spec = strtok_r(list, ",", &save); spec != NULL;
+			spec = strtok_r(NULL, ",", &save)) {
+		enum remote_frame type;
+		uint32_t id, len;
+		char *hello;
+		int fd = remote_dial(spec);
+
+		if (fd < 0)
+			continue;
+
+		// The coordinator proves it may run commands, then the worker
+		// says how many runs it takes at a time
+		if (remote_send(fd, REMOTE_AUTH, 0, token, strlen(token)) < 0
+				|| remote_recv(fd, &type, &id, &hello, &len) < 0) {
+			fprintf(stderr, "%s: no greeting\n", spec);
+			close(fd);
+			continue;
+		}
+
+		int slots = type == REMOTE_HELLO && len == 4 ? get32(hello) : 0;
+
+		free(hello);
+		if (slots <= 0) {
+			fprintf(stderr, "%s: not a worker\n", spec);
+			close(fd);
+			continue;
+		}
+
+		pool->hosts = realloc(pool->hosts,
+				(pool->nhosts + 1) * sizeof(*pool->hosts));
+		DIE(pool->hosts == NULL, "Error allocating worker pool.");
+
+		struct remote_host *h = &pool->hosts[pool->nhosts++];
+
+		memset(h, 0, sizeof(*h));
+		h->name = strdup(spec);
+		h->fd = fd;
+		h->slots = slots;
+		h->inflight = calloc(slots, sizeof(*h->inflight));
+		DIE(h->name == NULL || h->inflight == NULL,
+				"Error allocating worker pool.");
+
+		pool->live++;
+		pool->window += 2 * slots;
+	}
+
+	free(list);
+
+	if (pool->live == 0) {
+		free(pool->hosts);
+		free(pool);
+		return NULL;
+	}
+
+	remote_lower_prefix(pool);
+
+	return pool;
+}
+
+static void remote_job_free(struct remote_pool *pool, struct remote_job *job)
+{
+	free(job->payload);
+	free(job);
+	pool->pending--;
+}
+
+/**
+ * Return the next host that is still there, round-robin.
+ */
+static struct remote_host *remote_deal(struct remote_pool *pool)
+{
+	struct remote_host *h;
+
+	do {
+		h = &pool->hosts[pool->next];
+		pool->next = (pool->next + 1) % pool->nhosts;
+	} while (h->fd < 0);
+
+	return h;
+}
+
+/**
+ * Forget a worker that went away, handing its runs to the others.
+ */
+static void remote_drop(struct remote_pool *pool, struct remote_host *h)
+{
+	struct remote_deque *q = &h->queue;
+
+	fprintf(stderr, "%s: worker lost\n", h->name);
+	close(h->fd);
+	h->fd = -1;
+	pool->live--;
+
+	for (int i = 0; i < h->slots; i++)
+		if (h->inflight[i] != NULL)
+			deque_push(q, h->inflight[i]);
+	memset(h->inflight, 0, h->slots * sizeof(*h->inflight));
+	h->running = 0;
+
+	for (int i = q->head; i < q->tail; i++) {
+		if (pool->live > 0) {
+			deque_push(&remote_deal(pool)->queue, q->v[i]);
+		} else {
+			remote_job_free(pool, q->v[i]);
+			pool->failed = true;
+		}
+	}
+
+	q->head = q->tail = 0;
+}
+
+/**
+ * Move to an idle worker's deque the back half of the runs that the
+ * busiest one cannot start yet.
+ */
+static void remote_steal(struct remote_pool *pool, struct remote_host *thief)
+{
+	struct remote_host *victim = NULL;
+	int surplus = 0;
+
+	for (int i = 0; i < pool->nhosts; i++) {
+		struct remote_host *h = &pool->hosts[i];
+		int waiting = deque_size(&h->queue) - (h->slots - h->running);
+
+		if (h != thief && h->fd >= 0 && waiting > surplus) {
+			victim = h;
+			surplus = waiting;
+		}
+	}
+
+	if (victim == NULL)
+		return;
+
+	int k = (surplus + 1) / 2;
+	struct remote_deque *q = &victim->queue;
+
+	for (int i = q->tail - k; i < q->tail; i++)
+		deque_push(&thief->queue, q->v[i]);
+	q->tail -= k;
+}
+
+/**
+ * Start runs on the workers with free slots.
+ */
+static void remote_dispatch(struct remote_pool *pool)
+{
+	for (int i = 0; i < pool->nhosts; i++) {
+		struct remote_host *h = &pool->hosts[i];
+
+		while (h->fd >= 0 && h->running < h->slots) {
+			struct remote_deque *q = &h->queue;
+
+			if (deque_size(q) == 0)
+				remote_steal(pool, h);
+			if (deque_size(q) == 0)
+				break;
+
+			struct remote_job *job = q->v[q->head++];
+			int slot = 0;
+
+			while (h->inflight[slot] != NULL)
+				slot++;
+			h->inflight[slot] = job;
+			h->running++;
+
+			if (remote_send(h->fd, REMOTE_JOB, job->id,
+					job->payload, job->len) < 0)
+				remote_drop(pool, h);
+		}
+	}
+}
+
+static void remote_exited(struct remote_pool *pool, struct remote_host *h,
+		uint32_t id, const char *data, uint32_t len)
+{
+	for (int i = 0; i < h->slots; i++) {
+		struct remote_job *job = h->inflight[i];
+
+		if (job == NULL || job->id != id)
+			continue;
+
+		if (len != 4 || get32(data) != 0)
+			pool->failed = true;
+
+		h->inflight[i] = NULL;
+		h->running--;
+		remote_job_free(pool, job);
+		return;
+	}
+}
+
+/**
+ * Wait for the workers, and handle one frame from each that sent any.
+ */
+static void remote_pump(struct remote_pool *pool)
+{
+	struct pollfd pfds[pool->nhosts];
+
+	for (int i = 0; i < pool->nhosts; i++) {
+		pfds[i].fd = pool->hosts[i].fd;
+		pfds[i].events = POLLIN;
+	}
+
+	if (poll(pfds, pool->nhosts, -1) < 0)
+		return;
+
+	for (int i = 0; i < pool->nhosts; i++) {
+		struct remote_host *h = &pool->hosts[i];
+		enum remote_frame type;
+		uint32_t id, len;
+		char *data;
+
+		if (h->fd < 0 || pfds[i].revents == 0)
+			continue;
+
+		if (remote_recv(h->fd, &type, &id, &data, &len) < 0) {
+			remote_drop(pool, h);
+			continue;
+		}
+
+		if (type == REMOTE_OUT)
+			write_all(STDOUT_FILENO, data, len);
+		else if (type == REMOTE_ERR)
+			write_all(STDERR_FILENO, data, len);
+		else if (type == REMOTE_EXIT)
+			remote_exited(pool, h, id, data, len);
+
+		free(data);
+	}
+}
+
+void remote_submit(struct remote_pool *pool, char **args)
+{
+	struct remote_job *job = malloc(sizeof(*job));
+	int nargs = 0;
+	size_t len = pool->prefix_len;
+
+	DIE(job == NULL, "Error allocating run.");
+
+	for (; args[nargs] != NULL; nargs++)
+		len += strlen(args[nargs]) + 1;
+
+	job->id = ++pool->last_id;
+	job->len = len;
+	job->payload = malloc(len);
+	DIE(job->payload == NULL, "Error allocating run.");
+
+	memcpy(job->payload, pool->prefix, pool->prefix_len);
+	put32(job->payload + 4, nargs);
+
+	char *p = job->payload + pool->prefix_len;
+
+	for (int i = 0; i < nargs; i++)
+		p = stpcpy(p, args[i]) + 1;
+
+	// Backpressure: the caller waits while enough runs are pending
+	while (pool->pending >= pool->window && pool->live > 0) {
+		remote_pump(pool);
+		remote_dispatch(pool);
+	}
+
+	pool->pending++;
+	if (pool->live == 0) {
+		remote_job_free(pool, job);
+		pool->failed = true;
+		return;
+	}
+
+	deque_push(&remote_deal(pool)->queue, job);
+	remote_dispatch(pool);
+}
+
+bool remote_finish(struct remote_pool *pool)
+{
+	remote_dispatch(pool);
+	while (pool->pending > 0 && pool->live > 0) {
+		remote_pump(pool);
+		remote_dispatch(pool);
+	}
+
+	bool ok = !pool->failed;
+
+	for (int i = 0; i < pool->nhosts; i++) {
+		struct remote_host *h = &pool->hosts[i];
+
+		if (h->fd >= 0)
+			close(h->fd);
+		free(h->name);
+		free(h->inflight);
+		free(h->queue.v);
+	}
+
+	free(pool->hosts);
+	free(pool->prefix);
+	free(pool);
+
+	return ok;
+}
+
+/*
+ * The worker
+ */
+
+struct remote_run {
+	uint32_t id;
+	pid_t pid;
+	int out_fd, err_fd;	/* -1 once at end of file */
+};
+
+/**
+ * Check a REMOTE_JOB payload and point strs at its strings.
+ *
+ * @return the number of strings, or -1 if it is malformed
+ */
+static int remote_unpack(char *data, uint32_t len, char ***strs)
+{
+	if (len < 8)
+		return -1;
+
+	uint32_t nenv = get32(data), nargs = get32(data + 4);
+	char *p = data + 8, *end = data + len;
+
+	// Every string takes a byte at least; each count is checked on its
+	// own first, so that their sum cannot wrap around
+	if (nargs == 0 || nenv >= len || nargs >= len
+			|| 1 + nenv + nargs > len - 8)
+		return -1;
+
+	uint32_t n = 1 + nenv + nargs;
+
+	*strs = calloc(n + 1, sizeof(**strs));
+	DIE(*strs == NULL, "Error allocating run.");
+
+	for (uint32_t i = 0; i < n; i++) {
+		char *nul = memchr(p, '\0', end - p);
+
+		if (nul == NULL) {
+			free(*strs);
+			return -1;
+		}
+
+		(*strs)[i] = p;
+		p = nul + 1;
+	}
+
+	return n;
+}
+
+/**
+ * Start a run in a child process, its output going to pipes.
+ */
+static int remote_start(struct remote_run *run, uint32_t id, char *data,
+		uint32_t len, int null_fd)
+{
+	char **strs;
+	int out[2], err[2];
+
+	if (remote_unpack(data, len, &strs) < 0) {
+		errno = EPROTO;
+		return -1;
+	}
+
+	uint32_t nenv = get32(data);
+
+	if (pipe2(out, O_CLOEXEC) < 0) {
+		free(strs);
+		return -1;
+	}
+	if (pipe2(err, O_CLOEXEC) < 0) {
+		close(out[0]);
+		close(out[1]);
+		free(strs);
+		return -1;
+	}
+
+	pid_t pid = fork();
+
+	if (pid == 0) {
+		dup2(null_fd, STDIN_FILENO);
+		dup2(out[1], STDOUT_FILENO);
+		dup2(err[1], STDERR_FILENO);
+
+		if (chdir(strs[0]) < 0) {
+			perror(strs[0]);
+			child_exit(EXIT_FAILURE);
+		}
+
+		// The env delta goes on top of the worker's environment
+		for (uint32_t i = 1; i <= nenv; i++) {
+			if (strchr(strs[i], '=') != NULL)
+				putenv(strs[i]);
+			else
+				unsetenv(strs[i]);
+		}
+
+		char **args = strs + 1 + nenv;
+
+		execvp(args[0], args);
+		fprintf(stderr, "Execution failed for '%s'\n", args[0]);
+		child_exit(127);
+	}
+
+	free(strs);
+	close(out[1]);
+	close(err[1]);
+
+	if (pid < 0) {
+		close(out[0]);
+		close(err[0]);
+		return -1;
+	}
+
+	run->id = id;
+	run->pid = pid;
+	run->out_fd = out[0];
+	run->err_fd = err[0];
+
+	return 0;
+}
+
+/**
+ * Send what a run wrote on fd, or note that it closed it.
+ */
+static int remote_forward(int sock, struct remote_run *run, int *fd,
+		enum remote_frame type)
+{
+	char buf[REMOTE_CHUNK];
+	ssize_t n = read(*fd, buf, sizeof(buf));
+
+	if (n < 0 && errno == EINTR)
+		return 0;
+
+	if (n <= 0) {
+		close(*fd);
+		*fd = -1;
+		return 0;
+	}
+
+	return remote_send(sock, type, run->id, buf, n);
+}
+
+/**
+ * The runs a worker has going for a coordinator.
+ */
+struct remote_runs {
+	struct remote_run *v;
+	int n, cap;
+	int null_fd;
+};
+
+/**
+ * Handle a frame from the coordinator.
+ *
+ * @return false once it is gone
+ */
+static bool remote_take(int sock, struct remote_runs *runs)
+{
+	enum remote_frame type;
+	uint32_t id, len;
+	char *data;
+
+	if (remote_recv(sock, &type, &id, &data, &len) < 0)
+		return false;
+
+	if (type != REMOTE_JOB) {
+		free(data);
+		return true;
+	}
+
+	if (runs->n == runs->cap) {
+		runs->cap = runs->cap ? 2 * runs->cap : 16;
+		runs->v = realloc(runs->v, runs->cap * sizeof(*runs->v));
+		DIE(runs->v == NULL, "Error allocating runs.");
+	}
+
+	int ret = remote_start(&runs->v[runs->n], id, data, len,
+			runs->null_fd);
+
+	free(data);
+	if (ret == 0) {
+		runs->n++;
+		return true;
+	}
+
+	// A run that cannot start still ends, with a reason
+	const char *msg = strerror(errno);
+	char status[4];
+
+	put32(status, EXIT_FAILURE);
+
+	return remote_send(sock, REMOTE_ERR, id, msg, strlen(msg)) == 0
+		&& remote_send(sock, REMOTE_EXIT, id, status,
+				sizeof(status)) == 0;
+}
+
+/**
+ * Report the runs that closed both pipes, once they exit.
+ *
+ * @return false once the coordinator is gone
+ */
+static bool remote_reap(int sock, struct remote_runs *runs, bool connected)
+{
+	for (int i = 0; i < runs->n; i++) {
+		struct remote_run *run = &runs->v[i];
+		int status;
+		char code[4];
+
+		if (run->out_fd >= 0 || run->err_fd >= 0)
+			continue;
+
+		if (waitpid(run->pid, &status, 0) < 0)
+			status = EXIT_FAILURE << 8;
+
+		put32(code, WIFEXITED(status) ? WEXITSTATUS(status)
+				: 128 + WTERMSIG(status));
+		if (connected && remote_send(sock, REMOTE_EXIT, run->id, code,
+				sizeof(code)) < 0)
+			connected = false;
+
+		runs->v[i--] = runs->v[--runs->n];
+	}
+
+	return connected;
+}
+
+/**
+ * Check that the coordinator's first frame holds the worker's token.
+ */
+static bool remote_auth(int sock, const char *token)
+{
+	enum remote_frame type;
+	uint32_t id, len;
+	char *data;
+	size_t want = strlen(token);
+	unsigned char diff = 0;
+
+	if (remote_recv(sock, &type, &id, &data, &len) < 0)
+		return false;
+
+	// Compared in full, so the time taken tells nothing of the token
+	for (size_t i = 0; i < len && i < want; i++)
+		diff |= data[i] ^ token[i];
+
+	free(data);
+
+	return type == REMOTE_AUTH && len == want && diff == 0;
+}
+
+/**
+ * Serve one coordinator on sock, in its own process. Never returns.
+ */
+static void remote_session(int sock, const char *token)
+{
+	struct remote_runs runs = { NULL, 0, 0, -1 };
+	bool connected = true;
+	char hello[4];
+
+	no_delay(sock);
+	if (!remote_auth(sock, token)) {
+		fprintf(stderr, "worker: coordinator refused\n");
+		child_exit(EXIT_FAILURE);
+	}
+
+	runs.null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+	put32(hello, jobs_limit());
+	if (remote_send(sock, REMOTE_HELLO, 0, hello, sizeof(hello)) < 0)
+		child_exit(EXIT_FAILURE);
+
+	while (connected || runs.n > 0) {
+		struct pollfd pfds[1 + 2 * runs.n];
+		int polled = runs.n;
+
+		// The coordinator, then the output and error pipes of each run
+		pfds[0] = (struct pollfd){ connected ? sock : -1, POLLIN, 0 };
+		for (int i = 0; i < polled; i++) {
+			struct pollfd *p = &pfds[1 + 2 * i];
+
+			p[0] = (struct pollfd){ runs.v[i].out_fd, POLLIN, 0 };
+			p[1] = (struct pollfd){ runs.v[i].err_fd, POLLIN, 0 };
+		}
+
+		if (poll(pfds, 1 + 2 * polled, -1) < 0 && errno != EINTR)
+			break;
+
+		if (connected && pfds[0].revents != 0
+				&& !remote_take(sock, &runs)) {
+			// Without a coordinator, the runs are pointless
+			for (int i = 0; i < runs.n; i++)
+				kill(runs.v[i].pid, SIGTERM);
+			connected = false;
+		}
+
+		// Only the runs polled are looked at; new ones come next time
+		for (int i = 0; i < polled; i++) {
+			struct remote_run *run = &runs.v[i];
+
+			if (pfds[1 + 2 * i].revents != 0 && remote_forward(sock,
+					run, &run->out_fd, REMOTE_OUT) < 0)
+				connected = false;
+			if (pfds[2 + 2 * i].revents != 0 && remote_forward(sock,
+					run, &run->err_fd, REMOTE_ERR) < 0)
+				connected = false;
+		}
+
+		connected = remote_reap(sock, &runs, connected);
+	}
+
+	child_exit(EXIT_SUCCESS);
+}
+
+int remote_worker(const char *addr)
+{
+	const char *token = getenv("MINISHELL_WORKER_TOKEN");
+	struct addrinfo *res;
+	struct sockaddr_storage bound;
+	socklen_t bound_len = sizeof(bound);
+	char host[NI_MAXHOST], port[NI_MAXSERV];
+	int one = 1;
+	int fd = -1;
+
+	// Even on the loopback interface, any local user could connect
+	if (token == NULL || strlen(token) < REMOTE_MIN_TOKEN) {
+		fprintf(stderr, "worker: MINISHELL_WORKER_TOKEN must hold at "
+				"least %d characters\n", REMOTE_MIN_TOKEN);
+		errno = EACCES;
+		return -1;
+	}
+
+	res = remote_resolve(addr, true);
+	if (res == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (struct addrinfo *ai = res; ai != NULL && fd < 0;
+			ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC,
+				ai->ai_protocol);
+		if (fd < 0)
+			continue;
+
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		if (bind(fd, ai->ai_addr, ai->ai_addrlen) < 0
+				|| listen(fd, SOMAXCONN) < 0) {
+			close(fd);
+			fd = -1;
+		}
+	}
+
+	freeaddrinfo(res);
+	if (fd < 0)
+		return -1;
+
+	// With port 0, the one picked is what coordinators need
+	getsockname(fd, (struct sockaddr *)&bound, &bound_len);
+	if (getnameinfo((struct sockaddr *)&bound, bound_len, host,
+			sizeof(host), port, sizeof(port),
+			NI_NUMERICHOST | NI_NUMERICSERV) == 0)
+		fprintf(stderr, "worker: listening on %s:%s, %d slots\n", host,
+				port, jobs_limit());
+
+	// Coordinators' sessions are reaped by the kernel
+	signal(SIGCHLD, SIG_IGN);
+
+	for (;;) {
+		int sock = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+
+		if (sock < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			break;
+		}
+
+		fflush(stderr);
+
+		pid_t pid = fork();
+
+		if (pid == 0) {
+			close(fd);
+			signal(SIGCHLD, SIG_DFL);
+			remote_session(sock, token);
+		}
+
+		if (pid < 0)
+			perror("worker");
+		close(sock);
+	}
+
+	close(fd);
+
+	return -1;
+}
@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _REMOTE_H
+#define _REMOTE_H
+
+#include <stdbool.h>
+
+#define REMOTE_PORT		"7341"
+#define REMOTE_CHUNK		65536
+#define REMOTE_MIN_TOKEN	16
+
+/*
+ * Running commands on worker daemons over TCP ('mini-shell --worker').
+ *
+ * The coordinator is the shell running 'parmap -r' (see parmap.h). It
+ * connects to each worker of MINISHELL_WORKERS ("HOST:PORT,..."). Each
+ * worker greets it with the number of runs it takes at a time, its slots.
+ * Runs are shipped lowered: the words of the command, the coordinator's
+ * directory and the environment variables it set or unset since it
+ * started (an env delta on top of the worker's own). Their standard
+ * output, error and exit status are streamed back. On the worker, each
+ * run is a child process reading /dev/null.
+ *
+ * Each worker has a deque of runs. New runs are dealt round-robin to the
+ * back of the deques, and a worker with a free slot takes the run at the
+ * front of its own. A worker whose deque is empty steals the back half of
+ * the longest one, so that fast workers, or ones with more slots, take
+ * over what slow ones have not started. The runs of a worker that goes
+ * away are handed to the others, and may therefore run twice.
+ *
+ * Anyone who can connect to a worker could run commands as its user, so a
+ * worker requires a shared secret, MINISHELL_WORKER_TOKEN (at least
+ * REMOTE_MIN_TOKEN characters), and refuses to start without it; even on
+ * the loopback interface, which it only listens on unless a HOST is given,
+ * every local user can connect. A coordinator sends its own
+ * MINISHELL_WORKER_TOKEN first, and a worker only greets one whose token
+ * matches. The token is sent as is: across untrusted networks, workers are
+ * best reached through a tunnel.
+ *
+ * Everything is sent in frames: a type byte, then the id of the run and
+ * the length of the payload, as 32-bit big-endian numbers.
+ */
+
+enum remote_frame {
+	REMOTE_HELLO,	/* worker: its slots */
+	REMOTE_JOB,	/* coordinator: a run */
+	REMOTE_OUT,	/* worker: standard output of a run */
+	REMOTE_ERR,	/* worker: standard error of a run */
+	REMOTE_EXIT,	/* worker: exit status of a run */
+	REMOTE_AUTH	/* coordinator: the token, before anything else */
+};
+
+struct remote_pool;
+
+/**
+ * Remember the environment, to tell later what the shell changed in it;
+ * called once, at startup.
+ *
+ * @return 0, or -1 with errno set if it cannot be allocated
+ */
+int remote_init(void);
+
+/**
+ * Connect to the workers of MINISHELL_WORKERS; those that cannot be
+ * reached are reported and left out.
+ *
+ * @return the pool, or NULL if no worker could be reached
+ */
+struct remote_pool *remote_connect(void);
+
+/**
+ * Queue a run of args (args[0] is looked up in the worker's PATH), in the
+ * current directory and environment. Waits, streaming the output of the
+ * runs, while twice as many runs as the workers have slots are pending.
+ */
+void remote_submit(struct remote_pool *pool, char **args);
+
+/**
+ * Wait for every run, then disconnect and free the pool.
+ *
+ * @return false if any run failed or could not be run
+ */
+bool remote_finish(struct remote_pool *pool);
+
+/**
+ * Serve coordinators as a worker, on [HOST:]PORT (HOST defaults to the
+ * loopback interface), taking MINISHELL_JOBS runs at a time (see jobs.h).
+ *
+ * @return -1 with errno set, once the socket cannot be set up or accept()
+ * fails for good (EACCES: MINISHELL_WORKER_TOKEN is missing or too short)
+ */
+int remote_worker(const char *addr);
+
+#endif /* _REMOTE_H */
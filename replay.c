@@ -0,0 +1,461 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <sys/stat.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "minishell.h"
+#include "record.h"
+#include "replay.h"
+#include "utils.h"
+
+struct replay_statement {
+	char *text;
+	uint64_t arrival_us;
+	uint64_t run_ns;
+};
+
+struct replay_run {
+	uint64_t ns;
+	int status;
+};
+
+/**
+ * What a stub does: the runs of its command, in the order they ended.
+ */
+struct replay_stub {
+	char *name;
+	struct replay_run *runs;
+	int nruns;
+};
+
+struct replay {
+	struct replay_statement *statements;
+	int nstatements;
+	struct replay_stub *stubs;
+	int nstubs;
+
+	char dir[32];		/* the scratch directory */
+	char bin[64];		/* the stubs, in it */
+};
+
+// The scratch directory, while a recording is replayed
+static const char *replay_root;
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sleep_until(int64_t due)
+{
+	struct timespec ts = { due / 1000000000, due % 1000000000 };
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)
+			== EINTR)
+		;
+}
+
+/**
+ * Check if a command name can be stubbed: usable as is as a file name in
+ * the stub directory.
+ */
+static bool replay_stub_name(const char *name, size_t len)
+{
+	// The stub table is split on spaces. The runs of a stub are in
+	// '.NAME' next to it, which a name starting with '.' could be or
+	// clash with.
+	return len > 0 && len < NAME_MAX && name[0] != '.'
+		&& memchr(name, '/', len) == NULL
+		&& memchr(name, ' ', len) == NULL
+		&& memchr(name, '\0', len) == NULL;
+}
+
+static void replay_command(struct replay *rp, const struct record *r)
+{
+	// Commands run by path are stubbed under their basename, which is
+	// what they run as in a replay (see replay_command_name())
+	const char *name = r->text;
+	size_t len = r->text_len;
+	const char *slash = memrchr(name, '/', len);
+
+	if (slash != NULL) {
+		len -= slash + 1 - name;
+		name = slash + 1;
+	}
+
+	if (!replay_stub_name(name, len))
+		return;
+
+	struct replay_stub *stub = NULL;
+
+	for (int i = 0; i < rp->nstubs && stub == NULL; i++)
+		if (strlen(rp->stubs[i].name) == len
+				&& !memcmp(rp->stubs[i].name, name, len))
+			stub = &rp->stubs[i];
+
+	if (stub == NULL) {
+		rp->stubs = realloc(rp->stubs,
+				(rp->nstubs + 1) * sizeof(*rp->stubs));
+		DIE(rp->stubs == NULL, "Error allocating stubs.");
+
+		stub = &rp->stubs[rp->nstubs++];
+		memset(stub, 0, sizeof(*stub));
+		stub->name = strndup(name, len);
+		DIE(stub->name == NULL, "Error allocating stubs.");
+	}
+
+	stub->runs = realloc(stub->runs,
+			(stub->nruns + 1) * sizeof(*stub->runs));
+	DIE(stub->runs == NULL, "Error allocating stubs.");
+
+	stub->runs[stub->nruns].ns = r->run_ns;
+	stub->runs[stub->nruns++].status = r->status < 0 ? EXIT_FAILURE
+		: r->status;
+}
+
+static int replay_load(struct replay *rp, const char *path)
+{
+	struct record_file f;
+	struct record r;
+	size_t at = RECORD_MAGIC_SIZE;
+
+	if (record_load(path, &f) < 0)
+		return -1;
+
+	for (; record_next(&f, &r); at = f.pos) {
+		if (r.kind == RECORD_COMMAND) {
+			replay_command(rp, &r);
+			continue;
+		}
+
+		int n = rp->nstatements++;
+
+		rp->statements = realloc(rp->statements,
+				rp->nstatements * sizeof(*rp->statements));
+		DIE(rp->statements == NULL, "Error allocating statements.");
+
+		struct replay_statement *s = &rp->statements[n];
+
+		s->text = strndup(r.text, r.text_len);
+		DIE(s->text == NULL, "Error allocating statements.");
+		s->arrival_us = r.arrival_us;
+		s->run_ns = r.run_ns;
+	}
+
+	// What a killed shell was writing is left out
+	if (at < f.len)
+		fprintf(stderr, "%s: truncated at byte %zu\n", path, at);
+
+	record_unload(&f);
+
+	return 0;
+}
+
+/**
+ * Make the scratch directory and the stubs in it.
+ */
+static int replay_setup(struct replay *rp)
+{
+	char self[PATH_MAX], path[PATH_MAX];
+	ssize_t n = readlink("/proc/self/exe", self, sizeof(self) - 1);
+
+	if (n < 0)
+		return -1;
+	self[n] = '\0';
+
+	strcpy(rp->dir, "/tmp/minishell-replay.XXXXXX");
+	if (mkdtemp(rp->dir) == NULL)
+		return -1;
+
+	snprintf(rp->bin, sizeof(rp->bin), "%s/bin", rp->dir);
+	if (mkdir(rp->bin, 0755) < 0)
+		return -1;
+
+	for (int i = 0; i < rp->nstubs; i++) {
+		const struct replay_stub *stub = &rp->stubs[i];
+
+		// Only ever a file right in bin
+		if (!replay_stub_name(stub->name, strlen(stub->name)))
+			continue;
+
+		snprintf(path, sizeof(path), "%s/%s", rp->bin, stub->name);
+		if (symlink(self, path) < 0) {
+			perror(path);
+			continue;
+		}
+
+		snprintf(path, sizeof(path), "%s/.%s", rp->bin, stub->name);
+
+		FILE *runs = fopen(path, "w");
+
+		if (runs == NULL)
+			return -1;
+
+		// Fixed-size records, for the stub to read only its own
+		for (int k = 0; k < stub->nruns; k++)
+			fprintf(runs, "%20llu %10d\n",
+					(unsigned long long)stub->runs[k].ns,
+					stub->runs[k].status);
+
+		if (fclose(runs) != 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+static void replay_cleanup(struct replay *rp)
+{
+	char path[PATH_MAX];
+
+	for (int i = 0; i < rp->nstubs; i++) {
+		const char *name = rp->stubs[i].name;
+
+		snprintf(path, sizeof(path), "%s/%s", rp->bin, name);
+		unlink(path);
+		snprintf(path, sizeof(path), "%s/.%s", rp->bin, name);
+		unlink(path);
+		snprintf(path, sizeof(path), "%s/.%s.n", rp->bin, name);
+		unlink(path);
+	}
+
+	rmdir(rp->bin);
+
+	// What memo commands stored (see replay_run())
+	snprintf(path, sizeof(path), "%s/.memo", rp->dir);
+
+	DIR *memo = opendir(path);
+
+	for (struct dirent *d; memo != NULL && (d = readdir(memo)) != NULL;)
+		unlinkat(dirfd(memo), d->d_name, 0);
+	if (memo != NULL)
+		closedir(memo);
+	rmdir(path);
+
+	if (rmdir(rp->dir) < 0)
+		fprintf(stderr, "replay: files left in %s\n", rp->dir);
+}
+
+static int by_value(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void print_distribution(const char *what, int64_t *ns, int n)
+{
+	static const double pcts[] = { 50, 90, 99, 99.9 };
+	double sum = 0;
+
+	qsort(ns, n, sizeof(*ns), by_value);
+	for (int i = 0; i < n; i++)
+		sum += ns[i];
+
+	printf("%-9s min %.3fms", what, ns[0] / 1e6);
+	for (size_t i = 0; i < sizeof(pcts) / sizeof(pcts[0]); i++)
+		printf(" p%g %.3fms", pcts[i],
+				ns[(int)((n - 1) * pcts[i] / 100)] / 1e6);
+	printf(" max %.3fms mean %.3fms\n", ns[n - 1] / 1e6, sum / n / 1e6);
+}
+
+static void replay_free(struct replay *rp)
+{
+	for (int i = 0; i < rp->nstatements; i++)
+		free(rp->statements[i].text);
+	for (int i = 0; i < rp->nstubs; i++) {
+		free(rp->stubs[i].name);
+		free(rp->stubs[i].runs);
+	}
+
+	free(rp->statements);
+	free(rp->stubs);
+}
+
+int replay_run(const char *path, double speed)
+{
+	struct replay rp = { 0 };
+
+	if (replay_load(&rp, path) < 0)
+		return -1;
+
+	if (rp.nstatements == 0) {
+		fprintf(stderr, "%s: no statements\n", path);
+		replay_free(&rp);
+		return 0;
+	}
+
+	if (replay_setup(&rp) < 0 || chdir(rp.dir) < 0) {
+		replay_free(&rp);
+		return -1;
+	}
+
+	char memo[sizeof(rp.dir) + 8];
+
+	snprintf(memo, sizeof(memo), "%s/.memo", rp.dir);
+
+	// Contexts copy the environment, so it is set up first. Nothing is
+	// sent to workers, looked up in CDPATH, or kept in the make and memo
+	// stores of the caller.
+	setenv("PATH", rp.bin, 1);
+	setenv("MINISHELL_STUBS", rp.bin, 1);
+	setenv("MINISHELL_MEMO_DIR", memo, 1);
+	unsetenv("MINISHELL_MAKE_DB");
+	unsetenv("MINISHELL_WORKERS");
+	unsetenv("CDPATH");
+	unsetenv("OLDPWD");
+	replay_root = rp.dir;
+
+	struct minishell_ctx *ctx = ms_ctx_new();
+	int null_fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+	const int fds[3] = { null_fd, null_fd, -1 };
+	int64_t *latency = malloc(rp.nstatements * sizeof(*latency));
+	int64_t *recorded = malloc(rp.nstatements * sizeof(*recorded));
+	int64_t start = now_ns();
+	int n = 0;
+
+	DIE(latency == NULL || recorded == NULL, "Error allocating replay.");
+
+	for (int i = 0; i < rp.nstatements; i++) {
+		const struct replay_statement *s = &rp.statements[i];
+		int64_t due = now_ns();
+		int status;
+
+		// Open loop: a statement is due when it arrived, not when the
+		// one before it finished
+		if (speed > 0) {
+			due = start + s->arrival_us * 1000 / speed;
+			sleep_until(due);
+		}
+
+		ms_run(ctx, s->text, fds, &status);
+
+		latency[n] = now_ns() - due;
+		recorded[n++] = s->run_ns;
+
+		if (ms_exited(ctx))
+			break;
+	}
+
+	double elapsed = (now_ns() - start) / 1e9;
+	double span = rp.statements[rp.nstatements - 1].arrival_us / 1e6;
+
+	printf("replay: %d statements, %d stubs, in %.3fs (recorded %.3fs",
+			n, rp.nstubs, elapsed, span);
+	if (speed > 0)
+		printf(", at %gx", speed);
+	printf(")\n");
+	print_distribution("latency", latency, n);
+	print_distribution("recorded", recorded, n);
+
+	fflush(stdout);
+
+	ms_ctx_free(ctx);
+	replay_root = NULL;
+	if (null_fd >= 0)
+		close(null_fd);
+	free(latency);
+	free(recorded);
+	replay_cleanup(&rp);
+	replay_free(&rp);
+
+	return 0;
+}
+
+int replay_stub(const char *argv0)
+{
+	const char *dir = getenv("MINISHELL_STUBS");
+	const char *name = strrchr(argv0, '/');
+	char path[PATH_MAX], run[REPLAY_STUB_RECORD + 1];
+	unsigned long long ns;
+	struct stat st;
+	int status;
+
+	name = name != NULL ? name + 1 : argv0;
+	snprintf(path, sizeof(path), "%s/.%s", dir, name);
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+		return -1;
+
+	// Appending is atomic, so concurrent runs each get their own count
+	snprintf(path, sizeof(path), "%s/.%s.n", dir, name);
+
+	int count_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+			0644);
+	off_t n = count_fd >= 0 && write(count_fd, "", 1) == 1
+		? lseek(count_fd, 0, SEEK_CUR) - 1 : 0;
+	off_t nruns = fstat(fd, &st) == 0 ? st.st_size / REPLAY_STUB_RECORD
+		: 0;
+
+	if (count_fd >= 0)
+		close(count_fd);
+
+	// Past the runs recorded, they start over
+	off_t at = nruns > 0 ? n % nruns * REPLAY_STUB_RECORD : 0;
+	ssize_t len = pread(fd, run, REPLAY_STUB_RECORD, at);
+
+	close(fd);
+	if (len != REPLAY_STUB_RECORD)
+		return EXIT_SUCCESS;
+
+	run[len] = '\0';
+	if (sscanf(run, "%llu %d", &ns, &status) != 2)
+		return EXIT_SUCCESS;
+
+	sleep_until(now_ns() + ns);
+
+	return status;
+}
+
+bool replay_running(void)
+{
+	return replay_root != NULL;
+}
+
+void replay_command_name(char *name)
+{
+	char *slash = strrchr(name, '/');
+
+	if (replay_root != NULL && slash != NULL)
+		memmove(name, slash + 1, strlen(slash + 1) + 1);
+}
+
+int replay_confine(const char *path)
+{
+	bool inside = path[0] != '/' && strcmp(path, "-");
+
+	if (replay_root == NULL || !strcmp(path, "/dev/null"))
+		return 0;
+
+	// Relative and never going up, it stays under the scratch directory,
+	// which holds no symbolic links to directories
+	for (const char *p = path; inside && *p != '\0';) {
+		p += strspn(p, "/");
+		inside = strncmp(p, "..", 2) || (p[2] != '/' && p[2] != '\0');
+		p += strcspn(p, "/");
+	}
+
+	if (inside)
+		return 0;
+
+	fprintf(stderr, "replay: %s: outside the scratch directory\n", path);
+	errno = EACCES;
+
+	return -1;
+}
@@ -0,0 +1,75 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _REPLAY_H
+#define _REPLAY_H
+
+#include <stdbool.h>
+
+#define REPLAY_STUB_RECORD	32
+
+/*
+ * Replay of a recording (see record.h) as a benchmark.
+ *
+ * The statements are run again through ms_run(), each when it arrived in
+ * the recording, sped up by a factor, so that the shell sees the load it
+ * saw then. What is measured is the latency of each statement, from when
+ * it was due to when it finished; a shell that falls behind therefore
+ * shows it as queueing.
+ *
+ * Commands are not run for real: PATH only holds stubs, one per command
+ * name recorded, and commands run by path (e.g. /bin/touch) run the stub
+ * of their basename (see replay_command_name()). The Nth run of a stub
+ * sleeps for as long as the Nth recorded run of its command took, and
+ * exits with the same status. A stub is the shell binary itself under the
+ * command's name (see replay_stub()); its runs are in a file of fixed-size
+ * records next to it, and its run count in a file that each run appends a
+ * byte to. A command that was never recorded is not found.
+ *
+ * The statements run in a scratch directory, removed afterwards if they
+ * left nothing in it, and are kept in it: redirections, 'cd' and 'pushd'
+ * only take paths that stay under it (see replay_confine()), 'exec CMD'
+ * is refused, memo commands use a store in it, and the make database,
+ * CDPATH and remote workers are not used.
+ *
+ * What is not confined: 'source FILE' still reads any file, which has no
+ * effect outside the replay.
+ */
+
+/**
+ * Replay the recording at path, speed times faster than it was recorded
+ * (0 for back to back), and print the latency distribution.
+ *
+ * @return 0, or -1 with errno set if it could not be replayed (EINVAL if
+ * it is not a recording)
+ */
+int replay_run(const char *path, double speed);
+
+/**
+ * Act as the stub of the command argv0, if MINISHELL_STUBS names a stub
+ * directory that has one.
+ *
+ * @return its exit status, or -1 if it is not a stub
+ */
+int replay_stub(const char *argv0);
+
+/**
+ * Check if a recording is being replayed in this process.
+ */
+bool replay_running(void);
+
+/**
+ * While a recording is replayed, turn the command name into the name of
+ * its stub, in place: its basename.
+ */
+void replay_command_name(char *name);
+
+/**
+ * Check if path may be opened or entered: while a recording is replayed,
+ * only /dev/null and relative paths without '..' components may, and an
+ * error is printed for the others.
+ *
+ * @return 0, or -1 with errno set to EACCES
+ */
+int replay_confine(const char *path);
+
+#endif /* _REPLAY_H */
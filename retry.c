@@ -0,0 +1,138 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "proc.h"
+#include "retry.h"
+
+/**
+ * Wait until fd is readable, or ms milliseconds.
+ *
+ * @return true if it is readable
+ */
+static bool wait_readable(int fd, long ms)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	struct timespec start, now;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (;;) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		long left = ms - (now.tv_sec - start.tv_sec) * 1000
+			- (now.tv_nsec - start.tv_nsec) / 1000000;
+		int ret = poll(&pfd, 1, left > 0 ? left : 0);
+
+		if (ret >= 0 || errno != EINTR)
+			return ret > 0;
+	}
+}
+
+pid_t retry_wait(pid_t pid, long timeout_ms, int *status, bool *timed_out)
+{
+	*timed_out = false;
+
+	if (timeout_ms <= 0)
+		return waitpid(pid, status, 0);
+
+	// A pidfd becomes readable when the child exits
+	int fd = syscall(SYS_pidfd_open, pid, 0);
+
+	if (fd < 0) {
+		perror("retry: timeout not supported");
+		return waitpid(pid, status, 0);
+	}
+
+	// The child moves to its own group too (see retry.h); whichever of
+	// the two runs first, the group exists before it can be killed
+	setpgid(pid, pid);
+
+	if (!wait_readable(fd, timeout_ms)) {
+		*timed_out = true;
+		kill(-pid, SIGTERM);
+
+		if (!wait_readable(fd, RETRY_KILL_GRACE_MS))
+			kill(-pid, SIGKILL);
+	}
+
+	close(fd);
+
+	pid_t ret = waitpid(pid, status, 0);
+
+	// Nothing the timed out run started outlives it
+	if (*timed_out)
+		kill(-pid, SIGKILL);
+
+	if (*timed_out)
+		*status = RETRY_TIMEOUT_STATUS << 8;
+
+	return ret;
+}
+
+bool retry_retryable(const struct prefix_attrs *attrs, int status,
+		bool timed_out)
+{
+	if (timed_out)
+		return true;
+
+	if (WIFSIGNALED(status)) {
+		int sig = WTERMSIG(status);
+
+		return sig != SIGINT && sig != SIGQUIT;
+	}
+
+	int code = WEXITSTATUS(status);
+
+	if (attrs->has_retry_codes)
+		return attrs->retry_codes[code / 64] & (1ULL << (code % 64));
+
+	return code != 0 && code != 126 && code != 127;
+}
+
+void retry_sleep(const struct prefix_attrs *attrs, const char *name,
+		int status, int attempt)
+{
+	static bool seeded;
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	// Runs of parallel shells must not retry in lockstep; a simulation
+	// must do the same every time
+	if (!seeded) {
+		srandom(proc->simulated ? 1 : now.tv_nsec ^ getpid());
+		seeded = true;
+	}
+
+	long long ms = attrs->backoff_ms;
+
+	for (int i = 1; i < attempt && ms < RETRY_MAX_BACKOFF_MS; i++)
+		ms *= 2;
+	if (ms > RETRY_MAX_BACKOFF_MS)
+		ms = RETRY_MAX_BACKOFF_MS;
+
+	// Equal jitter: at least half of the backoff, at most all of it
+	if (ms > 0)
+		ms = ms / 2 + random() % (ms - ms / 2 + 1);
+
+	if (WIFSIGNALED(status))
+		fprintf(stderr, "retry: '%s' killed by signal %d", name,
+				WTERMSIG(status));
+	else
+		fprintf(stderr, "retry: '%s' failed with status %d", name,
+				WEXITSTATUS(status));
+	fprintf(stderr, ", attempt %d of %d in %.3fs\n", attempt + 1,
+			attrs->attempts, ms / 1e3);
+
+	proc->sleep(ms * 1000000);
+}
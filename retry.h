@@ -0,0 +1,62 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _RETRY_H
+#define _RETRY_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "prefix.h"
+
+#define RETRY_DEFAULT_ATTEMPTS		3
+#define RETRY_DEFAULT_BACKOFF_MS	100
+#define RETRY_MAX_BACKOFF_MS		30000
+#define RETRY_KILL_GRACE_MS		1000
+#define RETRY_TIMEOUT_STATUS		124
+
+/*
+ * 'retry [-n N] [-b MS] [-t SECS] [-c CODES] CMD' runs CMD (default
+ * RETRY_DEFAULT_ATTEMPTS) times at most, until it does not fail in a
+ * retryable way. The command is expanded and set up once; only the fork
+ * and exec are repeated.
+ *
+ * Before the k-th retry, the shell sleeps for a random time between half
+ * and all of MS * 2^(k-1) milliseconds (default RETRY_DEFAULT_BACKOFF_MS,
+ * at most RETRY_MAX_BACKOFF_MS), itself, without a sleep process.
+ *
+ * With -t, each run is started in a process group of its own. If it takes
+ * longer than SECS seconds, the group gets SIGTERM, then SIGKILL
+ * RETRY_KILL_GRACE_MS milliseconds later if the run is still there, and
+ * SIGKILL again once it is gone, so that nothing it started lingers. Its
+ * status is RETRY_TIMEOUT_STATUS, as with timeout(1), and it is always
+ * retryable. As with timeout(1), such a run is not in the terminal's
+ * foreground group: it does not get the terminal's SIGINT, and stops if it
+ * reads from the terminal.
+ *
+ * Otherwise a run is retryable if it exited with a code in CODES (a list
+ * like 1,75-78), or, without -c, with any code but 0, 126 and 127 (the
+ * command cannot run at all); or if it was killed by any signal but
+ * SIGINT and SIGQUIT, which are the user asking to stop.
+ */
+
+/**
+ * Wait for a child, for at most timeout_ms milliseconds if it is not 0;
+ * then the child's process group is killed.
+ *
+ * @return pid, or -1 on error
+ */
+pid_t retry_wait(pid_t pid, long timeout_ms, int *status, bool *timed_out);
+
+/**
+ * Check if a run of a command with attrs ended in a retryable way.
+ */
+bool retry_retryable(const struct prefix_attrs *attrs, int status,
+		bool timed_out);
+
+/**
+ * Report the failed attempt of name and sleep before the next one.
+ */
+void retry_sleep(const struct prefix_attrs *attrs, const char *name,
+		int status, int attempt);
+
+#endif /* _RETRY_H */
@@ -0,0 +1,254 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cmd.h"
+#include "plan.h"
+#include "source.h"
+#include "utils.h"
+
+/**
+ * The lowered statements of a sourced file, valid as long as the file
+ * keeps the same identity, modification time and size.
+ */
+struct source_entry {
+	dev_t dev;
+	ino_t ino;
+	struct timespec mtime;
+	off_t size;
+
+	struct plan **plans;
+	int nplans;
+
+	// Number of source_file() calls currently running these plans
+	int active;
+
+	struct source_entry *next;
+};
+
+static struct source_entry *sources;
+static int source_depth;
+
+static bool source_fresh(const struct source_entry *e, const struct stat *st)
+{
+	return e->size == st->st_size
+		&& e->mtime.tv_sec == st->st_mtim.tv_sec
+		&& e->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static void source_add_plan(struct source_entry *e, const char *text)
+{
+	struct plan *plan = plan_compile(text);
+
+	if (plan == NULL)
+		return;
+
+	e->plans = realloc(e->plans, (e->nplans + 1) * sizeof(*e->plans));
+	DIE(e->plans == NULL, "Error allocating source plan.");
+
+	e->plans[e->nplans++] = plan;
+}
+
+/**
+ * Split the text of a file into statements, like start_shell() does with
+ * its input: one per line, except for constructs spanning several lines.
+ * Blank lines and '#' comment lines are skipped.
+ */
+static void source_compile(struct source_entry *e, char *text)
+{
+	struct word_buf stmt = { NULL, 0, 0 };
+	char *line = text;
+
+	while (line != NULL && *line != '\0') {
+		char *nl = strchr(line, '\n');
+
+		if (nl != NULL)
+			*nl = '\0';
+
+		size_t len = strlen(line);
+
+		if (len > 0 && line[len - 1] == '\r')
+			line[--len] = '\0';
+
+		const char *p = line + strspn(line, " \t");
+
+		if (stmt.len == 0 && (*p == '\0' || *p == '#')) {
+			line = nl != NULL ? nl + 1 : NULL;
+			continue;
+		}
+
+		if (stmt.len > 0)
+			word_buf_append(&stmt, "\n", 1);
+		word_buf_append(&stmt, line, len);
+
+		if (!plan_incomplete(stmt.data)) {
+			source_add_plan(e, stmt.data);
+			stmt.len = 0;
+		}
+
+		line = nl != NULL ? nl + 1 : NULL;
+	}
+
+	// An unterminated construct at the end of the file
+	if (stmt.len > 0)
+		source_add_plan(e, stmt.data);
+
+	free(stmt.data);
+}
+
+static void source_clear(struct source_entry *e)
+{
+	for (int i = 0; i < e->nplans; i++)
+		plan_free(e->plans[i]);
+
+	free(e->plans);
+	e->plans = NULL;
+	e->nplans = 0;
+}
+
+/**
+ * Append the whole file open as fd to text. The file is read with a buffer
+ * of its own, so whatever the shell has buffered from its input (see
+ * input.h) is left as it is.
+ */
+static int source_read(int fd, struct word_buf *text)
+{
+	char block[SOURCE_BLOCK_SIZE];
+
+	for (;;) {
+		ssize_t n = read(fd, block, sizeof(block));
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return n;
+
+		word_buf_append(text, block, n);
+	}
+}
+
+/**
+ * Read and lower the file open as fd into e.
+ */
+static int source_load(struct source_entry *e, int fd, const struct stat *st)
+{
+	struct word_buf text = { NULL, 0, 0 };
+
+	if (source_read(fd, &text) < 0) {
+		free(text.data);
+		return -1;
+	}
+
+	word_buf_append(&text, "", 0);
+
+	e->dev = st->st_dev;
+	e->ino = st->st_ino;
+	e->mtime = st->st_mtim;
+	e->size = st->st_size;
+
+	source_compile(e, text.data);
+	free(text.data);
+
+	return 0;
+}
+
+/**
+ * Return up to date plans for the file open as fd. A stale entry that is
+ * still running (the file sources itself after changing) is left alone
+ * and a fresh, uncached entry is returned; *cached tells them apart.
+ */
+static struct source_entry *source_lookup(int fd, bool *cached)
+{
+	struct stat st;
+	struct source_entry *e;
+
+	if (fstat(fd, &st) < 0)
+		return NULL;
+
+	for (e = sources; e != NULL; e = e->next)
+		if (e->dev == st.st_dev && e->ino == st.st_ino)
+			break;
+
+	*cached = true;
+
+	if (e != NULL && source_fresh(e, &st))
+		return e;
+
+	if (e != NULL && e->active > 0) {
+		*cached = false;
+		e = NULL;
+	}
+
+	if (e == NULL) {
+		e = calloc(1, sizeof(*e));
+		DIE(e == NULL, "Error allocating source entry.");
+
+		if (*cached) {
+			e->next = sources;
+			sources = e;
+		}
+	} else {
+		source_clear(e);
+	}
+
+	if (source_load(e, fd, &st) < 0) {
+		// Keep the (now empty) entry, it is reloaded on the next call
+		if (!*cached)
+			free(e);
+		return NULL;
+	}
+
+	return e;
+}
+
+int source_file(const char *path)
+{
+	bool cached;
+	int ret = 0;
+
+	if (source_depth >= SOURCE_MAX_DEPTH) {
+		fprintf(stderr, "source: %s: nested too deeply\n", path);
+		return EXIT_FAILURE;
+	}
+
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0) {
+		fprintf(stderr, "source: %s: ", path);
+		perror(NULL);
+		return EXIT_FAILURE;
+	}
+
+	struct source_entry *e = source_lookup(fd, &cached);
+
+	close(fd);
+
+	if (e == NULL) {
+		fprintf(stderr, "source: cannot read %s\n", path);
+		return EXIT_FAILURE;
+	}
+
+	source_depth++;
+	e->active++;
+
+	for (int i = 0; i < e->nplans && ret != SHELL_EXIT; i++)
+		ret = plan_run(e->plans[i]);
+
+	e->active--;
+	source_depth--;
+
+	if (!cached) {
+		source_clear(e);
+		free(e);
+	}
+
+	return ret;
+}
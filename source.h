@@ -0,0 +1,21 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _SOURCE_H
+#define _SOURCE_H
+
+#define SOURCE_MAX_DEPTH	64
+#define SOURCE_BLOCK_SIZE	4096
+
+/**
+ * Run the commands of a file in the current shell ('source' and '.').
+ *
+ * The file is split into statements and lowered into plans once; the plans
+ * stay in memory keyed by the file's device, inode, modification time and
+ * size, so sourcing an unchanged file again neither reads nor parses it.
+ *
+ * @return the exit status of the last command, SHELL_EXIT if the file
+ * exited the shell, or 1 if it cannot be read
+ */
+int source_file(const char *path);
+
+#endif /* _SOURCE_H */
@@ -0,0 +1,33 @@
+#!/bin/sh
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Check case statements: keywords only in command position, and patterns
+# expanded when they run. Usage: tests/case.sh [SHELL]
+
+. "$(dirname "$0")/lib.sh"
+
+setup='x=hi
+y=*.c
+z=a.c
+'
+
+check 'case $x in hi) echo esac;; *) echo star;; esac'	'esac'
+check 'case $x in
+h*) echo case esac in
+;;
+esac
+echo after'							'case esac in
+after'
+check 'case $x in h?) echo a;; esac; echo esac'			'a
+esac'
+
+# Unquoted values are patterns, quoted ones are literal
+check 'case $z in $y) echo glob;; *) echo no;; esac'		'glob'
+check 'case $z in "$y") echo literal;; *) echo no;; esac'	'no'
+check 'case "*.c" in "$y") echo literal;; *) echo no;; esac'	'literal'
+check 'case $z in ${y%.c}.c) echo braces;; esac'		'braces'
+check 'case $z in b|${q:-a}.c) echo default;; esac'		'default'
+check 'y=a*
+case $z in $y) echo changed;; esac'				'changed'
+
+finish case
@@ -0,0 +1,26 @@
+#!/bin/sh
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Check '[[ ... ]]' tests, and the capture groups of '=~' in BASH_REMATCH.
+# Usage: tests/cond.sh [SHELL]
+
+. "$(dirname "$0")/lib.sh"
+
+setup='x=abc
+'
+
+check '[[ $x =~ ^a(b)c$ ]] && echo ${BASH_REMATCH[0]} ${BASH_REMATCH[1]}' \
+							'abc b'
+check '[[ $x =~ (a)(x)?(c)? ]] && echo ${#BASH_REMATCH[@]}' '4'
+check '[[ $x =~ z ]] || echo ${#BASH_REMATCH[@]}'	'0'
+check '[[ $x == a* ]] && echo glob'			'glob'
+check '[[ 3 -lt 10 ]] && echo less'			'less'
+
+# A regex with '|' must be quoted or come from a variable, and
+# stays a regex when quoted (see cond.h)
+check 'r="^a(b|c)c$"
+[[ $x =~ $r ]] && echo ${BASH_REMATCH[1]}'		'b'
+check '[[ $x =~ "^a(b|c)c$" ]] && echo ${BASH_REMATCH[1]}' 'b'
+check '[[ $x =~ "a.c" ]] && echo regex'			'regex'
+
+finish cond
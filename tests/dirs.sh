@@ -0,0 +1,29 @@
+#!/bin/sh
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Check that cached directories are reopened once removed, or renamed and
+# replaced, with and without their parent cached. Usage: tests/dirs.sh [SHELL]
+
+. "$(dirname "$0")/lib.sh"
+
+# Enter $tmp/$1/b once, then replace it by an empty directory
+replace()
+{
+	printf '%s\n' "mkdir -p $tmp/$1/b" "cd $tmp/$1/b" "touch old" \
+		"cd $tmp" "mv $1/b $1/b-old" "mkdir $1/b"
+}
+
+# The parent is cached
+check "$(replace p)
+cd $tmp/p
+cd b
+ls"							''
+# The parent is not
+check "$(replace q)
+cd $tmp/q/b
+ls"							''
+check "$(replace r)
+rmdir r/b
+cd $tmp/r/b 2>/dev/null || echo gone"			'gone'
+
+finish dirs
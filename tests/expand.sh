@@ -0,0 +1,33 @@
+#!/bin/sh
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Check '${...}' expansions, quoted and unquoted, against the expected
+# output. Usage: tests/expand.sh [SHELL]
+
+. "$(dirname "$0")/lib.sh"
+
+setup='x=hello
+'
+
+check 'echo ${x} "${x}" "a${x}b"'		'hello hello ahellob'
+check 'echo "${x}${x}" "$x"'			'hellohello hello'
+check 'echo "${x:-d}" "${y:-d}" "${y:-a b}"'	'hello d a b'
+check 'echo "${#x}" ${#x}'			'5 5'
+check 'echo "${x#h}" "${x##*l}"'		'ello o'
+check 'echo "${x%o}" "${x%%l*}"'		'hell he'
+check 'echo "${x/l/L}" "${x//l/L}"'		'heLlo heLLo'
+check 'echo "${x/#h/H}" "${x/%o/O}"'		'Hello hellO'
+check 'echo "${x:1:2}" "${x: -3}" "${x:1}"'	'el llo ello'
+check 'echo "${x:-${y}}" ${x:-${y}}'		'hello hello'
+
+# Default values and replacements are expanded too, with y unset
+check 'echo "[${y:-$x}]" [${y:-$x}]'		'[hello] [hello]'
+check 'echo "[${y:-${x}}]" [${y:-${x}}]'	'[hello] [hello]'
+check 'echo ${y:-${z:-$x!}} "${y:-a $x}"'	'hello! a hello'
+check 'echo "${x/l/$x}" ${x//l/${x:0:1}}'	'hehellolo hehho'
+check 'echo "${x:-$y}" "[${y:-$y}]"'		'hello []'
+
+check 'echo "$" "a $ b"'			'$ a $ b'
+check 'echo "${}"'				'Bad substitution: ${}'
+
+finish expand
@@ -0,0 +1,37 @@
+#!/bin/sh
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Check that --resume skips what a --journal run completed, even one that
+# was killed, and runs the rest. Usage: tests/journal.sh [SHELL]
+
+. "$(dirname "$0")/lib.sh"
+
+# The shell is killed at the last but one line, the first time
+cat > "$tmp/script" <<'SCRIPT'
+sh -c 'echo a >> log'
+x=set
+test -e ok
+sh -c 'echo b$x >> log'
+sh -c 'test -e ok || kill -9 $PPID'
+sh -c 'echo c >> log'
+SCRIPT
+
+# Through sh, which reports the kill to the discarded error
+(cd "$tmp" && sh -c '"$1" --journal journal < script > /dev/null' - \
+	"$SHELL_UNDER_TEST" 2>/dev/null)
+assert "the killed run did not stop" test "$(cat "$tmp/log")" = "a
+bset"
+
+touch "$tmp/ok"
+got=$(cd "$tmp" && "$SHELL_UNDER_TEST" --resume journal < script 2>&1 \
+	| sed -e 's/^\(> \)*//' -e '/^$/d')
+
+# The assignment runs again, the failed test is retried, and only the
+# commands that succeeded are skipped
+assert "completed commands ran again" test "$(cat "$tmp/log")" = "a
+bset
+c"
+assert "the skipped commands were not reported" \
+	test "$got" = "journal: skipped 2 commands already done"
+
+finish journal
@@ -0,0 +1,51 @@
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Helpers of the behaviour tests, sourced by each of them. A test is run
+# as 'sh tests/NAME.sh [SHELL]' from the source directory; it runs in a
+# scratch directory of its own, $tmp, removed when it ends.
+
+SHELL_UNDER_TEST=${1:-./mini-shell}
+case $SHELL_UNDER_TEST in
+/*) ;;
+*) SHELL_UNDER_TEST=$(pwd)/$SHELL_UNDER_TEST ;;
+esac
+
+failed=0
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+# Statements run before those of each check
+setup=
+
+# Run the statements in $tmp and compare what is printed, without the
+# prompts, to the expected text
+check()
+{
+	got=$(cd "$tmp" && printf '%s%s\n' "$setup" "$1" \
+		| "$SHELL_UNDER_TEST" 2>&1 | sed -e 's/^\(> \)*//' -e '/^$/d')
+
+	if [ "$got" != "$2" ]; then
+		printf 'FAIL: %s\n  expected: %s\n  got:      %s\n' \
+			"$1" "$2" "$got"
+		failed=1
+	fi
+}
+
+# Check that a command succeeds
+assert()
+{
+	what=$1
+	shift
+
+	if ! "$@"; then
+		printf 'FAIL: %s\n' "$what"
+		failed=1
+	fi
+}
+
+# Report and exit with the result of the test named $1
+finish()
+{
+	[ $failed -eq 0 ] && echo "$1: all passed"
+	exit $failed
+}
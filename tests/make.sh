@@ -0,0 +1,28 @@
+#!/bin/sh
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Check that shells sharing a make database keep each other's records.
+# Usage: tests/make.sh [SHELL]
+
+. "$(dirname "$0")/lib.sh"
+
+export MINISHELL_MAKE_DB="$tmp/db"
+
+# Each shell makes its own 20 files at the same time as the others
+for s in 1 2 3 4 5 6 7 8; do
+	for f in $(seq 20); do
+		echo "@out $s.$f touch $s.$f"
+	done > "$tmp/script$s"
+	(cd "$tmp" && "$SHELL_UNDER_TEST" < "script$s" > /dev/null 2>&1) &
+done
+wait
+
+assert "records of concurrent shells were lost" \
+	test "$(cut -d' ' -f1 "$tmp/db" | sort -u | wc -l)" -eq 160
+
+# With the database, each shell finds all of its commands up to date
+got=$(cd "$tmp" && "$SHELL_UNDER_TEST" < script3 2>&1 >/dev/null)
+assert "commands recorded were not up to date" \
+	sh -c 'echo "$1" | grep -q "20 of 20 commands up to date"' - "$got"
+
+finish make
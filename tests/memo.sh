@@ -0,0 +1,30 @@
+#!/bin/sh
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Check that memo replays successful runs and runs failed ones again.
+# Usage: tests/memo.sh [SHELL]
+
+. "$(dirname "$0")/lib.sh"
+
+# The statistics printed at exit go to the silenced error
+setup="MINISHELL_MEMO_DIR=$tmp/store
+exec 2>/dev/null
+"
+
+check 'memo sh -c "echo run >> ok; echo out" < /dev/null
+memo sh -c "echo run >> ok; echo out" < /dev/null
+wc -l < ok'						'out
+out
+1'
+check 'memo sh -c "echo run >> failed; exit 3" < /dev/null || echo failed
+memo sh -c "echo run >> failed; exit 3" < /dev/null || echo failed
+wc -l < failed'						'failed
+failed
+2'
+
+# A later run of a failed command is retried, not replayed
+check 'retry -n3 -b0 memo sh -c "echo run >> flaky; exit 1" < /dev/null
+retry -n3 -b0 memo sh -c "echo run >> flaky; exit 1" < /dev/null
+wc -l < flaky'						'6'
+
+finish memo
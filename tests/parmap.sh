@@ -0,0 +1,36 @@
+#!/bin/sh
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Check parmap: runs per line or batch, '{}' substitution, and the status
+# of failed and missing commands. Usage: tests/parmap.sh [SHELL]
+
+. "$(dirname "$0")/lib.sh"
+
+printf '#!/bin/sh\n' > "$tmp/notexec"
+
+check 'seq 6 | parmap -j 3 echo x{} | sort'		'x1
+x2
+x3
+x4
+x5
+x6'
+check 'seq 4 | parmap -n 2 echo a{}b | sort'		'a1 2b
+a3 4b'
+check 'seq 3 | parmap -n 3 echo {} end'			'1 2 3 end'
+check 'seq 2 | parmap echo | sort'			'1
+2'
+
+# A failed run fails the whole map; a command that cannot run fails it
+# before any run
+check "seq 3 | parmap sh -c 'test \$0 != 2' || echo failed"	'failed'
+check 'seq 2 | parmap ./notexec || echo not run'	'parmap: ./notexec: command not found
+not run'
+check 'seq 2 | parmap nosuchcommand || echo not run'	'parmap: nosuchcommand: command not found
+not run'
+
+# Runs of the shell's other commands are not parmap's to reap
+check 'sh -c "sleep 0.3; echo other" & seq 3 | parmap -j 2 sleep 0.1
+echo end'						'other
+end'
+
+finish parmap
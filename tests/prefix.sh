@@ -0,0 +1,29 @@
+#!/bin/sh
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Check that resource prefixes take the option syntax of the real tools,
+# and leave options they do not know to them. Usage: tests/prefix.sh [SHELL]
+
+. "$(dirname "$0")/lib.sh"
+
+niceness="sh -c 'cut -d\" \" -f19 /proc/self/stat'"
+base=$(cut -d' ' -f19 /proc/self/stat)
+
+check "nice -n5 $niceness" $((base + 5))
+check "nice --adjustment=3 $niceness" $((base + 3))
+check "nice --adjustment 2 $niceness" $((base + 2))
+check "nice -4 $niceness" $((base + 4))
+check 'nice -- echo hi' 'hi'
+check 'ionice -c3 echo a; ionice --class=idle echo b' 'a
+b'
+check 'taskset -c 0 echo a; taskset --cpu-list 0 echo b' 'a
+b'
+check 'retry -n2 -b0 sh -c "echo run; exit 1" || echo failed' "run
+retry: 'sh' failed with status 1, attempt 2 of 2 in 0.000s
+run
+failed"
+
+# The real tool gets the options only it knows
+check 'nice -x echo hi 2>/dev/null || echo tool' 'tool'
+
+finish prefix
@@ -0,0 +1,26 @@
+#!/bin/sh
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Check that 'read' takes the line after it from the input the script is
+# read from, on a pipe and on a file. Usage: tests/read.sh [SHELL]
+
+. "$(dirname "$0")/lib.sh"
+
+check 'read x
+hello
+echo got=$x' 'got=hello'
+check 'read x y
+one two three
+echo $y
+read z
+last
+echo $x $z' 'two three
+one last'
+
+printf '%s\n' 'read x' 'from file' 'echo got=$x' > "$tmp/script"
+got=$(cd "$tmp" && "$SHELL_UNDER_TEST" < script 2>&1 \
+	| sed -e 's/^\(> \)*//' -e '/^$/d')
+assert "a script file lost the line after 'read'" \
+	test "$got" = 'got=from file'
+
+finish read
@@ -0,0 +1,34 @@
+#!/bin/sh
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Check that redirections apply in source order and that a descriptor
+# the user opens does not clobber one the shell holds. Usage:
+# tests/redir.sh [SHELL]
+
+. "$(dirname "$0")/lib.sh"
+
+mkdir "$tmp/d"
+
+# Stderr goes where stdout pointed before it was moved
+check 'ls /nonexistent 2>&1 >out | wc -l
+cat out' '1'
+check 'ls /nonexistent >out 2>&1
+wc -l < out' '1'
+check 'ls /nonexistent &>out
+wc -l < out' '1'
+check 'echo a 3>f >&3
+cat f' 'a'
+
+# Low descriptors stay the user's across a cd and a record
+check 'exec 3>log
+echo one >&3
+cd d
+echo two >&3
+cd ..
+cat log' 'one
+two'
+cd "$tmp" && printf '%s\n' 'exec 3>log' 'echo kept' \
+	| "$SHELL_UNDER_TEST" --record "$tmp/rec" > /dev/null 2>&1
+assert "opening fd 3 clobbered the recording" test -s "$tmp/rec"
+
+finish redir
@@ -0,0 +1,34 @@
+#!/bin/sh
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Check that replaying a recording runs nothing for real outside its
+# scratch directory. Usage: tests/replay.sh [SHELL]
+
+. "$(dirname "$0")/lib.sh"
+
+out=$tmp/outside
+mkdir "$out"
+echo keep > "$out/kept"
+
+# Recorded for real, then put back as it was
+cd "$tmp" && printf '%s\n' "/bin/touch $out/made" "true > $out/kept" \
+	"cd $out" "cd .." "exec 5>$out/kept" "pushd $out" \
+	"exec nosuchcommand" "/bin/echo stubbed > /dev/null" \
+	| "$SHELL_UNDER_TEST" --record "$tmp/rec" > /dev/null 2>&1
+rm -f "$out/made"
+echo keep > "$out/kept"
+
+replayed=$("$SHELL_UNDER_TEST" --replay "$tmp/rec" 0 2>&1)
+
+assert "a command run by path ran" test ! -e "$out/made"
+assert "a redirection outside was opened" test "$(cat "$out/kept")" = keep
+assert "the replay did not run" \
+	sh -c 'echo "$1" | grep -q "^replay: 8 statements,"' - \
+	"$replayed"
+assert "an absolute cd was not refused" \
+	sh -c 'echo "$1" | grep -q "^replay: $2: outside"' - "$replayed" "$out"
+assert "'exec CMD' was not refused" \
+	sh -c 'echo "$1" | grep -q "^exec: not run in a replay"' - "$replayed"
+
+[ $failed -eq 0 ] || echo "$replayed"
+finish replay
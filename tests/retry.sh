@@ -0,0 +1,29 @@
+#!/bin/sh
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Check retry: attempts, retryable exit codes, and timeouts that kill all
+# of a run. Usage: tests/retry.sh [SHELL]
+
+. "$(dirname "$0")/lib.sh"
+
+check 'retry -n3 -b0 sh -c "echo run >> a; exit 3" || echo gave up
+wc -l < a'						"retry: 'sh' failed with status 3, attempt 2 of 3 in 0.000s
+retry: 'sh' failed with status 3, attempt 3 of 3 in 0.000s
+gave up
+3"
+check 'retry -n3 -b0 -c 1,4-5 sh -c "echo run >> b; exit 3" || echo no retry
+wc -l < b'						'no retry
+1'
+check 'retry -n3 -b0 sh -c "echo run >> c"
+wc -l < c'						'1'
+
+# A timed out run is killed with the children it left behind, which would
+# otherwise write their mark after it
+check 'retry -n2 -b0 -t1 sh -c "(sleep 2; echo leaked >> d) & echo run >> d; wait" || echo timed out'	"retry: 'sh' failed with status 124, attempt 2 of 2 in 0.000s
+timed out"
+sleep 2
+assert "a timed out run left children behind" \
+	test "$(cat "$tmp/d")" = "run
+run"
+
+finish retry
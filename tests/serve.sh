@@ -0,0 +1,25 @@
+#!/bin/sh
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Check that --serve replaces only a socket, and makes its own readable by
+# its user only. Usage: tests/serve.sh [SHELL]
+
+. "$(dirname "$0")/lib.sh"
+
+# A shell that took the file would serve on it until killed
+echo keep > "$tmp/file"
+timeout 2 "$SHELL_UNDER_TEST" --serve "$tmp/file" 2>/dev/null
+assert "a file was served on" test $? -ne 0
+assert "a file was removed" test "$(cat "$tmp/file")" = keep
+
+(umask 0 && exec "$SHELL_UNDER_TEST" --serve "$tmp/sock") &
+server=$!
+for i in 1 2 3 4 5 6 7 8 9 10; do
+	[ -S "$tmp/sock" ] && break
+	sleep 0.1
+done
+assert "the socket follows the umask" \
+	test "$(stat -c %a "$tmp/sock" 2>/dev/null)" = 600
+kill $server
+
+finish serve
@@ -0,0 +1,38 @@
+#!/bin/sh
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Check 'source' and '.': changed files are read again, nesting is bounded,
+# and the shell's own input is left alone. Usage: tests/source.sh [SHELL]
+
+. "$(dirname "$0")/lib.sh"
+
+setup='echo v=one > a.sh
+echo "source self.sh" > self.sh
+'
+
+check 'source a.sh
+echo $v'						'one'
+# The cached plans of a file are dropped once it changes, size or not
+check 'source a.sh
+echo v=six > a.sh
+. a.sh
+echo $v
+echo "v=seven; echo changed" > a.sh
+. a.sh
+echo $v'						'six
+changed
+seven'
+check 'source self.sh || echo deep'			'source: self.sh: nested too deeply
+deep'
+check 'source nope.sh || echo missing'			'source: nope.sh: No such file or directory
+missing'
+
+# The lines after 'read' still come from the shell's input
+check 'read p
+P
+source a.sh
+read q
+Q
+echo $p $q'						'P Q'
+
+finish source
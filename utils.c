@@ -1,47 +1,104 @@
 // SPDX-License-Identifier: BSD-3-Clause
 
+#include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
+#include "account.h"
+#include "expand.h"
 #include "utils.h"
 
+#define CHUNK_SIZE		1024
+
+/**
+ * Append n bytes of s to the buffer.
+ */
+void word_buf_append(struct word_buf *buf, const char *s, size_t n)
+{
+	if (buf->len + n + 1 > buf->size) {
+		size_t size = buf->size ? buf->size : 32;
+
+		while (buf->len + n + 1 > size)
+			size *= 2;
+
+		buf->data = realloc(buf->data, size);
+		DIE(buf->data == NULL, "Error allocating word string.");
+		buf->size = size;
+	}
+
+	memcpy(buf->data + buf->len, s, n);
+	buf->len += n;
+	buf->data[buf->len] = '\0';
+}
+
+#define HASH_BLOCK_SIZE		(64 * 1024)
+
+unsigned long long fnv1a(unsigned long long h, const void *data, size_t n)
+{
+	const unsigned char *p = data;
+
+	for (size_t i = 0; i < n; i++)
+		h = (h ^ p[i]) * FNV_PRIME;
+
+	return h;
+}
+
+bool fnv1a_file(unsigned long long *h, const char *path)
+{
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	char *block;
+	ssize_t len;
+
+	if (fd < 0)
+		return false;
+
+	block = malloc(HASH_BLOCK_SIZE);
+	DIE(block == NULL, "Error allocating hash buffer.");
+
+	*h = fnv1a(*h, path, strlen(path) + 1);
+	while ((len = read(fd, block, HASH_BLOCK_SIZE)) > 0)
+		*h = fnv1a(*h, block, len);
+
+	free(block);
+	close(fd);
+
+	return len == 0;
+}
+
 /**
  * Concatenate parts of the word to obtain the command.
  */
 char *get_word(word_t *s)
 {
-	char *string = NULL;
-	int string_length = 0;
-
-	const char *substring = NULL;
-	int substring_length = 0;
+	struct word_buf buf = { NULL, 0, 0 };
 
-	while (s != NULL) {
-		if (s->expand == true) {
-			substring = getenv(s->string);
-
-			/* Prevents strlen from failing. */
-			if (substring == NULL)
-				substring = "";
-		} else {
-			substring = s->string;
-		}
+	if (s == NULL)
+		return NULL;
 
-		substring_length = strlen(substring);
+	enum account_site prev = account_enter(ACCOUNT_GET_WORD);
 
-		string = realloc(string, string_length + substring_length + 1);
-		DIE(string == NULL, "Error allocating word string.");
+	/* An empty word still yields an empty string. */
+	word_buf_append(&buf, "", 0);
 
-		string[string_length] = '\0';
-		strcat(string, substring);
+	while (s != NULL) {
+		if (s->expand == true && s->string[0] == '\0') {
+			s = expand_quoted(s, &buf);
+			continue;
+		}
 
-		string_length += substring_length;
+		if (s->expand == true)
+			expand_param(s->string, &buf);
+		else
+			word_buf_append(&buf, s->string, strlen(s->string));
 
 		s = s->next_part;
 	}
 
-	return string;
+	account_leave(prev);
+
+	return buf.data;
 }
 
 /**
@@ -55,6 +112,8 @@ char **get_argv(simple_command_t *command, int *size)
 
 	word_t *param;
 
+	enum account_site prev = account_enter(ACCOUNT_GET_ARGV);
+
 	argc = 1;
 
 	/* Get parameters number. */
@@ -82,5 +141,86 @@ char **get_argv(simple_command_t *command, int *size)
 
 	*size = argc;
 
+	account_leave(prev);
+
 	return argv;
 }
+
+/**
+ * Free a list returned by get_argv.
+ */
+void free_argv(char **argv, int size)
+{
+	if (argv == NULL)
+		return;
+
+	for (int i = 0; i < size; i++)
+		free(argv[i]);
+
+	free(argv);
+}
+
+/**
+ * Readline from mini-shell.
+ */
+char *read_line(FILE *in)
+{
+	char *line = NULL;
+	int line_length = 0;
+
+	char chunk[CHUNK_SIZE];
+	int chunk_length;
+
+	char *rc;
+
+	int endline = 0;
+
+	enum account_site prev = account_enter(ACCOUNT_READ_LINE);
+
+	while (!endline) {
+		rc = fgets(chunk, CHUNK_SIZE, in);
+		if (rc == NULL)
+			break;
+
+		chunk_length = strlen(chunk);
+		if (chunk[chunk_length - 1] == '\n') {
+			if (chunk_length > 1 && chunk[chunk_length - 2] == '\r')
+				/* Windows */
+				chunk[chunk_length - 2] = 0;
+			else
+				chunk[chunk_length - 1] = 0;
+			endline = 1;
+		}
+
+		line = realloc(line, line_length + CHUNK_SIZE);
+		DIE(line == NULL, "Error allocating command line");
+
+		line[line_length] = '\0';
+		strcat(line, chunk);
+
+		line_length += CHUNK_SIZE;
+	}
+
+	account_leave(prev);
+
+	return line;
+}
+
+void child_exit(int status)
+{
+	fflush(stdout);
+	fflush(stderr);
+	_exit(status);
+}
+
+int fd_move_high(int fd)
+{
+	if (fd < 0 || fd >= SHELL_FD_MIN)
+		return fd;
+
+	int high = fcntl(fd, F_DUPFD_CLOEXEC, SHELL_FD_MIN);
+
+	close(fd);
+
+	return high;
+}
@@ -3,6 +3,10 @@
 #ifndef _UTILS_H
 #define _UTILS_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
 #include "../util/parser/parser.h"
 
 
@@ -17,6 +21,43 @@
 		}						\
 	} while (0)
 
+/*
+ * Lowest fd the shell keeps its own files at. Scripts redirect 0 to 9
+ * (e.g. 'exec 3>file'), which must never close one of them; as in other
+ * shells, redirecting higher fds may.
+ */
+#define SHELL_FD_MIN		10
+
+/**
+ * Growable output buffer of a word. 'data' is always NUL terminated once
+ * something (even an empty string) has been appended.
+ */
+struct word_buf {
+	char *data;
+	size_t len;
+	size_t size;
+};
+
+/**
+ * Append n bytes of s to the buffer.
+ */
+void word_buf_append(struct word_buf *buf, const char *s, size_t n);
+
+#define FNV_OFFSET		0xcbf29ce484222325ULL
+#define FNV_PRIME		0x100000001b3ULL
+
+/**
+ * Continue the 64-bit FNV-1a hash h over n bytes of data.
+ */
+unsigned long long fnv1a(unsigned long long h, const void *data, size_t n);
+
+/**
+ * Continue the FNV-1a hash h over the name and the contents of a file.
+ *
+ * @return false if the file cannot be read
+ */
+bool fnv1a_file(unsigned long long *h, const char *path);
+
 /**
  * Concatenate parts of the word to obtain the command.
  */
@@ -28,4 +69,30 @@ char *get_word(word_t *s);
  */
 char **get_argv(simple_command_t *command, int *size);
 
+/**
+ * Free a list returned by get_argv.
+ */
+void free_argv(char **argv, int size);
+
+/**
+ * Read a line from in, without its line ending.
+ *
+ * @return the line, to free, or NULL at the end of in
+ */
+char *read_line(FILE *in);
+
+/**
+ * End a child process of the shell: flush its standard output and error,
+ * then _exit(), so the atexit() handlers of a program embedding the shell
+ * never run in it.
+ */
+void child_exit(int status) __attribute__((noreturn));
+
+/**
+ * Move an fd the shell keeps open to SHELL_FD_MIN or above, close-on-exec.
+ *
+ * @return the new fd, or -1 with errno set (fd is closed either way)
+ */
+int fd_move_high(int fd);
+
 #endif /* _UTILS_H */
@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "utils.h"
+#include "vars.h"
+
+struct array_var {
+	char *name;
+	char **values;
+	int n;
+	struct array_var *next;
+};
+
+static struct array_var *arrays;
+
+static struct array_var **vars_array_find(const char *name)
+{
+	struct array_var **a = &arrays;
+
+	while (*a != NULL && strcmp((*a)->name, name))
+		a = &(*a)->next;
+
+	return a;
+}
+
+static void vars_array_clear(struct array_var *a)
+{
+	for (int i = 0; i < a->n; i++)
+		free(a->values[i]);
+	free(a->values);
+}
+
+void vars_array_set(const char *name, char **values, int n)
+{
+	struct array_var **slot = vars_array_find(name);
+	struct array_var *a = *slot;
+
+	if (a == NULL) {
+		a = calloc(1, sizeof(*a));
+		DIE(a == NULL, "Error allocating array.");
+
+		a->name = strdup(name);
+		DIE(a->name == NULL, "Error allocating array.");
+
+		*slot = a;
+	} else {
+		vars_array_clear(a);
+	}
+
+	a->values = values;
+	a->n = n;
+}
+
+const char *vars_array_get(const char *name, long idx)
+{
+	struct array_var *a = *vars_array_find(name);
+
+	if (a == NULL)
+		return NULL;
+
+	if (idx < 0)
+		idx += a->n;
+
+	if (idx < 0 || idx >= a->n)
+		return NULL;
+
+	return a->values[idx];
+}
+
+int vars_array_size(const char *name)
+{
+	struct array_var *a = *vars_array_find(name);
+
+	return a != NULL ? a->n : -1;
+}
+
+void vars_array_unset(const char *name)
+{
+	struct array_var **slot = vars_array_find(name);
+	struct array_var *a = *slot;
+
+	if (a == NULL)
+		return;
+
+	*slot = a->next;
+	vars_array_clear(a);
+	free(a->name);
+	free(a);
+}
@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _VARS_H
+#define _VARS_H
+
+/**
+ * Shell-private array variables. Scalars stay in the environment (see the
+ * assignment branch of parse_simple); arrays cannot be exported, so they
+ * live here and are reached through '${name[i]}', '${name[@]}' and
+ * '${#name[@]}'.
+ */
+
+/**
+ * Replace the array called name with the n values (taken over by the
+ * array, values itself included).
+ */
+void vars_array_set(const char *name, char **values, int n);
+
+/**
+ * Return element idx of the array, or NULL if unset. Negative indexes
+ * count from the end.
+ */
+const char *vars_array_get(const char *name, long idx);
+
+/**
+ * Return the number of elements of the array, -1 if there is no such array.
+ */
+int vars_array_size(const char *name);
+
+void vars_array_unset(const char *name);
+
+#endif /* _VARS_H */